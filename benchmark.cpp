@@ -0,0 +1,1096 @@
+/*
+ * Micro-benchmarks for the hot paths of the renderer. Run with the name of a benchmark, or none to run all.
+ */
+
+#include "iostream"
+#include "chrono"
+#include "string"
+#include "vector"
+#include "random"
+#include "bit"
+#include "fstream"
+#include "thread"
+#include "sstream"
+#include "cstdio"
+#include "./includes/common.h"
+#include "./includes/scenes.h"
+
+namespace bench {
+    using clock = std::chrono::high_resolution_clock;
+
+    template<typename F>
+    double time_ns_per_op(size_t ops, F&& body) {                               // returns ns per op
+        auto start = clock::now();
+        body();
+        auto end = clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(ops);
+    }
+
+    template<typename F>
+    double time_ms(F&& body) {
+        auto start = clock::now();
+        body();
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+
+    void rng() {
+        constexpr size_t N = 50'000'000;
+        double sink = 0.0;                                                      // keep the results alive
+
+        std::mt19937 gen(42);                                                   // the old utilities::gen setup
+        std::uniform_real_distribution<double> dis(0.0, 1.0);
+        auto mt = time_ns_per_op(N, [&] { for (size_t i = 0; i != N; ++i) sink += dis(gen); });
+
+        sampler::rng fast(42);
+        auto xo = time_ns_per_op(N, [&] { for (size_t i = 0; i != N; ++i) sink += fast.uniform(); });
+
+        std::vector<double> buffer(4096);
+        auto batched = time_ns_per_op(N, [&] {
+            for (size_t i = 0; i < N; i += buffer.size()) {
+                fast.fill(buffer.data(), buffer.size());
+                sink += buffer[i & 4095];
+            }
+        });
+
+        auto tls = time_ns_per_op(N, [&] { for (size_t i = 0; i != N; ++i) sink += utilities::random_double(); });
+
+        std::cout << "rng: mt19937 + uniform_real_distribution  " << mt << " ns/double  ("
+                  << sizeof(std::mt19937) << " bytes state)\n"
+                  << "rng: sampler::rng::uniform                 " << xo << " ns/double  ("
+                  << sizeof(sampler::rng) << " bytes state)\n"
+                  << "rng: sampler::rng::fill                    " << batched << " ns/double\n"
+                  << "rng: utilities::random_double (thread_rng) " << tls << " ns/double\n"
+                  << "(sink " << sink << ")" << std::endl;
+    }
+
+    // The geometry of main.cpp's final_scene: 400 ground boxes (six quads each) and the 1000-sphere cluster,
+    // flattened into one list so the BVH builders see every primitive.
+    hittable_list final_scene_primitives() {
+        hittable_list objects;
+        auto ground = std::make_shared<material::lambertian>(color(0.48, 0.83, 0.53));
+        for (int i = 0; i < 20; i++) {
+            for (int j = 0; j < 20; j++) {
+                auto x0 = -1000.0 + i * 100.0, z0 = -1000.0 + j * 100.0;
+                auto y1 = 1 + sin(i + j) * 101;
+                auto box = instance::box(objects.materials(), point3(x0, 0, z0), point3(x0 + 100, y1, z0 + 100),
+                                         ground);
+                for (const auto& side: box->objects) objects.add(side);
+            }
+        }
+        auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+        for (int j = 0; j < 1000; j++) {
+            auto center = normalize(vec3(sin(j), cos(j), tan(j))) * 165.0 + vec3(-100, 270, 395);
+            objects.add(std::make_shared<primitive::sphere>(objects.materials(), center, 10, white));
+        }
+        return objects;
+    }
+
+    // the world of a scene in scenes.h, built by the same code main.cpp and rt_bench render; its camera settings
+    // are left to each benchmark
+    hittable_list scene_world(const std::string& name) {
+        hittable_list world;
+        for (const auto& scene: scenes::all()) {
+            if (name != scene.name) continue;
+            camera cam;
+            scene.setup(world, cam);
+        }
+        return world;
+    }
+
+    // primary-like rays from the final_scene camera towards random points of the scene bounds
+    std::vector<ray> scene_rays(const hittable& world, size_t count) {
+        sampler::rng generator(7);
+        auto box = world.bounding_box();
+        point3 origin(478, 278, -600);
+        std::vector<ray> rays;
+        rays.reserve(count);
+        for (size_t i = 0; i != count; ++i) {
+            point3 target(generator.uniform(box.x.min, box.x.max), generator.uniform(box.y.min, box.y.max),
+                          generator.uniform(box.z.min, box.z.max));
+            rays.emplace_back(origin, target - origin, 0.0);
+        }
+        return rays;
+    }
+
+    double mrays_per_second(const hittable& world, const std::vector<ray>& rays, size_t& hits) {
+        hits = 0;
+        auto start = clock::now();
+        for (const auto& r: rays) {
+            hit_record rec;
+            if (world.hit(r, interval(min_hit_distance(r), utilities::infinity), rec)) {
+                rec.compute_surface(r);                                         // what shading would need
+                ++hits;
+            }
+        }
+        auto seconds = std::chrono::duration<double>(clock::now() - start).count();
+        return static_cast<double>(rays.size()) / seconds * 1e-6;
+    }
+
+    void bvh() {
+        auto objects = final_scene_primitives();
+        auto rays = scene_rays(objects, 1'000'000);
+        bvh_build_options median;
+        median.method = bvh_build_options::split_method::random_median;
+        median.max_leaf_size = 1;
+        bvh_build_options sah;
+        size_t reference_hits;                                                  // brute force, for correctness
+        mrays_per_second(objects, std::vector<ray>(rays.begin(), rays.begin() + 20000), reference_hits);
+        std::cout << "bvh: brute force hits on the first 20000 rays: " << reference_hits << std::endl;
+        for (auto [name, options]: {std::pair{"random median", median}, std::pair{"binned SAH   ", sah}}) {
+            auto start = clock::now();
+            auto tree = std::make_shared<bvh_node>(objects, options);
+            auto build_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            size_t hits;
+            auto speed = mrays_per_second(*tree, rays, hits);
+            std::cout << "bvh: " << name << "  build " << build_ms << " ms  SAH cost " << tree->sah_cost(options)
+                      << "  " << speed << " Mrays/s  (" << hits << " hits)" << std::endl;
+        }
+        auto start = clock::now();
+        auto flat = std::make_shared<linear_bvh>(objects, sah);
+        auto build_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        size_t hits;
+        auto speed = mrays_per_second(*flat, rays, hits);
+        std::cout << "bvh: linear_bvh     build " << build_ms << " ms  " << flat->node_count() << " nodes x "
+                  << sizeof(linear_bvh_node) << " bytes  " << speed << " Mrays/s  (" << hits << " hits)" << std::endl;
+    }
+
+    // aabb::hit on the rays a slab test gets wrong most easily: parallel to an axis and starting exactly on a slab
+    // plane, where the slab distance is 0 * inf = NaN, and through edges and corners.
+    void slab() {
+        struct slab_case {
+            point3 origin;
+            vec3 direction;
+            bool hit;
+        };
+        aabb box(point3(0, 0, 0), point3(1, 1, 1));
+        const slab_case cases[] = {{point3(0.5, 0.5, -1), vec3(0, 0, 1), true},      // through the middle
+                                   {point3(0, 0.5, -1), vec3(0, 0, 1), true},        // on the plane x = min
+                                   {point3(1, 0.5, -1), vec3(0, 0, 1), true},        // on the plane x = max
+                                   {point3(0.5, 0, -1), vec3(0, 0, -1), false},      // on y = min, away from it
+                                   {point3(-1, 0.5, 1), vec3(1, 0, 0), true},        // on z = max, along x
+                                   {point3(1.5, 0.5, -1), vec3(0, 0, 1), false},     // parallel, outside
+                                   {point3(-1, -1, -1), vec3(1, 1, 1), true},        // corner to corner
+                                   {point3(0, 2, 0.5), vec3(1, -1, 0), false}};      // touches an edge only
+        int wrong = 0;
+        for (const auto& test: cases) {
+            ray r(test.origin, test.direction, 0.0);
+            if (box.hit(r, interval(0, utilities::infinity)) == test.hit) continue;
+            ++wrong;
+            std::cout << "slab: wrong for origin " << test.origin << " direction " << test.direction << std::endl;
+        }
+        std::cout << "slab: " << std::size(cases) - wrong << " of " << std::size(cases) << " cases right"
+                  << std::endl;
+    }
+
+    // Rays aimed just inside the edges of quads spread over a large cube, where the float node test is closest to
+    // rounding a box away: every ray the brute-force list hits must hit the same quad at the same t through bvh4.
+    void bvh4_edges() {
+        auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+        sampler::rng generator(11);
+        auto random_vector = [&](double lo, double hi) {
+            return vec3(generator.uniform(lo, hi), generator.uniform(lo, hi), generator.uniform(lo, hi));
+        };
+        struct edges {
+            point3 corner;
+            vec3 u, v;
+        };
+        hittable_list quads;
+        std::vector<edges> shapes;
+        for (int i = 0; i != 800; ++i) {
+            point3 corner = random_vector(0, 5000);
+            vec3 u = random_vector(0, 200), v = random_vector(0, 200);       // quad's box spans Q to Q + u + v
+            if (i % 2 == 0) {                                                   // half of them axis-aligned, flat
+                int axis = i / 2 % 3;                                           // boxes padded to a sliver
+                u[axis] = v[axis] = 0;
+            }
+            shapes.push_back({corner, u, v});
+            quads.add(std::make_shared<primitive::quad>(quads.materials(), corner, u, v, white));
+        }
+        bvh_build_options single;                                               // so quad edges are box faces
+        single.max_leaf_size = 1;
+        ::bvh4 wide(quads, single);
+        constexpr double inset = 1e-3;                                          // world units inside an edge
+        size_t reference_hits = 0, misses = 0;
+        for (int i = 0; i != 2'000'000; ++i) {
+            const auto& shape = shapes[generator.bounded(static_cast<uint32_t>(shapes.size()))];
+            bool flip = generator.uniform() < 0.5;
+            const auto& along_edge = flip ? shape.v : shape.u;
+            const auto& across_edge = flip ? shape.u : shape.v;
+            double across = inset / across_edge.length();
+            if (generator.uniform() < 0.5) across = 1 - across;
+            auto target = shape.corner + generator.uniform() * along_edge + across * across_edge;
+            // short rays far from the world origin: the slab distances are small next to origin * inv_direction
+            auto direction = normalize(random_vector(-1, 1));
+            ray r(target - generator.uniform(1, 100) * direction, direction, 0.0);
+            interval ray_t(min_hit_distance(r), utilities::infinity);
+            hit_record expected, found;
+            if (!quads.hit(r, ray_t, expected)) continue;
+            ++reference_hits;
+            if (!wide.hit(r, ray_t, found) || found.object != expected.object || found.t != expected.t) ++misses;
+        }
+        std::cout << "bvh4: edge rays  " << reference_hits << " brute force hits, " << misses << " missed by bvh4"
+                  << std::endl;
+    }
+
+    // Binary vs 4-wide traversal of the same builder output, on final_scene's primitives and on a large random
+    // sphere cloud where traversal dominates.
+    void bvh4() {
+        auto cloud = [] {
+            auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+            sampler::rng generator(3);
+            hittable_list spheres;
+            for (int i = 0; i != 200'000; ++i) {
+                point3 center(generator.uniform(-500, 500), generator.uniform(-500, 500), generator.uniform(0, 1000));
+                auto radius = generator.uniform(0.5, 3.0);
+                spheres.add(std::make_shared<primitive::sphere>(spheres.materials(), center, radius, white));
+            }
+            return spheres;
+        };
+        std::pair<const char*, hittable_list> cases[] = {{"final_scene", final_scene_primitives()},
+                                                         {"sphere_cloud", cloud()}};
+        std::cout << "bvh4: node test " << ::bvh4::node_test() << std::endl;
+        for (auto& [name, objects]: cases) {
+            auto rays = scene_rays(objects, 1'000'000);
+            linear_bvh binary(objects);
+            ::bvh4 wide(objects);
+            size_t binary_hits, wide_hits;
+            double binary_speed = 0.0, wide_speed = 0.0;
+            for (int repeat = 0; repeat != 3; ++repeat) {
+                binary_speed = std::max(binary_speed, mrays_per_second(binary, rays, binary_hits));
+                wide_speed = std::max(wide_speed, mrays_per_second(wide, rays, wide_hits));
+            }
+            std::cout << "bvh4: " << name << "  linear_bvh " << binary_speed << " Mrays/s (" << binary_hits
+                      << " hits)  bvh4 " << wide_speed << " Mrays/s (" << wide_hits << " hits, "
+                      << wide.node_count() << " nodes x " << sizeof(bvh4_node) << " bytes)" << std::endl;
+        }
+        bvh4_edges();
+    }
+
+
+    // sphere_set against the same spheres as separate primitive::sphere objects in a linear_bvh: final_scene's
+    // cluster, and a random cloud large enough to leave the caches. Memory of the object version counts the
+    // sphere, its make_shared control block, the bvh's shared_ptr to it and the nodes.
+    void sphere_set() {
+        auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+        auto cluster = [&](auto&& add) {
+            for (int j = 0; j < 1000; j++) add(normalize(vec3(sin(j), cos(j), tan(j))) * 165.0, 10.0);
+        };
+        auto cloud = [&](auto&& add) {
+            sampler::rng generator(3);
+            for (int i = 0; i != 200'000; ++i) {
+                point3 center(generator.uniform(-500, 500), generator.uniform(-500, 500), generator.uniform(0, 1000));
+                add(center, generator.uniform(0.5, 3.0));
+            }
+        };
+        auto run = [&](const char* name, auto&& generate) {
+            hittable_list objects;
+            primitive::sphere_set set(objects.materials());
+            generate([&](const point3& center, double radius) {
+                objects.add(std::make_shared<primitive::sphere>(objects.materials(), center, radius, white));
+                set.add(center, radius, white);
+            });
+            auto n = static_cast<double>(objects.objects.size());
+            linear_bvh tree(objects);
+            auto set_build_ms = time_ms([&] { set.build(); });
+            auto rays = scene_rays(objects, 1'000'000);
+            size_t tree_hits, set_hits;
+            double tree_speed = 0.0, set_speed = 0.0;
+            for (int repeat = 0; repeat != 3; ++repeat) {
+                tree_speed = std::max(tree_speed, mrays_per_second(tree, rays, tree_hits));
+                set_speed = std::max(set_speed, mrays_per_second(set, rays, set_hits));
+            }
+            auto object_bytes = static_cast<double>(sizeof(primitive::sphere) + 2 * sizeof(long)
+                                                    + sizeof(std::shared_ptr<hittable>))
+                                + static_cast<double>(tree.node_count() * sizeof(linear_bvh_node)) / n;
+            std::cout << "sphere_set: " << name << " (" << objects.objects.size() << " spheres)\n"
+                      << "  spheres + linear_bvh  " << object_bytes << " bytes/sphere  " << tree_speed
+                      << " Mrays/s (" << tree_hits << " hits)\n"
+                      << "  sphere_set            " << static_cast<double>(set.memory_bytes()) / n
+                      << " bytes/sphere  " << set_speed << " Mrays/s (" << set_hits << " hits, " << set.node_count()
+                      << " nodes, " << set.block_count() << " blocks of " << primitive::sphere_set::lanes
+                      << ", build " << set_build_ms << " ms)" << std::endl;
+        };
+        run("final_scene cluster", cluster);
+        run("sphere_cloud", cloud);
+    }
+
+    // A closed UV sphere of about `triangles` triangles, with normals, as an OBJ file: rings of `slices` vertices
+    // and one vertex per pole, so every edge is shared by exactly two triangles.
+    size_t write_sphere_obj(const std::string& filename, size_t triangles) {
+        auto slices = static_cast<size_t>(std::sqrt(static_cast<double>(triangles) / 2.0)) + 3;
+        auto stacks = triangles / (2 * slices) + 2;
+        std::ofstream file(filename);
+        char line[96];
+        auto vertex = [&](double theta, double phi) {
+            double x = std::sin(theta) * std::cos(phi), y = std::cos(theta), z = std::sin(theta) * std::sin(phi);
+            file.write(line, std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvn %.6f %.6f %.6f\n",
+                                           100 * x, 100 * y, 100 * z, x, y, z));
+        };
+        vertex(0, 0);                                                           // 1: north pole
+        for (size_t i = 1; i != stacks; ++i)
+            for (size_t j = 0; j != slices; ++j)
+                vertex(utilities::pi * i / stacks, 2 * utilities::pi * j / slices);
+        vertex(utilities::pi, 0);                                               // last: south pole
+        auto ring = [&](size_t i, size_t j) { return 2 + (i - 1) * slices + j % slices; };
+        auto south = 2 + (stacks - 1) * slices;
+        auto face = [&](size_t a, size_t b, size_t c) {
+            file.write(line, std::snprintf(line, sizeof(line), "f %zu//%zu %zu//%zu %zu//%zu\n", a, a, b, b, c, c));
+        };
+        size_t count = 0;
+        for (size_t j = 0; j != slices; ++j, count += 2) {
+            face(1, ring(1, j + 1), ring(1, j));
+            face(south, ring(stacks - 1, j), ring(stacks - 1, j + 1));
+        }
+        for (size_t i = 1; i + 1 < stacks; ++i)
+            for (size_t j = 0; j != slices; ++j, count += 2) {
+                face(ring(i, j), ring(i, j + 1), ring(i + 1, j + 1));
+                face(ring(i, j), ring(i + 1, j + 1), ring(i + 1, j));
+            }
+        return count;
+    }
+
+    // the line-by-line ifstream parse the mapped one replaces, positions and faces only, for comparison
+    size_t legacy_obj_read(const std::string& filename, std::vector<point3>& positions,
+                           std::vector<uint32_t>& indices) {
+        std::ifstream file(filename);
+        std::string line, keyword, corner;
+        while (std::getline(file, line)) {
+            std::istringstream in(line);
+            in >> keyword;
+            if (keyword == "v") {
+                double x, y, z;
+                in >> x >> y >> z;
+                positions.emplace_back(x, y, z);
+            } else if (keyword == "f") {
+                std::vector<uint32_t> polygon;
+                while (in >> corner) polygon.push_back(static_cast<uint32_t>(std::stoul(corner) - 1));
+                for (size_t i = 1; i + 1 < polygon.size(); ++i)
+                    indices.insert(indices.end(), {polygon[0], polygon[i], polygon[i + 1]});
+            }
+        }
+        return indices.size() / 3;
+    }
+
+    // triangle_mesh from OBJ files of growing size: parse throughput against a getline loader, BVH build time,
+    // memory per triangle, Mrays/s, and a watertightness check: rays from the center of the closed sphere through
+    // its vertices and edge midpoints, where neighbouring triangles meet, must all hit.
+    void mesh(size_t max_triangles) {
+        auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+        const std::string filename = "bench_mesh.obj";
+        for (size_t target = 10'000; target <= max_triangles; target *= 10) {
+            auto written = write_sphere_obj(filename, target);
+            double megabytes = 0.0;
+            {
+                mapped_file file(filename);
+                megabytes = static_cast<double>(file.size) / (1 << 20);
+            }
+            primitive::triangle_mesh::buffers buffers;
+            bool read = false;
+            auto read_ms = time_ms([&] { read = obj_file::read(filename, buffers); });
+            if (!read || buffers.indices.size() != 3 * written) {
+                std::cout << "mesh: reading " << filename << " failed" << std::endl;
+                return;
+            }
+            double legacy_ms = 0.0;
+            if (target <= 1'000'000) {
+                std::vector<point3> positions;
+                std::vector<uint32_t> indices;
+                legacy_ms = time_ms([&] { legacy_obj_read(filename, positions, indices); });
+            }
+            auto corners = buffers.indices;
+            auto positions = buffers.positions;
+            material::material_table materials;
+            std::unique_ptr<primitive::triangle_mesh> mesh;
+            auto build_ms = time_ms([&] {
+                mesh = std::make_unique<primitive::triangle_mesh>(materials, std::move(buffers), white);
+            });
+
+            auto rays = scene_rays(*mesh, 1'000'000);
+            size_t hits;
+            double speed = 0.0;
+            for (int repeat = 0; repeat != 3; ++repeat) speed = std::max(speed, mrays_per_second(*mesh, rays, hits));
+
+            size_t misses = 0, probes = 0;
+            auto probe = [&](const point3& target_point) {
+                ray r(point3(0, 0, 0), target_point, 0.0);
+                hit_record rec;
+                ++probes;
+                if (!mesh->hit(r, interval(0, utilities::infinity), rec)) ++misses;
+            };
+            for (size_t i = 0; i + 2 < corners.size() && probes < 3'000'000; i += 3) {
+                point3 p[3];
+                for (int k = 0; k != 3; ++k) p[k] = point3(positions[corners[i + k]]);
+                probe(p[0]);
+                for (int k = 0; k != 3; ++k) probe((p[k] + p[(k + 1) % 3]) / 2);
+            }
+
+            auto n = static_cast<double>(mesh->triangle_count());
+            std::cout << "mesh: " << mesh->triangle_count() << " triangles, " << mesh->vertex_count()
+                      << " vertices, " << megabytes << " MB of OBJ\n"
+                      << "  read      " << read_ms << " ms  " << megabytes / read_ms * 1000 << " MB/s  "
+                      << n / read_ms / 1000 << " Mtriangles/s";
+            if (legacy_ms > 0) std::cout << "  (getline loader " << legacy_ms << " ms)";
+            std::cout << "\n  build     " << build_ms << " ms, " << mesh->node_count() << " nodes\n"
+                      << "  memory    " << static_cast<double>(mesh->memory_bytes()) / n << " bytes/triangle\n"
+                      << "  trace     " << speed << " Mrays/s (" << hits << " hits)\n"
+                      << "  watertight " << misses << " misses of " << probes << " rays through vertices and edges"
+                      << std::endl;
+        }
+        std::remove(filename.c_str());
+    }
+
+    // Dense, overlapping soups of spheres and of quads: a ray accepts several candidate hits before the closest,
+    // so this is where the per-candidate cost of filling in a hit record shows.
+    void surface() {
+        auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+        sampler::rng generator(13);
+        hittable_list spheres, quads;
+        for (int i = 0; i != 50'000; ++i) {
+            point3 center(generator.uniform(0, 200), generator.uniform(0, 200), generator.uniform(0, 200));
+            auto radius = generator.uniform(2, 8);
+            spheres.add(std::make_shared<primitive::sphere>(spheres.materials(), center, radius, white));
+            auto direction = [&] {
+                return normalize(vec3(generator.uniform(-1, 1), generator.uniform(-1, 1), generator.uniform(-1, 1)));
+            };
+            auto u = direction() * generator.uniform(5, 20);
+            auto v = normalize(cross(u, direction())) * generator.uniform(5, 20);
+            quads.add(std::make_shared<primitive::quad>(quads.materials(), center, u, v, white));
+        }
+        material::material_table materials;
+        primitive::sphere sphere(materials, point3(0, 0, 0), 1.0, white);       // one accepted hit per call
+        primitive::quad quad(materials, point3(-1, -1, 0), vec3(2, 0, 0), vec3(0, 2, 0), white);
+        std::vector<ray> rays;
+        for (int i = 0; i != 1'000'000; ++i)
+            rays.emplace_back(point3(generator.uniform(-0.7, 0.7), generator.uniform(-0.7, 0.7), -5), vec3(0, 0, 1), 0.0);
+        for (auto [name, object]: {std::pair<const char*, const hittable*>{"sphere", &sphere}, {"quad  ", &quad}}) {
+            real sink = 0;
+            auto ns = time_ns_per_op(rays.size(), [&] {
+                for (const auto& r: rays) {
+                    hit_record rec;
+                    if (object->hit(r, interval(0.0001, utilities::infinity), rec)) sink += rec.t;
+                }
+            });
+            std::cout << "surface: " << name << " hit()  " << ns << " ns per accepted hit  (sink " << sink << ")"
+                      << std::endl;
+        }
+        std::pair<const char*, hittable_list> cases[] = {{"sphere_soup", std::move(spheres)},
+                                                         {"quad_soup", std::move(quads)}};
+        for (auto& [name, objects]: cases) {
+            linear_bvh tree(objects);
+            auto rays = scene_rays(objects, 1'000'000);
+            size_t hits;
+            double best = 0.0;
+            for (int repeat = 0; repeat != 3; ++repeat) best = std::max(best, mrays_per_second(tree, rays, hits));
+            std::cout << "surface: " << name << "  " << best << " Mrays/s  (" << hits << " hits)" << std::endl;
+        }
+    }
+
+    // Closest-hit throughput of whole scenes: camera rays through random pixels, then one random bounce from
+    // every hit, so both coherent and incoherent rays are in the mix.
+    void traversal() {
+        struct scene_case {
+            const char* name;
+            hittable_list world;
+            point3 lookfrom, lookat;
+        };
+        scene_case scenes[] = {
+                {"cornell_box", scene_world("cornell_box"), point3(278, 278, -800), point3(278, 278, 0)},
+                {"final_scene", scene_world("final_scene"), point3(478, 278, -600), point3(278, 278, 0)},
+        };
+        for (auto& scene: scenes) {
+            sampler::rng generator(11);
+            auto w = normalize(scene.lookfrom - scene.lookat);
+            auto u = normalize(cross(vec3(0, 1, 0), w));
+            auto v = cross(w, u);
+            auto half = std::tan(utilities::degree_to_radian(40) / 2);
+            std::vector<ray> rays;
+            for (int i = 0; i != 500'000; ++i) {
+                auto px = generator.uniform(-half, half), py = generator.uniform(-half, half);
+                rays.emplace_back(scene.lookfrom, px * u + py * v - w, 0.0);
+            }
+            size_t primary = rays.size();
+            for (size_t i = 0; i != primary; ++i) {                             // secondary rays
+                hit_record rec;
+                if (!scene.world.hit(rays[i], interval(min_hit_distance(rays[i]), utilities::infinity), rec))
+                    continue;
+                rec.compute_surface(rays[i]);
+                rays.emplace_back(rec.p, rec.normal + vec3::random_unit_vec_on_sphere(), 0.0);
+            }
+            size_t hits;
+            double best = 0.0;
+            for (int repeat = 0; repeat != 3; ++repeat)
+                best = std::max(best, mrays_per_second(scene.world, rays, hits));
+            std::cout << "traversal: " << scene.name << "  " << best << " Mrays/s  (" << rays.size()
+                      << " rays, " << hits << " hits)" << std::endl;
+        }
+    }
+
+    // Closest hits of the cornell box, most of them on the one shared `white` material, traced by several threads
+    // at once (every thread traces the same rays). Anything a hit writes to shared state shows up here as lost
+    // scaling: refcounts on the material used to be such a write.
+    void contention() {
+        auto world = scene_world("cornell_box");
+        sampler::rng generator(5);
+        point3 lookfrom(278, 278, -800);
+        auto half = std::tan(utilities::degree_to_radian(40) / 2);
+        std::vector<ray> rays;
+        for (int i = 0; i != 500'000; ++i)
+            rays.emplace_back(lookfrom, vec3(generator.uniform(-half, half), generator.uniform(-half, half), 1.0), 0.0);
+        auto hardware = std::max(1u, std::thread::hardware_concurrency());
+        std::cout << "contention: " << hardware << " hardware threads" << std::endl;
+        std::vector<unsigned int> thread_counts = {1, 2, 4};
+        if (hardware > 4) thread_counts.push_back(hardware);
+        for (auto threads: thread_counts) {
+            std::vector<size_t> hits(threads, 0);
+            auto ms = time_ms([&] {
+                std::vector<std::thread> workers;
+                for (unsigned int t = 0; t != threads; ++t)
+                    workers.emplace_back([&, t] { mrays_per_second(world, rays, hits[t]); });
+                for (auto& worker: workers) worker.join();
+            });
+            auto total = static_cast<double>(rays.size()) * threads;
+            std::cout << "contention: " << threads << " threads  " << total / ms * 1e-3 << " Mrays/s total  "
+                      << total / ms * 1e-3 / threads << " per thread  (" << hits[0] << " hits each)" << std::endl;
+        }
+    }
+
+    // Primary visibility only: one camera ray through every pixel of a 1920x1080 image, traced one at a time and
+    // as packets over 2x2, 4x2 and 4x4 pixel blocks, the way camera's packet mode groups them.
+    void packets() {
+        struct scene_case {
+            const char* name;
+            hittable_list world;
+            point3 lookfrom, lookat;
+        };
+        scene_case scenes[] = {
+                {"cornell_box", scene_world("cornell_box"), point3(278, 278, -800), point3(278, 278, 0)},
+                {"final_scene", scene_world("final_scene"), point3(478, 278, -600), point3(278, 278, 0)},
+        };
+        constexpr int width = 1920, height = 1080;
+        for (auto& scene: scenes) {
+            auto w = normalize(scene.lookfrom - scene.lookat);
+            auto u = normalize(cross(vec3(0, 1, 0), w));
+            auto v = cross(w, u);
+            auto half_h = std::tan(utilities::degree_to_radian(40) / 2), half_w = half_h * width / height;
+            auto camera_ray = [&](int x, int y) {
+                auto px = (2.0 * (x + 0.5) / width - 1.0) * half_w, py = (1.0 - 2.0 * (y + 0.5) / height) * half_h;
+                return ray(scene.lookfrom, px * u + py * v - w, 0.0);
+            };
+            std::cout << "packets: " << scene.name;
+            for (int block: {1, 4, 8, 16}) {
+                int block_w = block == 1 ? 1 : block == 4 ? 2 : 4, block_h = block / block_w;
+                double best = 0.0;
+                size_t hits = 0;
+                for (int repeat = 0; repeat != 3; ++repeat) {
+                    hits = 0;
+                    auto start = clock::now();
+                    ray rays[ray_packet::max_size];
+                    hit_record records[ray_packet::max_size];
+                    ray_packet packet;
+                    for (int y0 = 0; y0 < height; y0 += block_h) {
+                        for (int x0 = 0; x0 < width; x0 += block_w) {
+                            int lanes = 0;
+                            for (int y = y0; y != y0 + block_h; ++y)
+                                for (int x = x0; x != x0 + block_w; ++x) rays[lanes++] = camera_ray(x, y);
+                            if (block == 1) {
+                                hits += scene.world.hit(rays[0], interval(min_hit_distance(rays[0]), utilities::infinity),
+                                                        records[0]);
+                                continue;
+                            }
+                            packet.assign(rays, lanes);
+                            hits += std::popcount(scene.world.hit_packet(packet, packet.all_lanes(), records));
+                        }
+                    }
+                    auto seconds = std::chrono::duration<double>(clock::now() - start).count();
+                    best = std::max(best, width * height / seconds * 1e-6);
+                }
+                std::cout << "  " << (block == 1 ? "single" : std::to_string(block) + "-ray") << " " << best
+                          << " Mrays/s (" << hits << " hits)";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    // The cornell box at a fixed seed, so the double and float32 builds can be compared with image_diff.
+    void render(const std::string& filename, unsigned int samples) {
+        std::cout << "render: real is " << (sizeof(real) == 4 ? "float" : "double") << ", sizeof(ray) "
+                  << sizeof(ray) << ", sizeof(hit_record) " << sizeof(hit_record) << ", sizeof(aabb) "
+                  << sizeof(aabb) << std::endl;
+        auto world = scene_world("cornell_box");
+        camera cam;
+        cam.set_camera_parameter(1.0, 400);
+        cam.samples_per_pixel = samples;
+        cam.max_depth = 50;
+        cam.rng_seed = 1;
+        cam.print_progress = false;
+        cam.background_function = [](double) -> color { return {0, 0, 0}; };
+        cam.vfov = 40;
+        cam.lookfrom = point3(278, 278, -800);
+        cam.lookat = point3(278, 278, 0);
+        cam.set_output_file(filename);
+        cam.set_focus_parameter(0.0);
+        auto ms = time_ms([&] { cam.render(world); });
+        std::cout << "render: " << filename << "  " << samples << " spp  " << ms << " ms" << std::endl;
+    }
+
+    std::vector<int> read_ppm(const std::string& filename, int& width, int& height) {
+        std::ifstream file(filename, std::ios::binary);
+        std::string magic;
+        int depth;
+        if (!(file >> magic >> width >> height >> depth) || (magic != "P3" && magic != "P6")) {
+            std::cout << "image_diff: " << filename << " is not a P3 or P6 ppm file." << std::endl;
+            return {};
+        }
+        std::vector<int> values(static_cast<size_t>(width) * height * 3);
+        if (magic == "P6") {
+            file.get();
+            for (auto& value: values) value = file.get();
+        } else {
+            for (auto& value: values) file >> value;
+        }
+        return values;
+    }
+
+    // Time to equal noise of the integrators. Noise is measured without a reference: two renders that differ only
+    // in the seed differ by twice the per-pixel variance, and variance times render time stays the same whatever
+    // the sample count, so it compares integrators that spend their time differently.
+    void integrator() {
+        struct scene_case {
+            const char* name;
+            hittable_list world;
+            point3 lookfrom, lookat;
+            unsigned int samples;
+        };
+        scene_case scenes[] = {
+                {"cornell_box", scene_world("cornell_box"), point3(278, 278, -800), point3(278, 278, 0), 64},
+                {"final_scene", scene_world("final_scene"), point3(478, 278, -600), point3(278, 278, 0), 32},
+        };
+        struct setting {
+            const char* name;
+            camera::integrator_type integrator;
+            unsigned int roulette_depth;
+            bool light_sampling;
+        };
+        setting settings[] = {{"recursive          ", camera::integrator_type::recursive, 0, false},
+                              {"iterative          ", camera::integrator_type::iterative, 50, false},
+                              {"iterative roulette3", camera::integrator_type::iterative, 3, false},
+                              {"iterative roulette5", camera::integrator_type::iterative, 5, false},
+                              {"roulette5 + lights ", camera::integrator_type::iterative, 5, true}};
+        const std::string filename = "integrator_bench.ppm";
+        for (auto& scene: scenes) {
+            double reference = 0.0;
+            for (const auto& option: settings) {
+                std::vector<int> images[2];
+                double ms = 0.0;
+                for (int seed = 0; seed != 2; ++seed) {
+                    camera cam;
+                    cam.set_camera_parameter(1.0, 100);
+                    cam.samples_per_pixel = scene.samples;
+                    cam.max_depth = 50;
+                    cam.rng_seed = seed + 1;
+                    cam.integrator = option.integrator;
+                    cam.roulette_depth = option.roulette_depth;
+                    cam.light_sampling = option.light_sampling;
+                    cam.print_progress = false;
+                    cam.background_function = [](double) -> color { return {0, 0, 0}; };
+                    cam.vfov = 40;
+                    cam.lookfrom = scene.lookfrom;
+                    cam.lookat = scene.lookat;
+                    cam.set_output_file(filename);
+                    cam.set_focus_parameter(0.0);
+                    ms += time_ms([&] { cam.render(scene.world); });
+                    int width, height;
+                    images[seed] = read_ppm(filename, width, height);
+                }
+                double squared = 0.0;
+                for (size_t i = 0; i != images[0].size(); ++i) {
+                    double d = images[0][i] - images[1][i];
+                    squared += d * d;
+                }
+                auto variance = squared / static_cast<double>(images[0].size()) / 2.0;
+                auto cost = variance * ms;
+                if (reference == 0.0) reference = cost;
+                std::cout << "integrator: " << scene.name << "  " << option.name << "  " << ms / 2 << " ms  variance "
+                          << variance << "  time to equal noise " << cost / reference << "x" << std::endl;
+            }
+        }
+        std::remove(filename.c_str());
+    }
+
+    // Wall time to a target error with uniform and with adaptive sampling on two main.cpp scenes. As in integrator(),
+    // the error is measured without a reference, from two renders that differ only in the seed, and is taken to
+    // fall with the square root of the time spent; that gives the time each setting needs for an rmse of 1 level,
+    // over the whole image and in its worst 16x16 tile. Adaptive sampling aims at the second: it evens the error
+    // out, which is not what minimizes the rmse of the whole image.
+    void adaptive() {
+        struct scene_case {
+            const char* name;
+            hittable_list world;
+            point3 lookfrom, lookat;
+            double aspect_ratio;
+            bool lit;                                                       // black background, sample the lights
+        };
+        scene_case scenes[] = {
+                {"sample_scene", scene_world("sample_scene"), point3(-2, 2, 1), point3(0, 0, -1), 16.0 / 9.0, false},
+                {"cornell_box ", scene_world("cornell_box"), point3(278, 278, -800), point3(278, 278, 0), 1.0, true},
+        };
+        struct setting {
+            const char* name;
+            unsigned int samples;
+            double threshold;                                               // 0: uniform
+        };
+        setting settings[] = {{"uniform  256 spp      ", 256, 0}, {"adaptive threshold .02", 1024, 0.02},
+                              {"adaptive threshold .01", 1024, 0.01}};
+        const std::string filename = "adaptive_bench.ppm";
+        for (auto& scene: scenes) {
+            double reference = 0.0, reference_worst = 0.0;
+            for (const auto& option: settings) {
+                std::vector<int> images[2];
+                double ms = 0.0;
+                for (int seed = 0; seed != 2; ++seed) {
+                    camera cam;
+                    cam.set_camera_parameter(scene.aspect_ratio, 160);
+                    cam.samples_per_pixel = option.samples;
+                    cam.max_depth = 50;
+                    cam.rng_seed = seed + 1;
+                    cam.print_progress = false;
+                    cam.tile_size = 16;
+                    cam.adaptive_sampling = option.threshold > 0;
+                    cam.adaptive_threshold = option.threshold;
+                    if (scene.lit) {
+                        cam.integrator = camera::integrator_type::iterative;
+                        cam.light_sampling = true;
+                        cam.background_function = [](double) -> color { return {0, 0, 0}; };
+                    }
+                    cam.vfov = 40;
+                    cam.lookfrom = scene.lookfrom;
+                    cam.lookat = scene.lookat;
+                    cam.set_output_file(filename);
+                    cam.set_focus_parameter(0.0);
+                    ms += time_ms([&] { cam.render(scene.world); });
+                    int width, height;
+                    images[seed] = read_ppm(filename, width, height);
+                }
+                int width = 160, height = static_cast<int>(width / scene.aspect_ratio), tiles_x = (width + 15) / 16;
+                std::vector<double> tile_squared(tiles_x * ((height + 15) / 16)), tile_values(tile_squared.size());
+                double squared = 0.0;
+                for (size_t i = 0; i != images[0].size(); ++i) {
+                    double d = images[0][i] - images[1][i];
+                    auto pixel = static_cast<int>(i / 3);
+                    auto tile = pixel / width / 16 * tiles_x + pixel % width / 16;
+                    squared += d * d;
+                    tile_squared[tile] += d * d;
+                    tile_values[tile] += 1;
+                }
+                double worst = 0.0;
+                for (size_t tile = 0; tile != tile_squared.size(); ++tile)
+                    worst = std::max(worst, tile_squared[tile] / tile_values[tile] / 2.0);
+                auto variance = squared / static_cast<double>(images[0].size()) / 2.0;
+                auto time_to_target = variance * ms / 2, time_to_worst = worst * ms / 2;    // ms for an rmse of 1
+                if (reference == 0.0) reference = time_to_target, reference_worst = time_to_worst;
+                std::cout << "adaptive: " << scene.name << "  " << option.name << "  " << ms / 2 << " ms  rmse "
+                          << std::sqrt(variance) << "  worst tile " << std::sqrt(worst) << "  time to rmse 1: "
+                          << time_to_target / reference << "x, in every tile: " << time_to_worst / reference_worst
+                          << "x" << std::endl;
+            }
+        }
+        std::remove(filename.c_str());
+    }
+
+    // The denoiser against more samples. A denoised image is biased, so two seeds don't tell its error: both scenes
+    // are rendered once at 1024 spp as the reference. Each setting is rendered at n spp without and with denoise,
+    // then without denoise again at however many samples the denoised render's time (render, features and filter)
+    // buys, which is the comparison that matters.
+    void denoise() {
+        struct scene_case {
+            const char* name;
+            hittable_list world;
+            point3 lookfrom, lookat;
+            double aspect_ratio;
+            bool lit;
+        };
+        scene_case scenes[] = {
+                {"sample_scene", scene_world("sample_scene"), point3(-2, 2, 1), point3(0, 0, -1), 16.0 / 9.0, false},
+                {"cornell_box ", scene_world("cornell_box"), point3(278, 278, -800), point3(278, 278, 0), 1.0, true},
+        };
+        const std::string filename = "denoise_bench.ppm";
+        for (auto& scene: scenes) {
+            auto render = [&](unsigned int samples, bool denoised, unsigned long long seed, double& ms) {
+                camera cam;
+                cam.set_camera_parameter(scene.aspect_ratio, 160);
+                cam.samples_per_pixel = samples;
+                cam.max_depth = 50;
+                cam.rng_seed = seed;
+                cam.print_progress = false;
+                cam.denoise = denoised;
+                if (scene.lit) {
+                    cam.integrator = camera::integrator_type::iterative;
+                    cam.light_sampling = true;
+                    cam.background_function = [](double) -> color { return {0, 0, 0}; };
+                }
+                cam.vfov = 40;
+                cam.lookfrom = scene.lookfrom;
+                cam.lookat = scene.lookat;
+                cam.set_output_file(filename);
+                cam.set_focus_parameter(0.0);
+                ms = time_ms([&] { cam.render(scene.world); });
+                int width, height;
+                return read_ppm(filename, width, height);
+            };
+            double ms;
+            auto reference = render(1024, false, 99, ms);
+            auto rmse = [&](const std::vector<int>& image) {
+                double squared = 0.0;
+                for (size_t i = 0; i != image.size(); ++i) squared += (image[i] - reference[i]) * (image[i] - reference[i]);
+                return std::sqrt(squared / static_cast<double>(image.size()));
+            };
+            auto psnr = [](double error) { return 20 * std::log10(255.0 / error); };
+            for (unsigned int samples: {16u, 64u}) {
+                double noisy_ms, denoised_ms, equal_ms;
+                auto noisy = rmse(render(samples, false, 1, noisy_ms));
+                auto denoised = rmse(render(samples, true, 1, denoised_ms));
+                auto equal_samples = static_cast<unsigned int>(std::lround(samples * denoised_ms / noisy_ms));
+                auto equal = rmse(render(equal_samples, false, 1, equal_ms));
+                std::cout << "denoise: " << scene.name << "  " << samples << " spp: noisy rmse " << noisy << " ("
+                          << psnr(noisy) << " dB, " << noisy_ms << " ms), denoised " << denoised << " ("
+                          << psnr(denoised) << " dB, " << denoised_ms << " ms), noisy at equal time (" << equal_samples
+                          << " spp) " << equal << " (" << psnr(equal) << " dB)" << std::endl;
+            }
+        }
+        std::remove(filename.c_str());
+    }
+
+    // Render time with every AOV gathered against none, the best of five runs each, on two main.cpp scenes. The
+    // AOVs cost one lookup and a few adds per camera ray, plus writing six more images.
+    void aov() {
+        struct scene_case {
+            const char* name;
+            hittable_list world;
+            point3 lookfrom, lookat;
+            double aspect_ratio;
+        };
+        scene_case scenes[] = {
+                {"sample_scene", scene_world("sample_scene"), point3(-2, 2, 1), point3(0, 0, -1), 16.0 / 9.0},
+                {"cornell_box ", scene_world("cornell_box"), point3(278, 278, -800), point3(278, 278, 0), 1.0},
+        };
+        const std::string filename = "aov_bench.png";
+        const char* written[] = {"aov_bench.png", "aov_bench_albedo.png", "aov_bench_normal.png",
+                                 "aov_bench_depth.png", "aov_bench_object_id.png", "aov_bench_material_id.png",
+                                 "aov_bench_emission.png"};
+        for (auto& scene: scenes) {
+            double best[2] = {utilities::infinity, utilities::infinity};
+            for (int run = 0; run != 5; ++run) {
+                for (int gathered = 0; gathered != 2; ++gathered) {
+                    camera cam;
+                    cam.set_camera_parameter(scene.aspect_ratio, 400);
+                    cam.samples_per_pixel = 16;
+                    cam.max_depth = 50;
+                    cam.print_progress = false;
+                    if (gathered) cam.aovs = {true, true, true, true, true, true};
+                    cam.vfov = 40;
+                    cam.lookfrom = scene.lookfrom;
+                    cam.lookat = scene.lookat;
+                    cam.set_output_file(filename);
+                    cam.set_focus_parameter(0.0);
+                    best[gathered] = std::min(best[gathered], time_ms([&] { cam.render(scene.world); }));
+                }
+            }
+            std::cout << "aov: " << scene.name << "  beauty only " << best[0] << " ms, with every AOV " << best[1]
+                      << " ms (+" << (best[1] / best[0] - 1) * 100 << "%)" << std::endl;
+        }
+        for (const auto* name: written) std::remove(name);
+    }
+
+    // Writing one 1600x900 image in every format, against the text PPM the camera used to print pixel by pixel
+    // through operator<< (reproduced here). The accumulation buffer is filled with noise so no format gets an easy
+    // image.
+    void image_write() {
+        const int width = 1600, height = 900;
+        const size_t pixels = static_cast<size_t>(width) * height;
+        std::vector<double> accumulation(pixels * 3);
+        std::vector<unsigned int> samples(pixels, 16);
+        std::mt19937_64 generator(3);
+        std::uniform_real_distribution<double> uniform(0.0, 16.0);
+        for (auto& value: accumulation) value = uniform(generator);
+        std::vector<unsigned char> rgb(pixels * 3);
+        std::vector<float> linear(pixels * 3);
+        const std::string filename = "image_write_bench";
+
+        auto display_ms = time_ms([&] {
+            image_file::to_display(accumulation.data(), samples.data(), pixels, rgb.data());
+        });
+        auto linear_ms = time_ms([&] {
+            image_file::to_linear(accumulation.data(), samples.data(), pixels, linear.data());
+        });
+        std::cout << "image_write: to_display " << display_ms << " ms  to_linear " << linear_ms << " ms" << std::endl;
+
+        auto stream_ms = time_ms([&] {
+            std::ofstream out(filename + ".ppm");
+            out << "P3\n" << width << ' ' << height << "\n255\n";
+            for (size_t i = 0; i != pixels; ++i)
+                out << int(rgb[i * 3]) << ' ' << int(rgb[i * 3 + 1]) << ' ' << int(rgb[i * 3 + 2]) << '\n';
+            out << std::endl;
+        });
+        auto text_ms = time_ms([&] { image_file::write_ppm_text(filename + ".ppm", width, height, rgb.data()); });
+        auto binary_ms = time_ms([&] { image_file::write_ppm_binary(filename + ".ppm", width, height, rgb.data()); });
+        auto pfm_ms = time_ms([&] { image_file::write_pfm(filename + ".pfm", width, height, linear.data()); });
+        auto png_ms = time_ms([&] { image_file::write_png(filename + ".png", width, height, rgb.data()); });
+        std::cout << "image_write: P3 operator<< " << stream_ms << " ms  P3 " << text_ms << " ms  P6 " << binary_ms
+                  << " ms  PFM " << pfm_ms << " ms  PNG " << png_ms << " ms" << std::endl;
+        for (const char* extension: {".ppm", ".pfm", ".png"}) std::remove((filename + extension).c_str());
+    }
+
+    // Many short passes against one long one. Both spend the same samples, so with an accumulation buffer that
+    // keeps every sample the two images differ by noise only; a buffer that rounds each pass drifts away.
+    void progressive() {
+        auto world = scene_world("cornell_box");
+        const std::string filename = "progressive_bench.ppm";
+        auto render = [&](unsigned passes, unsigned samples, unsigned seed) {
+            camera cam;
+            cam.set_camera_parameter(1.0, 100);
+            cam.samples_per_pixel = samples;
+            cam.max_depth = 50;
+            cam.rng_seed = seed;
+            cam.print_progress = false;
+            cam.background_function = [](double) -> color { return {0, 0, 0}; };
+            cam.vfov = 40;
+            cam.lookfrom = point3(278, 278, -800);
+            cam.lookat = point3(278, 278, 0);
+            cam.set_output_file(filename);
+            cam.set_focus_parameter(0.0);
+            for (unsigned i = 0; i != passes; ++i) cam.render(world);
+            int width, height;
+            return read_ppm(filename, width, height);
+        };
+        auto reference = render(1, 1024, 1);
+        auto compare = [&](const char* name, const std::vector<int>& image) {
+            double squared = 0.0, difference = 0.0;
+            for (size_t i = 0; i != image.size(); ++i) {
+                squared += double(image[i] - reference[i]) * (image[i] - reference[i]);
+                difference += image[i] - reference[i];
+            }
+            auto n = static_cast<double>(image.size());
+            std::cout << "progressive: " << name << "  rmse " << std::sqrt(squared / n) << "  mean difference "
+                      << difference / n << std::endl;
+        };
+        compare("1 pass x 256 spp ", render(1, 256, 2));
+        compare("256 passes x 1 spp", render(256, 1, 3));
+        std::remove(filename.c_str());
+    }
+
+    // RMSE, mean difference and PSNR of two renders, e.g. the double and the float32 build at the same seed.
+    // Two double renders at different seeds give the noise floor to compare against.
+    void image_diff(const std::string& first, const std::string& second) {
+        int w1, h1, w2, h2;
+        auto a = read_ppm(first, w1, h1), b = read_ppm(second, w2, h2);
+        if (a.empty() || b.empty()) return;
+        if (w1 != w2 || h1 != h2) {
+            std::cout << "image_diff: sizes differ." << std::endl;
+            return;
+        }
+        double squared = 0.0, signed_sum = 0.0;
+        for (size_t i = 0; i != a.size(); ++i) {
+            double d = a[i] - b[i];
+            squared += d * d;
+            signed_sum += d;
+        }
+        auto rmse = std::sqrt(squared / static_cast<double>(a.size()));
+        std::cout << "image_diff: rmse " << rmse << "  mean difference " << signed_sum / static_cast<double>(a.size())
+                  << "  psnr " << (rmse > 0 ? 20 * std::log10(255.0 / rmse) : utilities::infinity) << " dB"
+                  << std::endl;
+    }
+
+    // The bvh_node constructor as it was before bvh_builder: copies the whole list at every node and sorts with
+    // virtual bounding_box() calls. Kept here only to measure against.
+    class legacy_bvh_node: public hittable {
+    public:
+        legacy_bvh_node(const std::vector<std::shared_ptr<hittable>>& list, size_t start, size_t end) {
+            std::vector<std::shared_ptr<hittable>> modifi_list = list;
+            int axis = utilities::random_int(0, 2);
+            auto comparator = [axis](const std::shared_ptr<hittable>& a, const std::shared_ptr<hittable>& b) {
+                return a->bounding_box().axis(axis).min < b->bounding_box().axis(axis).min;
+            };
+            size_t object_span = end - start;
+            if (object_span == 1) {
+                left = right = modifi_list[start];
+            } else if (object_span == 2) {
+                left = modifi_list[start];
+                right = modifi_list[start + 1];
+            } else {
+                std::sort(modifi_list.begin() + start, modifi_list.begin() + end, comparator);
+                auto mid = start + object_span / 2;
+                left = std::make_shared<legacy_bvh_node>(modifi_list, start, mid);
+                right = std::make_shared<legacy_bvh_node>(modifi_list, mid, end);
+            }
+            bbox = aabb(left->bounding_box(), right->bounding_box());
+        }
+        bool hit(const ray& r, const interval& inter, hit_record& rec) const override { return false; }
+        [[nodiscard]] aabb bounding_box() const override { return bbox; }
+    private:
+        std::shared_ptr<hittable> left, right;
+        aabb bbox;
+    };
+
+    void bvh_build(size_t max_count) {
+        auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+        std::cout << "bvh_build: " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+        for (size_t count = 1000; count <= max_count; count *= 10) {
+            for (auto size: {count, count * 2 <= max_count && count >= 1'000'000 ? count * 2 : 0}) {
+                if (size == 0) continue;
+                sampler::rng generator(size);
+                material::material_table materials;
+                std::vector<std::shared_ptr<hittable>> spheres;
+                spheres.reserve(size);
+                double extent = std::cbrt(static_cast<double>(size)) * 4.0;     // keep the density constant
+                for (size_t i = 0; i != size; ++i) {
+                    point3 center(generator.uniform(0, extent), generator.uniform(0, extent),
+                                  generator.uniform(0, extent));
+                    auto radius = generator.uniform(0.2, 1.0);
+                    spheres.push_back(std::make_shared<primitive::sphere>(materials, center, radius, white));
+                }
+                bvh_build_options serial;
+                serial.build_threads = 1;
+                bvh_build_options parallel;
+                auto serial_ms = time_ms([&] { bvh_builder builder(spheres, serial); });
+                auto parallel_ms = time_ms([&] { bvh_builder builder(spheres, parallel); });
+                auto node_ms = time_ms([&] { bvh_node tree(spheres, 0, spheres.size(), parallel); });
+                hittable_list list;
+                list.objects = spheres;
+                auto linear_ms = time_ms([&] { linear_bvh tree(list, parallel); });
+                std::cout << "bvh_build: n=" << size << "  builder serial " << serial_ms << " ms  parallel "
+                          << parallel_ms << " ms  bvh_node " << node_ms << " ms  linear_bvh " << linear_ms << " ms";
+                if (size <= 10'000)
+                    std::cout << "  legacy bvh_node " << time_ms([&] { legacy_bvh_node tree(spheres, 0, size); })
+                              << " ms";
+                std::cout << std::endl;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string which = argc > 1 ? argv[1] : "all";
+    if (which == "all" || which == "rng") bench::rng();
+    if (which == "all" || which == "slab") bench::slab();
+    if (which == "all" || which == "bvh") bench::bvh();
+    if (which == "all" || which == "sphere_set") bench::sphere_set();
+    if (which == "all" || which == "bvh4") bench::bvh4();
+    if (which == "all" || which == "traversal") bench::traversal();
+    if (which == "all" || which == "contention") bench::contention();
+    if (which == "all" || which == "surface") bench::surface();
+    if (which == "all" || which == "integrator") bench::integrator();
+    if (which == "all" || which == "progressive") bench::progressive();
+    if (which == "all" || which == "adaptive") bench::adaptive();
+    if (which == "all" || which == "denoise") bench::denoise();
+    if (which == "all" || which == "aov") bench::aov();
+    if (which == "all" || which == "image_write") bench::image_write();
+    if (which == "all" || which == "packets") bench::packets();
+    if (which == "all" || which == "mesh")                                  // optional second argument: max triangles
+        bench::mesh(argc > 2 && which == "mesh" ? std::stoul(argv[2]) : 1'000'000);
+    if (which == "all" || which == "bvh_build")                             // optional second argument: max n
+        bench::bvh_build(argc > 2 ? std::stoul(argv[2]) : 2'000'000);
+    if (which == "render")                                                  // render <out.ppm> [spp]
+        bench::render(argc > 2 ? argv[2] : "render.ppm", argc > 3 ? std::stoul(argv[3]) : 64);
+    if (which == "image_diff" && argc > 3) bench::image_diff(argv[2], argv[3]);
+    return 0;
+}
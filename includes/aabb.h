@@ -7,62 +7,82 @@
 
 #include "vec3.h"
 #include "interval.h"
+#include "render_stats.h"
+#include "algorithm"
+#include "limits"
+#include "type_traits"
 
-class aabb {
+template<typename T>
+class basic_aabb {
 public:
-    interval x, y, z;
-    aabb() = default;                                                          // default: intervals are all universe
-    aabb(const interval& ix, const interval& iy, const interval& iz): x(ix), y(iy), z(iz) {}
-    aabb(const point3& p1, const point3& p2) {
-        x = interval(fmin(p1[0], p2[0]), fmax(p1[0], p2[0]));
-        y = interval(fmin(p1[1], p2[1]), fmax(p1[1], p2[1]));
-        z = interval(fmin(p1[2], p2[2]), fmax(p1[2], p2[2]));
+    using interval_type = basic_interval<T>;
+    using vec_type = basic_vec3<T>;
+    interval_type x, y, z;
+    basic_aabb() = default;                                                    // default: intervals are all universe
+    basic_aabb(const interval_type& ix, const interval_type& iy, const interval_type& iz): x(ix), y(iy), z(iz) {}
+    basic_aabb(const vec_type& p1, const vec_type& p2) {
+        x = interval_type(std::fmin(p1[0], p2[0]), std::fmax(p1[0], p2[0]));
+        y = interval_type(std::fmin(p1[1], p2[1]), std::fmax(p1[1], p2[1]));
+        z = interval_type(std::fmin(p1[2], p2[2]), std::fmax(p1[2], p2[2]));
     }
-    aabb(const aabb& b1, const aabb& b2) {
-        x = interval{b1.x, b2.x};                                       // interval constructor will automatically
-        y = interval{b1.y, b2.y};                                       // merge the two intervals
-        z = interval{b1.z, b2.z};
+    basic_aabb(const basic_aabb& b1, const basic_aabb& b2) {
+        x = interval_type{b1.x, b2.x};                                  // interval constructor will automatically
+        y = interval_type{b1.y, b2.y};                                  // merge the two intervals
+        z = interval_type{b1.z, b2.z};
     }
 
 
-    [[nodiscard]] const interval& axis(int dim) const {
+    [[nodiscard]] const interval_type& axis(int dim) const {
         if (dim == 0) return x;
         if (dim == 1) return y;
         if (dim == 2) return z;
         return z;
     }
 
-    void this_pad(double delta = 0.0001) {
-        this->x = (x.size() >= delta) ? x.expand(delta): x;
-        this->y = (y.size() >= delta) ? y.expand(delta): y;
-        this->z = (z.size() >= delta) ? z.expand(delta): z;
+    [[nodiscard]] vec_type centroid() const {
+        return {0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max)};
+    }
+
+    [[nodiscard]] double surface_area() const {                                // 0 for an empty box, double
+                                                                               // so SAH sums don't lose precision
+        double dx = x.size(), dy = y.size(), dz = z.size();
+        if (dx < 0 || dy < 0 || dz < 0) return 0.0;
+        return 2.0 * (dx * dy + dy * dz + dz * dx);
+    }
+
+    [[nodiscard]] int longest_axis() const {
+        if (x.size() > y.size()) return x.size() > z.size() ? 0 : 2;
+        return y.size() > z.size() ? 1 : 2;
+    }
+
+    void this_pad(T delta = T(0.0001)) {                                      // only flat axes get padded
+        *this = pad(delta);
     };
 
-    [[nodiscard]] aabb pad(double delta = 0.0001) const {
-        interval new_x = (x.size() >= delta) ? x.expand(delta): x;
-        interval new_y = (y.size() >= delta) ? y.expand(delta): y;
-        interval new_z = (z.size() >= delta) ? z.expand(delta): z;
-        return {new_x, new_y, new_z};
+    [[nodiscard]] basic_aabb pad(T delta = T(0.0001)) const {
+        return {pad_axis(x, delta), pad_axis(y, delta), pad_axis(z, delta)};
     }
 
-    // This version works better with compiler, although it's mathematically the same with hit_my_version
-    [[nodiscard]] bool hit(const ray& r, interval ray_t) const {
-        for (int a = 0; a < 3; a++) {
-            auto invD = 1 / r.direction()[a];                             // store the 1/direction
-            auto orig = r.origin()[a];                                    // also store this
-            auto t0 = (axis(a).min - orig) * invD;                   // don't need to calculate those again
-            auto t1 = (axis(a).max - orig) * invD;
-            if (invD < 0)                                                         // the case of negative ray
-                std::swap(t0, t1);                                          // code like this avoids min/max()
-            if (t0 > ray_t.min) ray_t.min = t0;                                   // use 'if' instead of fmax, fmin
-            if (t1 < ray_t.max) ray_t.max = t1;                                   // is more compiler friendly I guess
-            if (ray_t.max <= ray_t.min)                                           // corner is considered no
-                return false;
-        }
-        return true;
+    // Branchless slab test: the ray's sign bits pick the near/far plane of every axis, so there is no swap and no
+    // early exit, only selects and min/max which compile to cmov/minsd/maxsd.
+    [[nodiscard]] bool hit(const basic_ray<T>& r, interval_type ray_t) const {
+        RAY_TRACING_COUNT(aabb_hits);
+        const auto& orig = r.origin();
+        const auto& inv = r.inv_direction();
+        auto tx0 = ((r.sign(0) ? x.max : x.min) - orig[0]) * inv[0];
+        auto tx1 = ((r.sign(0) ? x.min : x.max) - orig[0]) * inv[0];
+        auto ty0 = ((r.sign(1) ? y.max : y.min) - orig[1]) * inv[1];
+        auto ty1 = ((r.sign(1) ? y.min : y.max) - orig[1]) * inv[1];
+        auto tz0 = ((r.sign(2) ? z.max : z.min) - orig[2]) * inv[2];
+        auto tz1 = ((r.sign(2) ? z.min : z.max) - orig[2]) * inv[2];
+        // the accumulator first: a ray on a slab plane with a zero direction component gives 0 * inf = NaN there,
+        // which std::max and std::min then drop instead of passing on
+        auto t_min = std::max(std::max(std::max(ray_t.min, tx0), ty0), tz0);
+        auto t_max = std::min(std::min(std::min(ray_t.max, tx1), ty1), tz1);
+        return t_min < t_max;                                                    // corner is considered no
     }
 
-    [[deprecated]][[nodiscard]] bool hit_my_version(const ray& r, interval ray_t) const {
+    [[deprecated]][[nodiscard]] bool hit_my_version(const basic_ray<T>& r, interval_type ray_t) const {
         for (int axis_i = 0; axis_i != 3; ++axis_i) {
             auto t0 = fmin( (axis(axis_i).min - r.origin().x())/r.direction().x() ,// t0 = min( (x0 - Ax)/bx),
                             (axis(axis_i).max - r.origin().x())/r.direction().x());        //           (x1 - Ax)/bx)
@@ -74,13 +94,28 @@ public:
         }
         return true;
     }
+
+private:
+    static interval_type pad_axis(const interval_type& i, T delta) {
+        if (i.size() >= delta) return i;
+        auto padded = i.expand(delta);
+        if constexpr (std::is_same_v<T, float>) {                            // far from the origin delta / 2 can be
+            padded.min = std::nextafter(padded.min, -std::numeric_limits<T>::infinity());  // below half an ulp
+            padded.max = std::nextafter(padded.max, std::numeric_limits<T>::infinity());
+        }
+        return padded;
+    }
 };
 
-aabb operator+(const aabb& bbox, const vec3& offset) {
+using aabb = basic_aabb<real>;
+
+template<typename T>
+basic_aabb<T> operator+(const basic_aabb<T>& bbox, const basic_vec3<T>& offset) {
     return {bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z()};
 }
 
-aabb operator+(const vec3& offset, const aabb& bbox) {
+template<typename T>
+basic_aabb<T> operator+(const basic_vec3<T>& offset, const basic_aabb<T>& bbox) {
     return bbox + offset;
 }
 
@@ -0,0 +1,134 @@
+#ifndef RAY_TRACING_AFFINE_TRANSFORM_H
+#define RAY_TRACING_AFFINE_TRANSFORM_H
+
+#include "vec3.h"
+#include "aabb.h"
+#include "utilities.h"
+#include "cmath"
+#include "limits"
+#include "type_traits"
+
+// An affine map as the top three rows of a 4x4 matrix, p' = m * (p, 1), in double whatever real is, so chains of
+// them compose without drifting. transform_instance keeps one and its inverse.
+class affine_transform {
+public:
+    double m[3][4];
+
+    affine_transform(): m{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}} {}    // identity
+
+    static affine_transform translation(const vec3d& offset) {
+        affine_transform t;
+        for (int i = 0; i != 3; ++i) t.m[i][3] = offset[i];
+        return t;
+    }
+
+    static affine_transform scaling(const vec3d& factors) {
+        affine_transform t;
+        for (int i = 0; i != 3; ++i) t.m[i][i] = factors[i];
+        return t;
+    }
+
+    // right-handed, counterclockwise seen from the tip of the axis; about y that is rotate_y's sense
+    static affine_transform rotation(const vec3d& axis, double degree) {
+        auto radians = utilities::degree_to_radian(degree);
+        auto c = std::cos(radians), s = std::sin(radians), k = 1 - c;
+        auto a = normalize(axis);
+        const auto x = a[0], y = a[1], z = a[2];
+        affine_transform t;
+        t.m[0][0] = c + x * x * k;     t.m[0][1] = x * y * k - z * s; t.m[0][2] = x * z * k + y * s;
+        t.m[1][0] = y * x * k + z * s; t.m[1][1] = c + y * y * k;     t.m[1][2] = y * z * k - x * s;
+        t.m[2][0] = z * x * k - y * s; t.m[2][1] = z * y * k + x * s; t.m[2][2] = c + z * z * k;
+        return t;
+    }
+
+    // this after first
+    affine_transform operator * (const affine_transform& first) const {
+        affine_transform t;
+        for (int i = 0; i != 3; ++i) {
+            for (int j = 0; j != 4; ++j)
+                t.m[i][j] = m[i][0] * first.m[0][j] + m[i][1] * first.m[1][j] + m[i][2] * first.m[2][j];
+            t.m[i][3] += m[i][3];
+        }
+        return t;
+    }
+
+    [[nodiscard]] double determinant() const {
+        return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+               + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    }
+
+    // by cofactors; a singular map (a scale of 0) has no inverse and gives infinities
+    [[nodiscard]] affine_transform inverse() const {
+        affine_transform t;
+        auto inv_det = 1.0 / determinant();
+        for (int i = 0; i != 3; ++i) {
+            for (int j = 0; j != 3; ++j) {                                  // transposed cofactor of m[j][i]
+                int r0 = (j + 1) % 3, r1 = (j + 2) % 3, c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+                t.m[i][j] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) * inv_det;
+            }
+        }
+        for (int i = 0; i != 3; ++i)                                        // and undo the translation
+            t.m[i][3] = -(t.m[i][0] * m[0][3] + t.m[i][1] * m[1][3] + t.m[i][2] * m[2][3]);
+        return t;
+    }
+
+    [[nodiscard]] point3d point(const point3d& p) const {
+        return {m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+                m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+                m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]};
+    }
+
+    [[nodiscard]] vec3d vector(const vec3d& v) const {
+        return {m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+                m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+                m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]};
+    }
+
+    // by the transpose of the linear part: called on the inverse, this carries normals over (unnormalized)
+    [[nodiscard]] vec3d transposed_vector(const vec3d& v) const {
+        return {m[0][0] * v[0] + m[1][0] * v[1] + m[2][0] * v[2],
+                m[0][1] * v[0] + m[1][1] * v[1] + m[2][1] * v[2],
+                m[0][2] * v[0] + m[1][2] * v[1] + m[2][2] * v[2]};
+    }
+
+    // The box around the transformed box, from its center and half extents (no need for all eight corners). Exact
+    // for the box, so bounds of what is inside are only tight if it is a box; see transformed_bounding_box.
+    [[nodiscard]] aabb box(const aabb& bounds) const {
+        if (bounds.x.min > bounds.x.max || bounds.y.min > bounds.y.max || bounds.z.min > bounds.z.max)
+            return {};                                                      // empty stays empty
+        point3d center(0.5 * (bounds.x.min + bounds.x.max), 0.5 * (bounds.y.min + bounds.y.max),
+                       0.5 * (bounds.z.min + bounds.z.max));
+        vec3d half(0.5 * bounds.x.size(), 0.5 * bounds.y.size(), 0.5 * bounds.z.size());
+        auto c = point(center);
+        vec3d extent;
+        for (int i = 0; i != 3; ++i)
+            extent[i] = std::fabs(m[i][0]) * half[0] + std::fabs(m[i][1]) * half[1] + std::fabs(m[i][2]) * half[2];
+        return outward(c - extent, c + extent);
+    }
+
+    // the box around a sphere after the transform, the exact box of the ellipsoid it becomes
+    [[nodiscard]] aabb sphere_box(const point3d& center, double radius) const {
+        auto c = point(center);
+        vec3d extent;
+        for (int i = 0; i != 3; ++i)
+            extent[i] = radius * std::sqrt(m[i][0] * m[i][0] + m[i][1] * m[i][1] + m[i][2] * m[i][2]);
+        return outward(c - extent, c + extent);
+    }
+
+    // double bounds as an aabb that doesn't shrink when real is float
+    static aabb outward(const point3d& lo, const point3d& hi) {
+        if constexpr (std::is_same_v<real, float>) {
+            constexpr auto infinity = std::numeric_limits<float>::infinity();
+            return {interval(std::nextafter(static_cast<float>(lo[0]), -infinity),
+                             std::nextafter(static_cast<float>(hi[0]), infinity)),
+                    interval(std::nextafter(static_cast<float>(lo[1]), -infinity),
+                             std::nextafter(static_cast<float>(hi[1]), infinity)),
+                    interval(std::nextafter(static_cast<float>(lo[2]), -infinity),
+                             std::nextafter(static_cast<float>(hi[2]), infinity))};
+        } else {
+            return {interval(lo[0], hi[0]), interval(lo[1], hi[1]), interval(lo[2], hi[2])};
+        }
+    }
+};
+
+#endif //RAY_TRACING_AFFINE_TRANSFORM_H
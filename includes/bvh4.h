@@ -0,0 +1,260 @@
+#ifndef RAY_TRACING_BVH4_H
+#define RAY_TRACING_BVH4_H
+
+#include "hittable_list.h"
+#include "hittable.h"
+#include "aabb.h"
+#include "bvh_builder.h"
+#include "cstdint"
+#include "cmath"
+#include "vector"
+#include "algorithm"
+
+// SSE2 is part of x86-64, so the SIMD node test is on by default there. Define RAY_TRACING_NO_SIMD to measure the
+// scalar fallback, which is also what other targets get. Building with -mavx / -march=native only changes the
+// encoding (VEX), the node test stays 4 wide and never fuses its multiply-subtract (see intersect).
+#if !defined(RAY_TRACING_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define RAY_TRACING_BVH4_SSE
+#include "immintrin.h"
+#endif
+
+// Four child boxes in SoA layout: bounds[side][axis] holds one plane of all four children, so one 4-wide load
+// feeds one slab of the test. 128 bytes, two cache lines.
+struct alignas(16) bvh4_node {
+    float bounds[2][3][4];                                                   // [min/max][axis][child]
+    uint32_t child[4];                                                       // interior child: node index
+                                                                             // leaf child: first primitive
+    uint32_t count[4];                                                       // primitives of a leaf child,
+};                                                                           // 0 = interior or unused slot
+static_assert(sizeof(bvh4_node) == 128, "bvh4_node should stay 128 bytes");
+
+// A 4-wide BVH, collapsed from bvh_builder's binary tree: every node absorbs its grandchildren (largest first)
+// until it has four children, so traversal does one SIMD box test where the binary tree did up to three scalar
+// ones. Hit children are visited nearest first, and a stacked child is skipped if a closer hit was found since.
+class bvh4: public hittable {
+public:
+    explicit bvh4(const hittable_list& world, const bvh_build_options& options = {}) {
+        std::vector<std::shared_ptr<hittable>> flat;
+        world.flatten(flat);
+        build(flat, options);
+    }
+
+    bool hit(const ray& r, const interval &inter, hit_record &rec) const override {
+        if (nodes.empty()) return false;
+
+        const ray_lanes lanes(r);
+        interval ray_t(inter);
+        bool hit_any = false;
+        struct entry {
+            uint32_t index, count;                                           // same meaning as in bvh4_node
+            float t;                                                         // where the ray enters its box
+        };
+        entry stack[max_stack];
+        int stack_size = 0;
+        stack[stack_size++] = {0, 0, -INFINITY};
+        while (stack_size > 0) {
+            const auto current = stack[--stack_size];
+            if (current.t > ray_t.max) continue;                             // behind the closest hit so far
+            RAY_TRACING_COUNT(bvh_node_visits);
+            if (current.count > 0) {                                         // leaf: test its primitives
+                for (uint32_t i = current.index; i != current.index + current.count; ++i) {
+                    if (primitives[i]->hit(r, ray_t, rec)) {
+                        hit_any = true;
+                        ray_t.max = rec.t;
+                    }
+                }
+                continue;
+            }
+            const auto& node = nodes[current.index];
+            alignas(16) float t_near[4];
+            auto mask = intersect(node, lanes, ray_t, t_near);
+            entry hits[4];
+            int hit_count = 0;
+            for (int i = 0; i != 4; ++i) {                                   // insertion sort, farthest first,
+                if (!(mask & (1u << i))) continue;                           // so the nearest is popped next
+                entry child{node.child[i], node.count[i], t_near[i]};
+                int k = hit_count++;
+                for (; k > 0 && hits[k - 1].t < child.t; --k) hits[k] = hits[k - 1];
+                hits[k] = child;
+            }
+            for (int i = 0; i != hit_count; ++i) stack[stack_size++] = hits[i];
+        }
+        return hit_any;
+    }
+
+    [[nodiscard]] aabb bounding_box() const override {
+        return bbox;
+    }
+
+    [[nodiscard]] aabb transformed_bounding_box(const affine_transform& to_world) const override {
+        aabb bounds;
+        for (const auto& primitive: primitives) bounds = aabb(bounds, primitive->transformed_bounding_box(to_world));
+        return bounds;
+    }
+
+    void gather_lights(std::vector<const hittable*>& lights) const override {
+        for (const auto& primitive: primitives) primitive->gather_lights(lights);
+    }
+
+    void gather_primitives(std::vector<const hittable*>& objects) const override {
+        for (const auto& primitive: primitives) primitive->gather_primitives(objects);
+    }
+
+    [[nodiscard]] size_t node_count() const { return nodes.size(); }
+    [[nodiscard]] size_t primitive_count() const { return primitives.size(); }
+
+    [[nodiscard]] static const char* node_test() {                           // which kernel this build uses
+#ifdef RAY_TRACING_BVH4_SSE
+        return "SSE";
+#else
+        return "scalar";
+#endif
+    }
+
+private:
+    // Every level pops one entry and pushes at most four, and a level descends at least one level of the binary
+    // tree, which bvh_builder keeps under max_depth levels deep.
+    static constexpr int max_stack = 3 * bvh_builder::max_depth + 1;
+    // Node tests run in float: widen the exit and narrow the entry distance by 2 * gamma(3) so rounding never
+    // drops a box the ray really enters (Ize, "Robust BVH Ray Traversal").
+    static constexpr float exit_scale = 1.0f + 2.0f * 3.0f * 0x1.0p-24f / (1.0f - 3.0f * 0x1.0p-24f);
+    static constexpr float entry_scale = 1.0f - 2.0f * 3.0f * 0x1.0p-24f / (1.0f - 3.0f * 0x1.0p-24f);
+
+    std::vector<bvh4_node> nodes;                                            // nodes[0] is the root
+    std::vector<std::shared_ptr<hittable>> primitives;                       // in leaf order
+    aabb bbox;
+
+    // the ray converted to float once, broadcast to all four lanes
+    struct ray_lanes {
+#ifdef RAY_TRACING_BVH4_SSE
+        __m128 orig[3], inv[3];
+#else
+        float orig[3], inv[3];
+#endif
+        int sign[3];
+
+        explicit ray_lanes(const ray& r) {
+            for (int a = 0; a != 3; ++a) {
+                auto o = static_cast<float>(r.origin()[a]);
+                auto i = static_cast<float>(r.inv_direction()[a]);
+#ifdef RAY_TRACING_BVH4_SSE
+                orig[a] = _mm_set1_ps(o);
+                inv[a] = _mm_set1_ps(i);
+#else
+                orig[a] = o;
+                inv[a] = i;
+#endif
+                sign[a] = r.sign(a);
+            }
+        }
+    };
+
+    // Slab test of the ray against all four child boxes. Returns a bit per child hit, and the entry distances.
+    static inline unsigned intersect(const bvh4_node& node, const ray_lanes& r, const interval& ray_t,
+                                     float* t_near) {
+#ifdef RAY_TRACING_BVH4_SSE
+        __m128 t_min = _mm_set1_ps(static_cast<float>(ray_t.min));
+        __m128 t_max = _mm_set1_ps(static_cast<float>(ray_t.max));
+        for (int a = 0; a != 3; ++a) {
+            __m128 near_plane = _mm_load_ps(node.bounds[r.sign[a]][a]);
+            __m128 far_plane = _mm_load_ps(node.bounds[1 - r.sign[a]][a]);
+            // (plane - orig) * inv even where FMA is available: plane * inv - orig * inv cancels, and its error
+            // is relative to the two products, which the widening below doesn't cover
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(near_plane, r.orig[a]), r.inv[a]);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(far_plane, r.orig[a]), r.inv[a]);
+            t_min = _mm_max_ps(t0, t_min);                                   // slab first: a NaN slab (0 * inf)
+            t_max = _mm_min_ps(t1, t_max);                                   // is ignored, not a miss
+        }
+        t_max = _mm_mul_ps(t_max, _mm_set1_ps(exit_scale));
+        _mm_store_ps(t_near, _mm_mul_ps(t_min, _mm_set1_ps(entry_scale)));
+        return static_cast<unsigned>(_mm_movemask_ps(_mm_cmple_ps(t_min, t_max)));
+#else
+        unsigned mask = 0;
+        for (int i = 0; i != 4; ++i) {
+            auto t_min = static_cast<float>(ray_t.min), t_max = static_cast<float>(ray_t.max);
+            for (int a = 0; a != 3; ++a) {
+                auto t0 = (node.bounds[r.sign[a]][a][i] - r.orig[a]) * r.inv[a];
+                auto t1 = (node.bounds[1 - r.sign[a]][a][i] - r.orig[a]) * r.inv[a];
+                t_min = t0 > t_min ? t0 : t_min;
+                t_max = t1 < t_max ? t1 : t_max;
+            }
+            t_near[i] = t_min * entry_scale;
+            mask |= static_cast<unsigned>(t_min <= t_max * exit_scale) << i;
+        }
+        return mask;
+#endif
+    }
+
+    void build(const std::vector<std::shared_ptr<hittable>>& objects, const bvh_build_options& options) {
+        if (objects.empty()) return;
+        bvh_builder builder(objects, options);
+        bbox = builder.nodes[0].box;
+        nodes.reserve(builder.nodes.size() / 2 + 1);
+        primitives.reserve(objects.size());
+        collapse(builder, 0, objects);
+    }
+
+    // Turns the binary subtree at `index` into one bvh4 node (plus its descendants): start from its two children
+    // and keep opening the interior child with the largest surface area, the one most rays reach, until there are
+    // four. Returns the node's index.
+    uint32_t collapse(const bvh_builder& builder, uint32_t index, const std::vector<std::shared_ptr<hittable>>& objects) {
+        const auto& source = builder.nodes[index];
+        uint32_t slots[4];
+        unsigned slot_count = 0;
+        if (source.count > 0) {                                              // only for a root that is a leaf
+            slots[slot_count++] = index;
+        } else {
+            slots[slot_count++] = source.left;
+            slots[slot_count++] = source.right;
+        }
+        while (slot_count < 4) {
+            int widest = -1;
+            double widest_area = -1.0;
+            for (unsigned i = 0; i != slot_count; ++i) {
+                const auto& candidate = builder.nodes[slots[i]];
+                if (candidate.count == 0 && candidate.box.surface_area() > widest_area) {
+                    widest = static_cast<int>(i);
+                    widest_area = candidate.box.surface_area();
+                }
+            }
+            if (widest < 0) break;                                           // all leaves
+            const auto& opened = builder.nodes[slots[widest]];
+            slots[widest] = opened.left;
+            slots[slot_count++] = opened.right;
+        }
+
+        auto flat_index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        for (int i = 0; i != 4; ++i) {                                       // unused slots: an empty box,
+            for (int a = 0; a != 3; ++a) {                                   // which no ray enters
+                nodes[flat_index].bounds[0][a][i] = INFINITY;
+                nodes[flat_index].bounds[1][a][i] = -INFINITY;
+            }
+            nodes[flat_index].child[i] = 0;
+            nodes[flat_index].count[i] = 0;
+        }
+        for (unsigned i = 0; i != slot_count; ++i) {
+            const auto& child = builder.nodes[slots[i]];
+            set_bounds(nodes[flat_index], i, child.box);
+            if (child.count > 0) {
+                nodes[flat_index].child[i] = static_cast<uint32_t>(primitives.size());
+                nodes[flat_index].count[i] = child.count;
+                for (uint32_t k = child.start; k != child.start + child.count; ++k)
+                    primitives.push_back(objects[builder.indices[k]]);
+            } else {
+                auto grandchild = collapse(builder, slots[i], objects);      // may reallocate nodes
+                nodes[flat_index].child[i] = grandchild;
+            }
+        }
+        return flat_index;
+    }
+
+    static void set_bounds(bvh4_node& node, unsigned slot, const aabb& box) {
+        for (int a = 0; a != 3; ++a) {                                       // round outwards to float
+            node.bounds[0][a][slot] = std::nextafter(static_cast<float>(box.axis(a).min), -INFINITY);
+            node.bounds[1][a][slot] = std::nextafter(static_cast<float>(box.axis(a).max), INFINITY);
+        }
+    }
+};
+
+#endif //RAY_TRACING_BVH4_H
@@ -0,0 +1,275 @@
+#ifndef RAY_TRACING_BVH_BUILDER_H
+#define RAY_TRACING_BVH_BUILDER_H
+
+#include "hittable.h"
+#include "aabb.h"
+#include "thread_pool.h"
+#include "atomic"
+#include "cstdint"
+#include "memory"
+#include "vector"
+#include "algorithm"
+
+struct bvh_build_options {
+    enum class split_method {
+        sah,                                                                 // binned surface area heuristic
+        random_median                                                        // the old builder: random axis, median
+    };
+    split_method method = split_method::sah;
+    unsigned int bins = 16;                                                  // SAH buckets per axis
+    size_t max_leaf_size = 4;                                                // a span this small may become a leaf
+    double traversal_cost = 1.0;                                             // cost of one box test, relative to
+    double intersection_cost = 1.0;                                          // one primitive test
+    unsigned int build_threads = 0;                                          // 0 = all hardware threads, 1 = serial
+    size_t parallel_threshold = 4096;                                        // smaller spans are built inline
+};
+
+// Builds the topology of a BVH over a list of hittables, without touching the hittables again after one
+// bounding_box() call each: boxes and centroids go into one flat array that is partitioned in place (no per-node
+// copies), and large subtrees are handed to a work-stealing pool. bvh_node and linear_bvh turn the result into
+// their own layouts.
+class bvh_builder {
+public:
+    struct node {
+        aabb box;
+        uint32_t left = 0, right = 0;                                        // children of an interior node
+        uint32_t start = 0, count = 0;                                       // leaf range in indices, count > 0
+        int axis = 0;                                                        // split axis of an interior node
+    };
+
+    std::vector<node> nodes;                                                 // nodes[0] is the root
+    std::vector<uint32_t> indices;                                           // primitive order, leaves are ranges
+
+    bvh_builder(const std::vector<std::shared_ptr<hittable>>& objects, const bvh_build_options& options):
+                bvh_builder(objects.size(), [&objects](size_t i) { return objects[i]->bounding_box(); }, options) {}
+
+    // For primitives that aren't hittables (sphere_set): box_of(i) gives the bounds of primitive i.
+    template<typename BoxOf>
+    bvh_builder(size_t n, BoxOf&& box_of, const bvh_build_options& options): options(options) {
+        if (n == 0) return;
+        refs.resize(n);
+        indices.resize(n);
+        nodes.resize(2 * n - 1);                                             // upper bound of a binary tree, so the
+                                                                             // array never moves while tasks run
+        std::unique_ptr<thread_pool> pool;
+        if (options.build_threads != 1 && n >= options.parallel_threshold)
+            pool = std::make_unique<thread_pool>(options.build_threads);
+
+        auto precompute = [&](size_t first, size_t last) {
+            for (size_t i = first; i != last; ++i) {
+                aabb box = box_of(i);
+                refs[i] = {box, box.centroid(), static_cast<uint32_t>(i)};
+            }
+        };
+        if (pool) {
+            size_t chunks = 4 * pool->size(), chunk = (n + chunks - 1) / chunks;
+            pool->parallel_for(chunks, [&](size_t c) { precompute(std::min(n, c * chunk), std::min(n, (c + 1) * chunk)); });
+        } else {
+            precompute(0, n);
+        }
+
+        node_count = 1;
+        build_range(pool.get(), 0, 0, static_cast<uint32_t>(n), 0);
+        if (pool) pool->wait();
+        nodes.resize(node_count.load());
+        for (size_t i = 0; i != n; ++i) indices[i] = refs[i].index;
+        std::vector<primitive_ref>().swap(refs);
+    }
+
+    // Deeper than this, splits fall back to the median, which halves the span (at most 2^32 primitives) every
+    // level: no tree is deeper than max_depth, so traversal stacks of max_depth entries never overflow.
+    static constexpr int max_sah_depth = 40;
+    static constexpr int max_depth = max_sah_depth + 32;
+
+private:
+    // Spans this small are split by an exact sorted sweep, cheaper than clearing and scanning the bins.
+    static constexpr uint32_t small_span = 16;
+
+    // Everything the split decisions read, stored together and partitioned in place so every pass over a span
+    // is a sequential scan instead of a gather through an index array.
+    struct primitive_ref {
+        aabb box;
+        point3 centroid;
+        uint32_t index;
+    };
+
+    bvh_build_options options;
+    std::vector<primitive_ref> refs;
+    std::atomic<uint32_t> node_count{0};
+
+    void build_range(thread_pool* pool, uint32_t index, uint32_t start, uint32_t end, int depth) {
+        aabb bounds;
+        point3 c_min(utilities::infinity), c_max(-utilities::infinity);
+        for (uint32_t i = start; i != end; ++i) {
+            bounds = aabb(bounds, refs[i].box);
+            const auto& c = refs[i].centroid;
+            for (int a = 0; a != 3; ++a) {
+                c_min[a] = c[a] < c_min[a] ? c[a] : c_min[a];
+                c_max[a] = c[a] > c_max[a] ? c[a] : c_max[a];
+            }
+        }
+        aabb centroid_bounds(interval(c_min[0], c_max[0]), interval(c_min[1], c_max[1]),
+                             interval(c_min[2], c_max[2]));
+        nodes[index].box = bounds;
+
+        int axis = centroid_bounds.longest_axis();
+        uint32_t mid;
+        if (end - start == 1) {
+            mid = start;
+        } else if (options.method == bvh_build_options::split_method::random_median) {
+            axis = utilities::random_int(0, 2);
+            mid = median(start, end, axis);
+        } else if (depth >= max_sah_depth) {
+            mid = (end - start <= options.max_leaf_size) ? start : median(start, end, axis);
+        } else if (end - start <= small_span) {
+            mid = split_sah_sweep(start, end, bounds, axis);
+        } else {
+            mid = split_sah(start, end, bounds, centroid_bounds, axis);
+        }
+
+        if (mid == start || mid == end) {                                    // leaf
+            nodes[index].start = start;
+            nodes[index].count = end - start;
+            return;
+        }
+        auto left = node_count.fetch_add(2);
+        nodes[index].left = left;
+        nodes[index].right = left + 1;
+        nodes[index].axis = axis;
+        if (pool && end - start >= options.parallel_threshold) {             // big subtree: let someone steal it
+            pool->submit([this, pool, left, start, mid, depth] { build_range(pool, left, start, mid, depth + 1); });
+        } else {
+            build_range(pool, left, start, mid, depth + 1);
+        }
+        build_range(pool, left + 1, mid, end, depth + 1);
+    }
+
+    uint32_t median(uint32_t start, uint32_t end, int axis) {
+        auto mid = start + (end - start) / 2;
+        std::nth_element(refs.begin() + start, refs.begin() + mid, refs.begin() + end,
+                         [axis](const primitive_ref& a, const primitive_ref& b) {
+                             return a.centroid[axis] < b.centroid[axis];
+                         });
+        return mid;
+    }
+
+    // Bin centroids on all three axes in one pass and pick the cheapest plane between two bins.
+    // Returns start if a leaf is cheaper than any split.
+    uint32_t split_sah(uint32_t start, uint32_t end, const aabb& bounds, const aabb& centroid_bounds, int& axis) {
+        constexpr unsigned max_bins = 64;
+        const unsigned bin_count = std::clamp(options.bins, 2u, max_bins);
+        const size_t count = end - start;
+
+        aabb bin_box[3][max_bins];                                           // default constructed empty
+        uint32_t bin_size[3][max_bins];
+        for (int a = 0; a != 3; ++a)
+            std::fill(bin_size[a], bin_size[a] + bin_count, 0u);
+        double lo[3], scale[3];
+        for (int a = 0; a != 3; ++a) {
+            lo[a] = centroid_bounds.axis(a).min;
+            auto extent = centroid_bounds.axis(a).size();
+            scale[a] = extent > 0 ? bin_count / extent : 0.0;
+        }
+        for (uint32_t i = start; i != end; ++i) {
+            const auto& primitive = refs[i];
+            for (int a = 0; a != 3; ++a) {
+                auto b = bin_index(primitive.centroid[a], lo[a], scale[a], bin_count);
+                bin_box[a][b] = aabb(bin_box[a][b], primitive.box);
+                ++bin_size[a][b];
+            }
+        }
+
+        double best_cost = utilities::infinity;
+        int best_axis = -1;
+        unsigned best_split = 0;                                             // split after this bin
+        double right_area[max_bins];
+        uint32_t right_size[max_bins];
+        for (int a = 0; a != 3; ++a) {
+            if (scale[a] == 0.0) continue;                                   // all centroids on one plane
+            aabb accumulated;                                                // sweep right to left
+            uint32_t accumulated_size = 0;
+            for (unsigned b = bin_count - 1; b > 0; --b) {
+                accumulated = aabb(accumulated, bin_box[a][b]);
+                accumulated_size += bin_size[a][b];
+                right_area[b] = accumulated.surface_area();
+                right_size[b] = accumulated_size;
+            }
+            accumulated = aabb();                                            // then left to right
+            accumulated_size = 0;
+            for (unsigned b = 0; b + 1 < bin_count; ++b) {
+                accumulated = aabb(accumulated, bin_box[a][b]);
+                accumulated_size += bin_size[a][b];
+                if (accumulated_size == 0 || right_size[b + 1] == 0) continue;
+                auto cost = accumulated.surface_area() * accumulated_size + right_area[b + 1] * right_size[b + 1];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = b;
+                }
+            }
+        }
+
+        if (best_axis < 0)                                                   // coincident centroids, can't bin
+            return count <= options.max_leaf_size ? start : start + static_cast<uint32_t>(count / 2);
+        axis = best_axis;
+        auto area = bounds.surface_area();
+        auto split_cost = options.traversal_cost
+                + options.intersection_cost * (area > 0 ? best_cost / area : static_cast<double>(count));
+        if (count <= options.max_leaf_size && options.intersection_cost * static_cast<double>(count) <= split_cost)
+            return start;
+
+        auto a_lo = lo[best_axis], a_scale = scale[best_axis];
+        auto middle = std::partition(refs.begin() + start, refs.begin() + end, [&](const primitive_ref& primitive) {
+            return bin_index(primitive.centroid[best_axis], a_lo, a_scale, bin_count) <= best_split;
+        });
+        return static_cast<uint32_t>(middle - refs.begin());
+    }
+
+    // Exact SAH for a handful of primitives: sort by centroid on each axis and try every split position.
+    uint32_t split_sah_sweep(uint32_t start, uint32_t end, const aabb& bounds, int& axis) {
+        const uint32_t count = end - start;
+        double best_cost = utilities::infinity;
+        int best_axis = -1;
+        uint32_t best_split = 0;                                             // size of the left part
+        double right_area[small_span];
+        for (int a = 0; a != 3; ++a) {
+            sort_by_centroid(start, end, a);
+            aabb accumulated;
+            for (uint32_t k = count - 1; k > 0; --k) {
+                accumulated = aabb(accumulated, refs[start + k].box);
+                right_area[k] = accumulated.surface_area() * (count - k);
+            }
+            accumulated = aabb();
+            for (uint32_t k = 1; k != count; ++k) {
+                accumulated = aabb(accumulated, refs[start + k - 1].box);
+                auto cost = accumulated.surface_area() * k + right_area[k];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = k;
+                }
+            }
+        }
+        auto area = bounds.surface_area();
+        auto split_cost = options.traversal_cost
+                + options.intersection_cost * (area > 0 ? best_cost / area : static_cast<double>(count));
+        if (count <= options.max_leaf_size && options.intersection_cost * static_cast<double>(count) <= split_cost)
+            return start;
+        axis = best_axis;
+        if (best_axis != 2) sort_by_centroid(start, end, best_axis);        // the z sort is still in place
+        return start + best_split;
+    }
+
+    void sort_by_centroid(uint32_t start, uint32_t end, int axis) {
+        std::sort(refs.begin() + start, refs.begin() + end, [axis](const primitive_ref& a, const primitive_ref& b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+    }
+
+    static inline unsigned bin_index(double centroid, double lo, double scale, unsigned bin_count) {
+        auto index = static_cast<unsigned>((centroid - lo) * scale);
+        return index < bin_count ? index : bin_count - 1;
+    }
+};
+
+#endif //RAY_TRACING_BVH_BUILDER_H
@@ -8,81 +8,113 @@
 #include "hittable_list.h"
 #include "hittable.h"
 #include "aabb.h"
+#include "bvh_builder.h"
 #include "memory"
 #include "functional"
+#include "algorithm"
+#include "vector"
 
 class bvh_node: public hittable {
 public:
-    explicit bvh_node(const hittable_list& world): bvh_node(world.objects, 0, world.objects.size()) {}
-    bvh_node(const std::vector<std::shared_ptr<hittable>> &list, size_t start, size_t end) {
-        std::vector<std::shared_ptr<hittable>> modifi_list = list;                        // copy the list
-
-        int random_axis = utilities::random_int(0, 2);             // randomly choose an axis
-        std::function<bool(const std::shared_ptr<hittable>&, std::shared_ptr<hittable>&)> comparator;
-        if (random_axis == 0) {
-            comparator = box_compare_x;
-        } else if (random_axis == 1) {
-            comparator = box_compare_y;
-        } else {
-            comparator = box_compare_z;
-        }
-//        auto comparator = (random_axis == 0) ? box_compare_x
-//                                      : (random_axis == 1) ? box_compare_y
-//                                                    : box_compare_z;
-
-        size_t object_span = end - start;
-        if (object_span == 1) {
-            left = right = modifi_list[start];                                       // only 1 object in the span
-        } else if (object_span == 2) {                                               // situation of span = 2
-            if (comparator(modifi_list[start], modifi_list[start + 1])) {         // the reason of we specifically
-                left = modifi_list[start];                                           // pick the situation of 2 out, is
-                right = modifi_list[start + 1];                                      // we don't want to create more
-            } else {                                                                 // bvh_node, we only need to store
-                left = modifi_list[start + 1];                                       // left and write as hittable object
-                right = modifi_list[start];
-            }
-        } else {
-            std::sort(modifi_list.begin() + start, modifi_list.begin() + end, comparator);
-            auto mid = start + object_span / 2;                              // sort and split to two
-            left = std::make_shared<bvh_node>(modifi_list, start, mid);    // needs to be resorted
-            right = std::make_shared<bvh_node>(modifi_list, mid, end);    // because we randomly choose axis
-        }
-        bbox = aabb(left->bounding_box(), right->bounding_box());
+    explicit bvh_node(const hittable_list& world, const bvh_build_options& options = {}):
+                                            bvh_node(world.objects, 0, world.objects.size(), options) {}
+    bvh_node(const std::vector<std::shared_ptr<hittable>> &list, size_t start, size_t end,
+             const bvh_build_options& options = {}) {
+        std::vector<std::shared_ptr<hittable>> span(list.begin() + start, list.begin() + end);
+        bvh_builder builder(span, options);                                  // one copy of the span, no per-level
+        if (!builder.nodes.empty()) assign(builder, 0, span);                // copies or virtual sort comparators
     }
 
     bool hit(const ray& r, const interval &inter, hit_record &rec) const override {
+        RAY_TRACING_COUNT(bvh_node_visits);
         if (!bbox.hit(r, inter)) return false;
+        if (!primitives.empty()) {                                           // leaf: closest hit among primitives
+            interval temp_interval(inter);
+            bool hit_any = false;
+            for (const auto& object: primitives) {
+                if (object->hit(r, temp_interval, rec)) {
+                    hit_any = true;
+                    temp_interval.max = rec.t;
+                }
+            }
+            return hit_any;
+        }
         bool left_hit = left->hit(r, inter, rec);          // if left_hit, there's no need to calculate what's behind
         bool right_hit = right->hit(r, interval(inter.min, left_hit? rec.t : inter.max), rec);
 
         return left_hit || right_hit;
     }
 
-    [[nodiscard]] aabb bounding_box() const {
+    [[nodiscard]] aabb bounding_box() const override {
         return bbox;
     }
 
+    [[nodiscard]] aabb transformed_bounding_box(const affine_transform& to_world) const override {
+        aabb bounds;
+        for (const auto& object: primitives) bounds = aabb(bounds, object->transformed_bounding_box(to_world));
+        if (left) bounds = aabb(bounds, left->transformed_bounding_box(to_world));
+        if (right) bounds = aabb(bounds, right->transformed_bounding_box(to_world));
+        return bounds;
+    }
+
+    void gather_lights(std::vector<const hittable*>& lights) const override {
+        for (const auto& object: primitives) object->gather_lights(lights);
+        if (left) left->gather_lights(lights);
+        if (right) right->gather_lights(lights);
+    }
+
+    void gather_primitives(std::vector<const hittable*>& objects) const override {
+        for (const auto& object: primitives) object->gather_primitives(objects);
+        if (left) left->gather_primitives(objects);
+        if (right) right->gather_primitives(objects);
+    }
+
+    // Expected cost of a random ray against this tree, SAH-weighted by the child/parent surface area ratio.
+    // Builders can be compared with this number: smaller is better.
+    [[nodiscard]] double sah_cost(const bvh_build_options& options = {}) const {
+        if (!primitives.empty())
+            return options.intersection_cost * static_cast<double>(primitives.size());
+        auto area = bbox.surface_area();
+        if (area <= 0) return options.traversal_cost;
+        return options.traversal_cost + (child_cost(left, options) * left->bounding_box().surface_area()
+                                       + child_cost(right, options) * right->bounding_box().surface_area()) / area;
+    }
 
 private:
     std::shared_ptr<hittable> left;
     std::shared_ptr<hittable> right;
+    std::vector<std::shared_ptr<hittable>> primitives;                       // non-empty only for a leaf
     aabb bbox;
 
-    static bool box_compare_axis(                                            // compare if a.axis is smaller than b.axis
-        const std::shared_ptr<hittable> &a, const std::shared_ptr<hittable> &b, int axis_index) {
-            return a->bounding_box().axis(axis_index).min < b->bounding_box().axis(axis_index).min;
-    }
-    static bool box_compare_x(                                               // compare if a.x is smaller than b.x
-            const std::shared_ptr<hittable> &a, const std::shared_ptr<hittable> &b) {
-        return box_compare_axis(a, b, 0);
+    bvh_node() = default;
+
+    static double child_cost(const std::shared_ptr<hittable>& child, const bvh_build_options& options) {
+        if (auto node = std::dynamic_pointer_cast<bvh_node>(child))
+            return node->sah_cost(options);
+        return options.intersection_cost;                                    // a primitive linked directly
     }
-    static bool box_compare_y(                                               // compare if a.y is smaller than b.y
-            const std::shared_ptr<hittable> &a, const std::shared_ptr<hittable> &b) {
-        return box_compare_axis(a, b, 1);
+
+    // turn builder node `index` into this node, children become bvh_nodes, single primitives are linked directly
+    void assign(const bvh_builder& builder, uint32_t index, const std::vector<std::shared_ptr<hittable>>& objects) {
+        const auto& node = builder.nodes[index];
+        bbox = node.box;
+        if (node.count > 0) {
+            primitives.reserve(node.count);
+            for (uint32_t i = node.start; i != node.start + node.count; ++i)
+                primitives.push_back(objects[builder.indices[i]]);
+            return;
+        }
+        left = make_child(builder, node.left, objects);
+        right = make_child(builder, node.right, objects);
     }
-    static bool box_compare_z(                                               // compare if a.z is smaller than b.z
-            const std::shared_ptr<hittable> &a, const std::shared_ptr<hittable> &b) {
-        return box_compare_axis(a, b, 2);
+
+    static std::shared_ptr<hittable> make_child(const bvh_builder& builder, uint32_t index,
+                                                const std::vector<std::shared_ptr<hittable>>& objects) {
+        const auto& node = builder.nodes[index];
+        if (node.count == 1) return objects[builder.indices[node.start]];   // no node for a single primitive
+        auto child = std::shared_ptr<bvh_node>(new bvh_node());
+        child->assign(builder, index, objects);
+        return child;
     }
 };
 
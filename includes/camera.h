@@ -14,9 +14,25 @@
 #include "fstream"
 #include "sstream"
 #include "lambertian.h"
+#include "thread_pool.h"
+#include "light_list.h"
+#include "checkpoint.h"
+#include "image_file.h"
+#include "denoiser.h"
+#include "render_stats.h"
+#include "atomic"
+#include "mutex"
+#include "typeindex"
+#include "unordered_map"
+#include "utility"
 
 class camera {
 public:
+    enum class integrator_type {
+        recursive,                                         // ray_color: one call per bounce, up to max_depth
+        iterative                                          // trace_path: a loop with russian roulette and depth caps
+    };
+
     bool print_progress = true;                            // print the "lines done: xx"
     unsigned int samples_per_pixel = 10;                   // pixel sample time, large for better visual effects
     unsigned int max_depth = 50;                           // light ray bounce max depth
@@ -25,6 +41,34 @@ public:
     point3 lookfrom = point3{0, 0, -1};        // look from position
     point3 lookat = point3{0, 0, 0};           // look at position
     vec3 vup = vec3{0, 1, 0};                  // camera vup vector, actually it controls the rotation
+    bool tiled_render = true;                              // split the image into tiles and render them in parallel
+    unsigned int thread_count = 0;                         // worker threads for tiled render, 0 = all hardware threads
+    unsigned int tile_size = 32;                           // tile edge length in pixels
+    unsigned long long rng_seed = 0;                       // per-pixel sample streams derive from this seed
+    unsigned int packet_size = 0;                          // tiled render: trace camera rays in packets of 4, 8 or
+                                                           // 16 neighbouring pixels, 0 = one ray at a time
+    integrator_type integrator = integrator_type::recursive;
+    unsigned int roulette_depth = 5;                       // iterative: bounces before russian roulette may end a path
+    bool light_sampling = false;                           // iterative: next-event estimation with MIS, see shade_path
+    std::string checkpoint_file;                           // arrange_render resumes from and saves to this, if set
+    image_file::format output_format = image_file::format::automatic;    // by the output file's extension
+    bool background_writes = true;                         // arrange_render: write a step's image while the next renders
+    bool adaptive_sampling = false;                        // render: passes of adaptive_step samples go only to tiles
+    unsigned int adaptive_step = 16;                       // whose error is above adaptive_threshold, see render_adaptive
+    unsigned int adaptive_min_samples = 64;
+    double adaptive_threshold = 0.01;
+    std::string sample_map_file;                           // adaptive: samples per pixel as an image, if set
+    bool denoise = false;                                  // gather first-hit albedo and normal while rendering and
+    denoiser::settings denoise_settings;                   // write images through denoiser::atrous
+    struct aov_outputs {                                   // what camera rays hit first, gathered while rendering and
+        bool albedo = false;                               // written next to the image: out.png, out_albedo.png, ...
+        bool normal = false;                               // shading normal, -1..1 in a PFM, 0.5 + n/2 otherwise
+        bool depth = false;                                // distance t, near is white, 0 where nothing was hit
+        bool object_id = false;                            // 1 + the object's index in gather_primitives, 0 for none;
+        bool material_id = false;                          // 1 + material_id; both of the pixel's first ray
+        bool emission = false;                             // what the first hit emits itself
+    };
+    aov_outputs aovs;                                      // set before the first render
     std::function<color(double)> background_function =     // function controls how the background color will be rendered
             [](double blend_factor) -> color {
                 color color1{1.0, 1.0, 1.0};
@@ -47,6 +91,14 @@ public:
         this->image_width = width;
     }
 
+    void set_image_width(int width) {                                       // keeps the aspect ratio
+        this->image_width = width;
+    }
+
+    void set_aspect_ratio(double ratio) {                                   // keeps the image width
+        this->aspect_ratio = ratio;
+    }
+
     void set_output_file(const std::string &val) {
         this->output_file = val;
         if (filestream.is_open())
@@ -68,12 +120,25 @@ public:
         }
     }
 
-    [[nodiscard]] double focus_test(const hittable_list& world) {
-        if (!initialized) initialize();
-        ray test_ray{camera_center, -w_};
+    // iterative: a path ends at a Material once it is `depth` bounces deep, e.g. cap_depth<material::lambertian>(8)
+    template<typename Material>
+    void cap_depth(unsigned int depth) {
+        depth_caps[std::type_index(typeid(Material))] = depth;
+    }
+
+    // rays traced by the renders so far: camera rays, and all rays (camera, bounce and shadow rays)
+    [[nodiscard]] uint64_t camera_rays() const { return camera_ray_count; }
+    [[nodiscard]] uint64_t rays_traced() const { return ray_count; }
+    // counted only when compiled with RAY_TRACING_STATS, all zero otherwise
+    [[nodiscard]] const render_stats::counters& statistics() const { return stats; }
+
+    // distance to what the view center looks at, from lookfrom and lookat, so it can be called before initialize()
+    [[nodiscard]] double focus_test(const hittable_list& world) const {
+        ray test_ray{lookfrom, normalize(lookat - lookfrom)};
         hit_record rec;
         if (world.hit(test_ray, interval(0.0001, utilities::infinity), rec)) {
-            return (rec.p - camera_center).length();
+            rec.compute_surface(test_ray);
+            return (rec.p - lookfrom).length();
         } else {
             return utilities::infinity;
         }
@@ -97,9 +162,10 @@ public:
 
         image_height = static_cast<int>(image_width / aspect_ratio);
         image_height = (image_height > 1) ? image_height : 1;
-                                                                                 // late initialize the buffer
+                                                                                 // late initialize the buffers
                                                                                  // they are all zero-initialized
-        image_buffer = std::make_unique<unsigned char[]>(image_width * image_height * 3);
+        accumulation = std::make_unique<double[]>(image_width * image_height * 3);
+        pixel_samples = std::make_unique<unsigned int[]>(image_width * image_height);
 
         auto theta = utilities::degree_to_radian(vfov);
         auto h = tan(theta / 2);                                     // h is height for unit focal_length
@@ -126,24 +192,77 @@ public:
 //        }
     }
 
+    // Renders groups more steps of sample_per_group samples. With a checkpoint_file, the image is saved there
+    // after every step, and a matching checkpoint found there at the start is resumed: only the steps it doesn't
+    // have yet are rendered, so rerunning the same call after a crash finishes the same image.
     void arrange_render(const hittable_list& world, unsigned groups, unsigned sample_per_group) {
         if (!initialized) initialize();
         if (output_file.empty()) {
             std::cout << "Error occurred while arranging render. Empty output_file is not supported." << std::endl;
             return;
         }
+        auto target = sample_count + groups * sample_per_group;
+        if (!checkpoint_file.empty() && load_checkpoint(checkpoint_file, world) && print_progress)
+            std::cout << "Resuming from " << checkpoint_file << ", sample count = " << sample_count << std::endl;
         if (print_progress) std::cout << "Launching render... Size = " << groups << " x " << sample_per_group << std::endl;
-        for (unsigned int i = 0; i != groups; ++i) {
-            render_step(world, sample_per_group, true);
+        while (sample_count < target) {
+            render_step(world, std::min(sample_per_group, target - sample_count));
+            if (!checkpoint_file.empty()) save_checkpoint(checkpoint_file, world);
         }
+        if (writer) writer->wait();                                         // the last step's image is complete
+    }
+
+    // The accumulation buffer, per-pixel sample counts and sample count, in the format of checkpoint.h
+    bool save_checkpoint(const std::string& filename, const hittable_list& world) {
+        if (!initialized) initialize();
+        checkpoint::header head{};
+        std::memcpy(head.magic, checkpoint::magic, sizeof(head.magic));
+        head.width = image_width;
+        head.height = image_height;
+        head.sample_count = sample_count;
+        head.max_depth = max_depth;
+        head.rng_seed = rng_seed;
+        head.fingerprint = fingerprint(world);
+        return checkpoint::write(filename, head, accumulation.get(), pixel_samples.get());
     }
 
-    void render(const hittable_list& world, bool empty_file_first = true) {
+    // Continues from a checkpoint of this camera and scene. A checkpoint of another resolution, seed, scene or
+    // camera setting is refused, and the camera is left as it was.
+    bool load_checkpoint(const std::string& filename, const hittable_list& world) {
         if (!initialized) initialize();
-        internal_render(world, samples_per_pixel, empty_file_first);
-        sample_count += samples_per_pixel;
+        return checkpoint::read(filename, [&](const checkpoint::header& head, const unsigned char* data) {
+            const auto width = static_cast<uint32_t>(image_width), height = static_cast<uint32_t>(image_height);
+            if (head.width != width || head.height != height) {
+                std::cout << "Error occurred while loading the checkpoint. It is " << head.width << 'x'
+                          << head.height << ", the camera is " << image_width << 'x' << image_height << std::endl;
+                return false;
+            }
+            if (head.fingerprint != fingerprint(world) || head.rng_seed != rng_seed || head.max_depth != max_depth) {
+                std::cout << "Error occurred while loading the checkpoint. It was rendered with another scene or "
+                             "camera." << std::endl;
+                return false;
+            }
+            auto pixels = static_cast<size_t>(image_width) * image_height;
+            std::memcpy(accumulation.get(), data, pixels * 3 * sizeof(double));
+            std::memcpy(pixel_samples.get(), data + pixels * 3 * sizeof(double), pixels * sizeof(unsigned int));
+            sample_count = head.sample_count;
+            return true;
+        });
+    }
+
+    void render(const hittable_list& world) {
+        if (!initialized) initialize();
+        if (adaptive_sampling) {
+            render_adaptive(world);
+        } else {
+            internal_render(world, samples_per_pixel);
+            sample_count += samples_per_pixel;
+        }
+#ifdef RAY_TRACING_STATS
+        if (print_progress) std::clog << render_stats::report(stats);
+#endif
         if (print_progress) std::clog << "Writing to file..." << std::endl;
-        write_all_color(empty_file_first);
+        write_all_color();
     }
 
 
@@ -160,8 +279,33 @@ private:
 
     double reciprocal_sqrt_spp = 0.0;
 
-    std::unique_ptr<unsigned char[]> image_buffer;                         // store the buffer and count of samples
-    unsigned int sample_count = 0;
+    // Linear radiance, summed over every sample a pixel has had, and how many that is. Averaging, gamma and
+    // quantization happen only when an image is written, so a long progressive render keeps converging where an
+    // 8-bit running average stopped moving after a few thousand samples.
+    std::unique_ptr<double[]> accumulation;                                // rgb sums, row h at h * image_width
+    std::unique_ptr<unsigned int[]> pixel_samples;
+    std::unique_ptr<image_file::writer_thread> writer;                     // started by the first background write
+    std::unique_ptr<double[]> odd_accumulation;                            // adaptive: the sums of every other pass
+    std::unique_ptr<unsigned int[]> odd_pixel_samples;                     // of a pixel, see render_adaptive
+    unsigned int sample_count = 0;                                         // samples per pixel of passes so far
+    std::unordered_map<std::type_index, unsigned int> depth_caps;          // see cap_depth
+    light_list lights;                                                     // gathered by internal_render
+    const material::material_table* materials = nullptr;                   // the world's, set by internal_render
+    struct aov_buffers {                                                   // allocated by prepare_aovs
+        std::unique_ptr<float[]> albedo, normal, emission;                 // sums over camera rays, 3 per pixel
+        std::unique_ptr<float[]> depth;                                    // sum over the rays that hit
+        std::unique_ptr<uint32_t[]> object_id, material_id;
+        std::unique_ptr<unsigned int[]> samples, hits;                     // camera rays, and those that hit
+    };
+    aov_buffers aov;                                                       // also the denoiser's albedo and normal
+    std::unordered_map<const hittable*, uint32_t> object_ids;             // aovs.object_id, from gather_primitives
+    struct ray_counts {
+        uint64_t camera, total;                                            // zero, being thread_local
+    };
+    static inline thread_local ray_counts thread_rays;                     // counted without sharing a cache line,
+    std::atomic<uint64_t> camera_ray_count{0}, ray_count{0};               // merged by count_rays after every tile
+    render_stats::counters stats{};                                        // also merged by count_rays
+    std::mutex stats_mutex;
 
     vec3 u, v, w_;                                                         // camera coordinate basis
 
@@ -183,6 +327,9 @@ private:
     std::ofstream filestream;
     bool stream_is_file = false;
 
+    std::unique_ptr<thread_pool> pool;                                     // created on first tiled render
+    std::mutex progress_mutex;
+
     bool initialized = false;
 
     void refocus() {
@@ -260,23 +407,191 @@ private:
     }
 
 
+    // the material of a completed hit, from the table of the world being rendered
+    [[nodiscard]] material::material_base* surface_of(const hit_record& rec) const {
+        return materials->get(rec.surface_id);
+    }
+
+    // world.hit over the whole ray, counted
+    static bool closest_hit(const ray& r, const hittable& world, hit_record& rec) {
+        ++thread_rays.total;
+        return world.hit(r, interval(min_hit_distance(r), utilities::infinity), rec);
+    }
+
+    // moves the calling thread's ray counts (and render statistics) into the camera's
+    void count_rays() {
+        camera_ray_count += std::exchange(thread_rays.camera, 0);
+        ray_count += std::exchange(thread_rays.total, 0);
+#ifdef RAY_TRACING_STATS
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.add(render_stats::local());
+        render_stats::local() = {};
+#endif
+    }
+
     [[nodiscard]] color ray_color(const ray &r, unsigned int remain_depth, const hittable& world) {
         if (remain_depth <= 0) return color{0, 0, 0};                  // exceeds depths limit
 
         hit_record rec;
+        RAY_TRACING_COUNT_DEPTH(max_depth - remain_depth);
+        if (!closest_hit(r, world, rec))
+            return background_color(r);                                             // no hit -> return background color
+        return shade_hit(r, rec, remain_depth, world);
+    }
+
+    // radiance along one camera ray with the selected integrator
+    [[nodiscard]] color trace(const ray& r, const hittable& world) {
+        if (integrator == integrator_type::iterative) return trace_path(r, world);
+        return ray_color(r, max_depth, world);
+    }
+
+    // the same, from a closest hit that is already known (packet path)
+    [[nodiscard]] color trace_from_hit(const ray& r, hit_record& rec, const hittable& world) {
+        if (integrator == integrator_type::iterative) return shade_path(r, rec, world);
+        return shade_hit(r, rec, max_depth, world);
+    }
+
+    // trace() for a camera ray, adding its first hit to the pixel's AOVs if they are gathered
+    [[nodiscard]] color trace_camera_ray(const ray& r, const hittable& world, size_t pixel_index) {
+        if (!aov.samples || max_depth == 0) return trace(r, world);
+        hit_record rec;
+        RAY_TRACING_COUNT_DEPTH(0);
+        if (!closest_hit(r, world, rec)) {
+            ++aov.samples[pixel_index];                                            // a miss adds nothing
+            return background_color(r);
+        }
+        gather_aovs(r, rec, pixel_index);
+        return trace_from_hit(r, rec, world);
+    }
+
+    // completes rec and adds it to the pixel's AOV sums; tiles are disjoint, so no two threads share a pixel
+    void gather_aovs(const ray& r, hit_record& rec, size_t pixel_index) {
+        const auto* object = rec.object;
+        rec.compute_surface(r);
+        const auto* surface = surface_of(rec);
+        auto i = pixel_index * 3;
+        if (aov.albedo) {
+            auto albedo = surface->albedo(rec);
+            for (int c = 0; c != 3; ++c) aov.albedo[i + c] += static_cast<float>(albedo[c]);
+        }
+        if (aov.normal) for (int c = 0; c != 3; ++c) aov.normal[i + c] += static_cast<float>(rec.normal[c]);
+        if (aov.emission) {
+            auto emission = surface->emitted(rec.u, rec.v, rec.p);
+            for (int c = 0; c != 3; ++c) aov.emission[i + c] += static_cast<float>(emission[c]);
+        }
+        if (aov.depth) {
+            aov.depth[pixel_index] += static_cast<float>(rec.t);
+            ++aov.hits[pixel_index];
+        }
+        if (aov.samples[pixel_index] == 0) {                                       // ids can't be averaged
+            if (aov.object_id) {
+                auto found = object_ids.find(object);
+                aov.object_id[pixel_index] = found == object_ids.end() ? 0 : found->second;
+            }
+            if (aov.material_id) aov.material_id[pixel_index] = rec.surface_id + 1;
+        }
+        ++aov.samples[pixel_index];
+    }
+
+    // ray_color as a loop: one hit_record for the whole path, the product of the attenuations so far (throughput)
+    // and the radiance gathered so far instead of a call per bounce. From roulette_depth on, a path survives a
+    // bounce with probability max(throughput), and survivors are weighted up by its inverse, so dim paths end
+    // early without biasing the image.
+    [[nodiscard]] color trace_path(const ray& r, const hittable& world) {
+        if (max_depth == 0) return color{0, 0, 0};
+        hit_record rec;
+        RAY_TRACING_COUNT_DEPTH(0);
+        if (!closest_hit(r, world, rec))
+            return background_color(r);
+        return shade_path(r, rec, world);
+    }
+
+    // With light sampling, every diffuse bounce also sends one shadow ray to a random light (sample_light), and
+    // a light that a bounce hits by itself is weighted against the chance the shadow ray had of finding it
+    // (multiple importance sampling, power heuristic). Specular bounces (metal, dielectric: no pdf) can't be
+    // light sampled, so lights seen through them count in full as before.
+    [[nodiscard]] color shade_path(ray r, hit_record& rec, const hittable& world) {
+        color radiance{0, 0, 0}, throughput{1, 1, 1};
+        real scatter_pdf = 0;                                                      // of the bounce that led here,
+        point3 scatter_origin;                                                     // 0 for the camera and specular
+        for (unsigned int depth = 1; ; ++depth) {                                  // depth: hits so far
+            bool light_sampled = scatter_pdf > 0 && lights.contains(rec.object);
+            rec.compute_surface(r);
+            const auto* surface = surface_of(rec);
+            auto emission = surface->emitted(rec.u, rec.v, rec.p);
+            if (light_sampled) emission *= power_heuristic(scatter_pdf, lights.pdf_value(scatter_origin, r.direction()));
+            radiance += throughput * emission;
+            if (depth >= max_depth || depth >= depth_cap(*surface)) break;
+            ray scatter_ray;
+            color attenuation;
+            real pdf = 0.0;
+            if (!surface->scatter(r, rec, attenuation, scatter_ray, pdf)) break;
+            if (pdf > 0 && !lights.empty())
+                radiance += throughput * attenuation * sample_light(r, rec, *surface, world);
+            throughput = throughput * attenuation;
+            scatter_pdf = pdf;
+            scatter_origin = rec.p;
+            if (depth >= roulette_depth) {
+                auto survival = std::min(real(1), std::max(throughput.x(), std::max(throughput.y(), throughput.z())));
+                if (sampler::thread_rng().uniform() >= survival) break;    // also ends black paths for sure
+                throughput /= survival;
+            }
+            r = scatter_ray;
+            RAY_TRACING_COUNT_DEPTH(depth);
+            if (!closest_hit(r, world, rec)) {
+                radiance += throughput * background_color(r);
+                break;
+            }
+        }
+        return radiance;
+    }
+
+    // Light arriving at rec over one shadow ray to a random point of a random light, per unit attenuation: the
+    // material's scattering_pdf turns attenuation into the BRDF times cosine, the light's pdf_value divides out
+    // how the direction was chosen.
+    [[nodiscard]] color sample_light(const ray& r, const hit_record& rec, const material::material_base& surface,
+                                     const hittable& world) const {
+        ray shadow_ray(rec.p, lights.random(rec.p), r.time());
+        auto light_pdf = lights.pdf_value(rec.p, shadow_ray.direction());
+        if (light_pdf <= 0) return color{0, 0, 0};
+        auto surface_pdf = surface.scattering_pdf(r, rec, shadow_ray);
+        if (surface_pdf <= 0) return color{0, 0, 0};                              // below the surface
+        hit_record light_rec;
+        RAY_TRACING_COUNT(shadow_rays);
+        if (!closest_hit(shadow_ray, world, light_rec) || !lights.contains(light_rec.object))
+            return color{0, 0, 0};                                                 // in shadow
+        light_rec.compute_surface(shadow_ray);
+        auto emission = surface_of(light_rec)->emitted(light_rec.u, light_rec.v, light_rec.p);
+        return emission * (surface_pdf / light_pdf * power_heuristic(light_pdf, surface_pdf));
+    }
+
+    static real power_heuristic(real pdf, real other_pdf) {
+        return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+    }
+
+    [[nodiscard]] unsigned int depth_cap(const material::material_base& surface) const {
+        if (depth_caps.empty()) return max_depth;
+        auto found = depth_caps.find(std::type_index(typeid(surface)));
+        return found == depth_caps.end() ? max_depth : found->second;
+    }
+
+    [[nodiscard]] color background_color(const ray& r) const {
         auto blend_factor = 0.5 * (r.direction().y() + 1.0);
-        if (!world.hit(r, interval(0.0001, utilities::infinity), rec))
-            return background_function(blend_factor);                               // no hit -> return background color
+        return background_function(blend_factor);
+    }
 
-        color emission_color = rec.surface_material->emitted(rec.u, rec.v, rec.p);  // emission term
+    // everything ray_color does once the closest hit is known; the packet path joins here for its camera rays
+    [[nodiscard]] color shade_hit(const ray& r, hit_record& rec, unsigned int remain_depth, const hittable& world) {
+        rec.compute_surface(r);                                                     // the closest hit only
+        color emission_color = surface_of(rec)->emitted(rec.u, rec.v, rec.p);      // emission term
         ray scatter_ray;                                                            // scatter term
         color attenuation;
-        double pdf = 0.0;
-        if (!rec.surface_material->scatter(r, rec, attenuation, scatter_ray, pdf))
+        real pdf = 0.0;
+        if (!surface_of(rec)->scatter(r, rec, attenuation, scatter_ray, pdf))
             return emission_color;                                                  // no scatter, just emission
 
                                                                                     // probability of getting scatter_ray
-//        double scattering_pdf = rec.surface_material->scattering_pdf(r, rec, scatter_ray);
+//        double scattering_pdf = surface_of(rec)->scattering_pdf(r, rec, scatter_ray);
 //        double sample_pdf = scattering_pdf;                                         // relative prob of sampling this ray
 //
 //        color scatter_color = attenuation
@@ -286,174 +601,505 @@ private:
         return emission_color + scatter_color;
     }
 
+    // what a checkpoint must have been rendered with to be resumed: the view, the integrator and the bounds of every
+    // primitive, gathered through any BVHs (not their materials, which have no cheap identity)
+    [[nodiscard]] uint64_t fingerprint(const hittable_list& world) const {
+        checkpoint::hasher hash;
+        for (const auto& point: {lookfrom, lookat, vup})
+            hash.add(double(point.x())).add(double(point.y())).add(double(point.z()));
+        hash.add(vfov).add(aspect_ratio).add(defocus_angle).add(focus_dist).add(exposure_time);
+        hash.add(static_cast<int>(integrator)).add(roulette_depth).add(light_sampling).add(sizeof(real));
+        size_t caps = 0;                                                    // in any order
+        for (const auto& [type, depth]: depth_caps) caps += type.hash_code() ^ depth;
+        hash.add(caps);
+        std::vector<const hittable*> primitives;
+        world.gather_primitives(primitives);
+        hash.add(primitives.size());
+        for (const auto* primitive: primitives) {
+            auto bounds = primitive->bounding_box();
+            for (int axis = 0; axis != 3; ++axis)
+                hash.add(double(bounds.axis(axis).min)).add(double(bounds.axis(axis).max));
+        }
+        return hash.value();
+    }
+
     void load_image(const std::string& filename, unsigned int previous_samples = 1) {
-        std::ifstream file(filename);
+        std::ifstream file(filename, std::ios::binary);
         if (!file.is_open()) {
             std::cout << "Error occurred while opening the file." << std::endl;
             return;
         }
-        std::string line;
-        // read the first line, should be "P3"
-        std::getline(file, line);
-        if (line != "P3") {
+        // the header: "P3" (text) or "P6" (binary), image_width image_height, 255
+        std::string magic;
+        int width, height, depth;
+        file >> magic >> width >> height >> depth;
+        if (magic != "P3" && magic != "P6") {
             std::cout << "Error occurred while reading the file. The file is not a PPM file." << std::endl;
             return;
         }
-        // read the second line, should be image_width image_height
-        std::getline(file, line);
-        std::stringstream ss(line);
-        int width, height;
-        ss >> width >> height;
         if (width != image_width || height != image_height) {
             std::cout << "Error occurred while reading the file. The file's size does not match." << std::endl;
             return;
         }
-        // read the third line, should be 255
-        std::getline(file, line);
-        if (line != "255") {
+        if (depth != 255) {
             std::cout << "Error occurred while reading the file. The file's color depth is not 255." << std::endl;
             return;
         }
-        // read the rest of the file
-        for (unsigned int h = 0; h != image_height; ++h) {
-            for (unsigned int w = 0; w != image_width; ++w) {
-                auto buffer_index = (image_height - h - 1) * image_width * 3 + w * 3;
-                int r, g, b;
-                file >> r >> g >> b;
-                image_buffer[buffer_index] = r;
-                image_buffer[buffer_index + 1] = g;
-                image_buffer[buffer_index + 2] = b;
+        auto pixels = static_cast<size_t>(image_width) * image_height;
+        std::vector<unsigned char> rgb(pixels * 3);
+        if (magic == "P6") {
+            file.get();                                                     // the one whitespace after the header
+            file.read(reinterpret_cast<char*>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+        } else {
+            for (auto& value: rgb) {
+                int number;
+                file >> number;
+                value = static_cast<unsigned char>(number);
+            }
+        }
+        if (!file) {
+            std::cout << "Error occurred while reading the file. The file is too short." << std::endl;
+            return;
+        }
+        // undo the gamma and weight the image as previous_samples samples
+        for (size_t pixel_index = 0; pixel_index != pixels; ++pixel_index) {
+            for (int c = 0; c != 3; ++c) {
+                auto gamma = (rgb[pixel_index * 3 + c] + 0.5) / 256.0;       // middle of the value's range
+                accumulation[pixel_index * 3 + c] = gamma * gamma * previous_samples;
             }
+            pixel_samples[pixel_index] = previous_samples;
         }
         sample_count = previous_samples;
         file.close();
         if (print_progress) std::cout << "Image loaded." << std::endl;
     }
 
-    void render_step(const hittable_list& world, unsigned int samples_per_pixel_step, bool empty_file_first = true) {
+    void render_step(const hittable_list& world, unsigned int samples_per_pixel_step) {
         if (print_progress) std::cout << "Rendering... sample steps = " << samples_per_pixel_step << std::endl;
         if (!initialized) initialize();                     // directly call the internal render function
-        internal_render(world, samples_per_pixel_step, empty_file_first);
+        internal_render(world, samples_per_pixel_step);
         sample_count += samples_per_pixel_step;
         if (print_progress) std::clog << "Writing to file..., sample count = " << sample_count << std::endl;
         std::string step_string = std::to_string(sample_count);
-        // remove .ppm, concatenate the step string, add .ppm
-        std::string filename = output_file.substr(0, output_file.size() - 4) + "_" + step_string + ".ppm";
-        write_all_color(empty_file_first, filename);
+        write_all_color(with_suffix(output_file, "_" + step_string), background_writes);
+    }
+
+    // filename with suffix before its extension: out.png, "_16" -> out_16.png
+    [[nodiscard]] static std::string with_suffix(const std::string& filename, const std::string& suffix) {
+        auto dot = filename.find_last_of('.');
+        if (dot == std::string::npos || filename.find_first_of("/\\", dot) != std::string::npos)
+            dot = filename.size();
+        return filename.substr(0, dot) + suffix + filename.substr(dot);
     }
 
-    void internal_render(const hittable_list& world, unsigned int samples = 0, bool empty_file_first = true) {
+    struct tile_layout {
+        unsigned edge, tiles_x, tiles_y;
+        unsigned block_w, block_h;                                          // pixels per packet
+    };
+
+    [[nodiscard]] tile_layout layout_tiles() const {
+        tile_layout layout{tile_size > 0 ? tile_size : 32, 0, 0, 1, 1};
+        if (packet_size >= 16) layout.block_w = layout.block_h = 4;
+        else if (packet_size >= 8) layout.block_w = 4, layout.block_h = 2;
+        else if (packet_size >= 4) layout.block_w = layout.block_h = 2;
+        if (layout.block_w > 1) layout.edge = (layout.edge + 3) / 4 * 4;   // blocks never straddle two tiles
+        layout.tiles_x = (image_width + layout.edge - 1) / layout.edge;
+        layout.tiles_y = (image_height + layout.edge - 1) / layout.edge;
+        return layout;
+    }
+
+    // Adaptive sampling. Every pass adds adaptive_step samples to the pixels of the tiles still active, and a
+    // pixel's odd-numbered passes also go into a second buffer, so each pixel has two estimates: I from all of its
+    // samples and A from half of them. Their difference is an error estimate that needs no per-sample bookkeeping
+    // (the one Cycles uses): |I - A| summed over the channels, relative to sqrt(I), which makes it an error of the
+    // gamma-corrected image. Once every pixel has adaptive_min_samples, a tile stays active while the mean error
+    // of its pixels is above adaptive_threshold; earlier, a tile whose rare bright paths (caustics through glass)
+    // haven't shown up yet would look converged and stop for good. Rendering stops when no tile is active or
+    // samples_per_pixel is reached.
+    void render_adaptive(const hittable_list& world) {
+        auto pixels = static_cast<size_t>(image_width) * image_height;
+        odd_accumulation = std::make_unique<double[]>(pixels * 3);
+        odd_pixel_samples = std::make_unique<unsigned int[]>(pixels);
+        auto step = std::max(adaptive_step, 1u);
+        auto layout = layout_tiles();
+        std::vector<char> active(layout.tiles_x * layout.tiles_y, 1);
+        auto start = sample_count, target = sample_count + std::max(samples_per_pixel, step);
+        for (unsigned int pass = 0; sample_count < target; ++pass) {
+            internal_render(world, std::min(step, target - sample_count), &active);
+            sample_count += std::min(step, target - sample_count);
+            if (pass == 0 || sample_count - start < adaptive_min_samples) continue;    // one pass gives no estimate
+            size_t remaining = 0;
+            for (unsigned tile = 0; tile != active.size(); ++tile) {
+                if (active[tile] && tile_error(layout, tile) <= adaptive_threshold) active[tile] = 0;
+                remaining += active[tile];
+            }
+            if (print_progress)
+                std::clog << "Adaptive pass " << pass + 1 << ": " << remaining << '/' << active.size()
+                          << " tiles above the threshold" << std::endl;
+            if (remaining == 0) break;
+        }
+        odd_accumulation.reset();
+        odd_pixel_samples.reset();
+        if (!sample_map_file.empty()) write_sample_map(sample_map_file);
+    }
+
+    [[nodiscard]] double tile_error(const tile_layout& layout, unsigned tile) const {
+        unsigned x0 = tile % layout.tiles_x * layout.edge, y0 = tile / layout.tiles_x * layout.edge;
+        unsigned x1 = std::min(x0 + layout.edge, static_cast<unsigned>(image_width));
+        unsigned y1 = std::min(y0 + layout.edge, static_cast<unsigned>(image_height));
+        double error = 0.0;
+        for (unsigned h = y0; h != y1; ++h) {
+            for (unsigned w = x0; w != x1; ++w) {
+                auto pixel_index = h * image_width + w;
+                if (odd_pixel_samples[pixel_index] == 0) return utilities::infinity;
+                double difference = 0.0, brightness = 0.0;
+                for (int c = 0; c != 3; ++c) {
+                    auto all = accumulation[pixel_index * 3 + c] / pixel_samples[pixel_index];
+                    auto half = odd_accumulation[pixel_index * 3 + c] / odd_pixel_samples[pixel_index];
+                    difference += std::abs(all - half);
+                    brightness += all;
+                }
+                error += difference / (0.0001 + std::sqrt(brightness));
+            }
+        }
+        return error / ((x1 - x0) * (y1 - y0));
+    }
+
+    // the samples per pixel, black for none and white for the most any pixel had
+    void write_sample_map(const std::string& filename) const {
+        auto pixels = static_cast<size_t>(image_width) * image_height;
+        auto most = std::max(1u, *std::max_element(pixel_samples.get(), pixel_samples.get() + pixels));
+        if (image_file::format_of(filename) == image_file::format::pfm) {
+            std::vector<float> counts(pixels * 3);
+            for (size_t i = 0; i != pixels * 3; ++i) counts[i] = static_cast<float>(pixel_samples[i / 3]);
+            image_file::write_pfm(filename, image_width, image_height, counts.data());
+            return;
+        }
+        std::vector<unsigned char> gray(pixels * 3);
+        for (size_t i = 0; i != pixels * 3; ++i)
+            gray[i] = static_cast<unsigned char>(pixel_samples[i / 3] * 255ull / most);
+        if (image_file::format_of(filename) == image_file::format::png)
+            image_file::write_png(filename, image_width, image_height, gray.data());
+        else
+            image_file::write_ppm_binary(filename, image_width, image_height, gray.data());
+    }
+
+    // allocates the AOV buffers asked for (the denoiser's guides too) and numbers the scene's objects for object_id
+    void prepare_aovs(const hittable_list& world) {
+        bool guides = denoise;
+        if (!(guides || aovs.albedo || aovs.normal || aovs.depth || aovs.object_id || aovs.material_id || aovs.emission))
+            return;
+        auto pixels = static_cast<size_t>(image_width) * image_height;
+        auto need = [](bool wanted, auto& buffer, size_t size) {
+            if (wanted && !buffer) buffer = std::make_unique<std::remove_reference_t<decltype(buffer[0])>[]>(size);
+        };
+        need(true, aov.samples, pixels);
+        need(guides || aovs.albedo, aov.albedo, pixels * 3);
+        need(guides || aovs.normal, aov.normal, pixels * 3);
+        need(aovs.emission, aov.emission, pixels * 3);
+        need(aovs.depth, aov.depth, pixels);
+        need(aovs.depth, aov.hits, pixels);
+        need(aovs.object_id, aov.object_id, pixels);
+        need(aovs.material_id, aov.material_id, pixels);
+        if (aovs.object_id) {
+            std::vector<const hittable*> objects;
+            world.gather_primitives(objects);
+            object_ids.clear();
+            for (size_t index = 0; index != objects.size(); ++index)      // a shared object keeps its first index
+                object_ids.emplace(objects[index], static_cast<uint32_t>(index + 1));
+        }
+    }
+
+    void internal_render(const hittable_list& world, unsigned int samples = 0,
+                         const std::vector<char>* active_tiles = nullptr) {
         if (samples == 0) samples = samples_per_pixel;
+        lights = light_sampling && integrator == integrator_type::iterative ? light_list(world) : light_list();
+        materials = &world.materials();
+        prepare_aovs(world);
         auto sqrt_spp = static_cast<unsigned>(std::sqrt(samples));   // sqrt_spp is the sqrt of samples
         bool use_sqrt = (sqrt_spp * sqrt_spp == samples);               // if samples is a perfect square, use sqrt
+        if (use_sqrt) reciprocal_sqrt_spp = 1.0 / sqrt_spp;
+        if (tiled_render || active_tiles) {                                // adaptive passes are always tiled
+            internal_render_tiled(world, samples, sqrt_spp, use_sqrt, active_tiles);
+            return;
+        }
         // first loop through height, so that the output will be row-by-row
-        if (!use_sqrt) {
-            for (unsigned h = 0; h != image_height; ++h) {
-                if (print_progress) std::clog << "\rScan lines done: " << h << ' ' << std::flush;
-                for (unsigned w = 0; w != image_width; ++w) {
-                    color avg_color{0, 0, 0};
-                    for (int i = 0; i != samples; ++i) {
-                        auto pixel_ray = get_ray_defocus(w, h);
-                        avg_color += ray_color(pixel_ray, max_depth, world);   // core render function
+        for (unsigned h = 0; h != image_height; ++h) {
+            if (print_progress) std::clog << "\rScan lines done: " << h << ' ' << std::flush;
+            for (unsigned w = 0; w != image_width; ++w) {
+                buffer_color(sample_pixel(world, w, h, samples, sqrt_spp, use_sqrt), h, w, samples);
+            }
+        }
+        count_rays();
+    }
+
+    void internal_render_tiled(const hittable_list& world, unsigned int samples, unsigned sqrt_spp, bool use_sqrt,
+                               const std::vector<char>* active_tiles = nullptr) {
+        auto& pool = worker_pool();
+        auto [edge, tiles_x, tiles_y, block_w, block_h] = layout_tiles();
+        unsigned tile_total = tiles_x * tiles_y;
+        std::atomic<unsigned> tiles_done{0};
+
+        // tiles are disjoint, so every worker writes only its own area of the accumulation buffer
+        pool.parallel_for(tile_total, [&](size_t tile) {
+            if (active_tiles && !(*active_tiles)[tile]) return;
+            unsigned x0 = static_cast<unsigned>(tile % tiles_x) * edge;
+            unsigned y0 = static_cast<unsigned>(tile / tiles_x) * edge;
+            unsigned x1 = std::min(x0 + edge, static_cast<unsigned>(image_width));
+            unsigned y1 = std::min(y0 + edge, static_cast<unsigned>(image_height));
+            if (block_w > 1) {
+                for (unsigned h = y0; h < y1; h += block_h)
+                    for (unsigned w = x0; w < x1; w += block_w)
+                        render_packet_block(world, w, h, std::min(w + block_w, x1), std::min(h + block_h, y1),
+                                            samples, sqrt_spp, use_sqrt);
+            } else {
+                for (unsigned h = y0; h != y1; ++h) {
+                    for (unsigned w = x0; w != x1; ++w) {
+                        buffer_color(sample_pixel(world, w, h, samples, sqrt_spp, use_sqrt), h, w, samples);
                     }
-                    buffer_color(avg_color, h, w,samples);
                 }
             }
+            count_rays();
+            auto finished = ++tiles_done;
+            if (print_progress) {
+                std::lock_guard<std::mutex> lock(progress_mutex);          // keep the progress line in one piece
+                std::clog << "\rTiles done: " << finished << '/' << tile_total << ' ' << std::flush;
+            }
+        });
+        if (print_progress) std::clog << std::endl;
+    }
+
+    thread_pool& worker_pool() {
+        if (!pool || (thread_count != 0 && pool->size() != thread_count))
+            pool = std::make_unique<thread_pool>(thread_count);
+        return *pool;
+    }
+
+    // sum (not average) of all samples of one pixel, stratified when samples is a perfect square
+    [[nodiscard]] color sample_pixel(const hittable_list& world, unsigned w, unsigned h,
+                                     unsigned int samples, unsigned sqrt_spp, bool use_sqrt) {
+        // every (pixel, pass) gets its own stream, so the image is the same for any thread count or tile order
+        auto pixel_index = static_cast<size_t>(h) * image_width + w;
+        sampler::thread_rng().seed(sampler::stream_seed(rng_seed, pixel_index, sample_count));
+        thread_rays.camera += samples;
+        color sum_color{0, 0, 0};
+        if (!use_sqrt) {
+            for (unsigned i = 0; i != samples; ++i) {
+                auto pixel_ray = get_ray_defocus(w, h);
+                sum_color += trace_camera_ray(pixel_ray, world, pixel_index);   // core render function
+            }
         } else {
-            reciprocal_sqrt_spp = 1.0 / sqrt_spp;
-            for (unsigned h = 0; h != image_height; ++h) {
-                if (print_progress) std::clog << "\rScan lines done: " << h << ' ' << std::flush;
-                for (unsigned w = 0; w != image_width; ++w) {
-                    color avg_color{0, 0, 0};
-                    for (int i = 0; i != sqrt_spp; ++i) {
-                        for (int j = 0; j != sqrt_spp; ++j) {
-                            auto pixel_ray = get_ray_defocus_monte_carlo(w, h, i, j);
-                            avg_color += ray_color(pixel_ray, max_depth, world);   // core render function
-                        }
-                    }
-                    buffer_color(avg_color, h, w, samples);
+            for (unsigned i = 0; i != sqrt_spp; ++i) {
+                for (unsigned j = 0; j != sqrt_spp; ++j) {
+                    auto pixel_ray = get_ray_defocus_monte_carlo(w, h, i, j);
+                    sum_color += trace_camera_ray(pixel_ray, world, pixel_index);   // core render function
                 }
             }
         }
+        return sum_color;
     }
 
-    void write_all_color(bool empty_file_first, const std::string& force_overwrite_filename = "",
-                                                                                    unsigned int depth = 255) {
-        if (stream_is_file && !output_file.empty() && !dynamic_cast<std::ofstream*>(output)->is_open()) {
-            dynamic_cast<std::ofstream*>(output)->open(output_file);
-            if (!dynamic_cast<std::ofstream*>(output)->is_open()) {
-                std::cout << "[write_all_color]Error occurred while opening the file." << std::endl;
-                return;
+    // sample_pixel for a small block of pixels, camera rays traced as one packet per sample and everything after
+    // the first hit traced one ray at a time. Each pixel keeps its own stream, swapped into the thread's generator
+    // around its own work, so it draws exactly the numbers sample_pixel would.
+    void render_packet_block(const hittable_list& world, unsigned x0, unsigned y0, unsigned x1, unsigned y1,
+                             unsigned int samples, unsigned sqrt_spp, bool use_sqrt) {
+        unsigned px[ray_packet::max_size], py[ray_packet::max_size];
+        sampler::rng streams[ray_packet::max_size];
+        color sums[ray_packet::max_size];
+        int lanes = 0;
+        for (unsigned h = y0; h != y1; ++h) {
+            for (unsigned w = x0; w != x1; ++w) {
+                px[lanes] = w;
+                py[lanes] = h;
+                streams[lanes].seed(sampler::stream_seed(rng_seed, h * image_width + w, sample_count));
+                ++lanes;
             }
         }
-        std::ostream *out = output;                                         // general output stream
-        std::ofstream force_overwrite_stream;                               // force overwrite stream
-        if (!force_overwrite_filename.empty()) {
-            force_overwrite_stream.open(force_overwrite_filename);
-            if (!force_overwrite_stream.is_open()) {
-                std::cout << "[write_all_color]Error occurred while opening the file.(force overwrite file)" << std::endl;
-                return;
+        auto& generator = sampler::thread_rng();
+        ray rays[ray_packet::max_size];
+        hit_record records[ray_packet::max_size];
+        ray_packet packet;
+        for (unsigned s = 0; s != samples && max_depth > 0; ++s) {
+            for (int i = 0; i != lanes; ++i) {
+                generator = streams[i];
+                rays[i] = use_sqrt ? get_ray_defocus_monte_carlo(px[i], py[i], s / sqrt_spp, s % sqrt_spp)
+                                   : get_ray_defocus(px[i], py[i]);
+                streams[i] = generator;
+            }
+            packet.assign(rays, lanes);
+            // anything random during the packet's hit (media) draws from a stream of the block, not of a pixel
+            generator.seed(sampler::stream_seed(~rng_seed, y0 * image_width + x0,
+                                                (static_cast<uint64_t>(sample_count) << 32) | s));
+            auto hits = world.hit_packet(packet, packet.all_lanes(), records);
+            thread_rays.camera += lanes, thread_rays.total += lanes;
+            RAY_TRACING_ADD(rays_by_depth[0], lanes);
+            for (int i = 0; i != lanes; ++i) {
+                generator = streams[i];
+                if (aov.samples) {
+                    auto pixel_index = static_cast<size_t>(py[i]) * image_width + px[i];
+                    if (hits & (1u << i)) gather_aovs(rays[i], records[i], pixel_index);
+                    else ++aov.samples[pixel_index];
+                }
+                sums[i] += (hits & (1u << i)) ? trace_from_hit(rays[i], records[i], world)
+                                              : background_color(rays[i]);
+                streams[i] = generator;
             }
-            out = &force_overwrite_stream;                                  // if force overwrite, use this stream
-            if (empty_file_first) {
-                force_overwrite_stream.seekp(0);
+        }
+        for (int i = 0; i != lanes; ++i) buffer_color(sums[i], py[i], px[i], samples);
+    }
+
+    // Writes the image to force_overwrite_filename, or else output_file, in output_format, and as P3 text to the
+    // output stream if there's no file; the AOVs go next to the file, in the same format. With denoise, what is
+    // written is the denoised image; the accumulation buffer itself stays as it was rendered, for further passes
+    // and checkpoints. In the background, the pixels are converted here and the files are encoded and written on
+    // the writer thread, so the next pass can start at once.
+    void write_all_color(const std::string& force_overwrite_filename = "", bool in_background = false,
+                                                                                    unsigned int depth = 255) {
+        auto pixels = static_cast<size_t>(image_width) * image_height;
+        auto filename = force_overwrite_filename.empty() ? output_file : force_overwrite_filename;
+        auto format = filename.empty() ? image_file::format::ppm_text : image_file::format_of(filename, output_format);
+        std::function<void()> write;
+        std::vector<float> denoised;
+        if (denoise && aov.samples) denoised = denoised_image();
+        if (format == image_file::format::pfm) {
+            std::vector<float> linear = std::move(denoised);
+            if (linear.empty()) {
+                linear.resize(pixels * 3);
+                image_file::to_linear(accumulation.get(), pixel_samples.get(), pixels, linear.data());
             }
-        } else if (empty_file_first && stream_is_file) {                    // if not force overwrite, use original stream
-            if (!dynamic_cast<std::ofstream*>(out)->is_open())
-                dynamic_cast<std::ofstream*>(out)->open(output_file);
-            dynamic_cast<std::ofstream*>(out)->seekp(0);
-        }
-        *out << "P3\n" << image_width << ' ' << image_height << "\n" << depth << "\n";
-        for (unsigned int h = 0; h != image_height; ++h) {
-            for (unsigned int w = 0; w != image_width; ++w) {
-                auto buffer_index = (image_height - h - 1) * image_width * 3 + w * 3;
-                auto r = static_cast<int>(image_buffer[buffer_index]);          // write int, not char
-                auto g = static_cast<int>(image_buffer[buffer_index + 1]);
-                auto b = static_cast<int>(image_buffer[buffer_index + 2]);
-                *out << r << ' ' << g << ' ' << b << '\n';
+            write = image_job(filename, format, {}, std::move(linear));
+        } else {
+            std::vector<unsigned char> rgb(pixels * 3);
+            if (!denoised.empty()) image_file::to_display(denoised.data(), nullptr, pixels, rgb.data(), depth);
+            else image_file::to_display(accumulation.get(), pixel_samples.get(), pixels, rgb.data(), depth);
+            if (filename.empty()) {
+                image_file::write_ppm_text(*output, image_width, image_height, rgb.data(), depth);
+                return;
             }
+            write = image_job(filename, format, std::move(rgb), {}, depth);
         }
-        *out << std::endl;                                                      // this will force the stream to write
-        if (!force_overwrite_filename.empty()) {                                // if force overwrite, close the stream
-            force_overwrite_stream.close();
+        if (aov.samples)
+            write = [image = std::move(write), aov_images = aov_job(filename, format)] { image(); aov_images(); };
+        if (!in_background) {
+            if (writer) writer->wait();                                     // an older step must not land later
+            write();
             return;
         }
-        if (force_overwrite_filename.empty() && stream_is_file) {               // if not force overwrite, close the stream
-            dynamic_cast<std::ofstream*>(out)->close();
-        }
-    }
-
-    static inline double linear_to_gamma(double val) {
-        return std::sqrt(val);
-    }
-
-    void buffer_color(const color &pixel_color, unsigned int h, unsigned int w,
-                                                    unsigned int sample_num, unsigned int depth = 255) {
-        static const interval intensity(0, 0.999);
-        auto r = pixel_color.x();
-        auto g = pixel_color.y();
-        auto b = pixel_color.z();
-
-        // Divide the color by the number of samples and gamma-correct for gamma=2.0.
-        auto scale = 1.0 / sample_num;
-        r = linear_to_gamma(r * scale);
-        g = linear_to_gamma(g * scale);
-        b = linear_to_gamma(b * scale);
-
-        // Write the translated [0,255] value of each color component.
-        double coefficient = depth + 0.999;
-        // write to buffer
-        auto buffer_index = (image_height - h - 1) * image_width * 3 + w * 3;
-        auto buffer2_index = h * image_width + w;          // merge old and new
-        image_buffer[buffer_index] = (static_cast<unsigned char>(intensity.clamp(r) * coefficient) * sample_num
-                + image_buffer[buffer_index] * sample_count)
-                / (sample_count + sample_num);                      // r'=(r_new*new_count+r_old*old_count)/(new+old)
-        image_buffer[buffer_index + 1] = (static_cast<unsigned char>(intensity.clamp(g) * coefficient) * sample_num
-                + image_buffer[buffer_index + 1] * sample_count)
-                / (sample_count + sample_num);
-        image_buffer[buffer_index + 2] = (static_cast<unsigned char>(intensity.clamp(b) * coefficient) * sample_num
-                + image_buffer[buffer_index + 2] * sample_count)
-                / (sample_count + sample_num);
+        if (!writer) writer = std::make_unique<image_file::writer_thread>();
+        writer->submit(std::move(write));
+    }
+
+    // writes rgb, or linear for a PFM, to filename
+    [[nodiscard]] std::function<void()> image_job(const std::string& filename, image_file::format format,
+                                                  std::vector<unsigned char> rgb, std::vector<float> linear,
+                                                  unsigned int depth = 255) const {
+        int width = image_width, height = image_height;
+        return [=, rgb = std::move(rgb), linear = std::move(linear)] {
+            if (format == image_file::format::pfm) image_file::write_pfm(filename, width, height, linear.data());
+            else if (format == image_file::format::png) image_file::write_png(filename, width, height, rgb.data());
+            else if (format == image_file::format::ppm_text)
+                image_file::write_ppm_text(filename, width, height, rgb.data(), depth);
+            else image_file::write_ppm_binary(filename, width, height, rgb.data(), depth);
+        };
+    }
+
+    // The AOVs asked for as they are now, one job writing them all next to filename (out_albedo.png, ...). A PFM
+    // gets the values themselves, the 8-bit formats a picture of them.
+    [[nodiscard]] std::function<void()> aov_job(const std::string& filename, image_file::format format) const {
+        auto pixels = static_cast<size_t>(image_width) * image_height;
+        std::vector<std::function<void()>> jobs;
+        auto add = [&](const char* name, std::vector<float> linear, auto&& picture) {
+            auto aov_filename = with_suffix(filename, std::string("_") + name);
+            if (format == image_file::format::pfm) {
+                jobs.push_back(image_job(aov_filename, format, {}, std::move(linear)));
+                return;
+            }
+            std::vector<unsigned char> rgb(pixels * 3);
+            for (size_t p = 0; p != pixels; ++p) picture(&linear[p * 3], &rgb[p * 3]);
+            jobs.push_back(image_job(aov_filename, format, std::move(rgb), {}));
+        };
+        auto per_pixel = [&](auto&& value) {                               // value(p, float[3])
+            std::vector<float> linear(pixels * 3);
+            for (size_t p = 0; p != pixels; ++p) value(p, &linear[p * 3]);
+            return linear;
+        };
+        auto mean = [&](const float* sums) {
+            return per_pixel([&](size_t p, float* out) {
+                for (int c = 0; c != 3; ++c) out[c] = sums[p * 3 + c] / static_cast<float>(std::max(aov.samples[p], 1u));
+            });
+        };
+        auto gamma = [](const float* value, unsigned char* out) {
+            for (int c = 0; c != 3; ++c)
+                out[c] = static_cast<unsigned char>(std::sqrt(std::clamp(value[c], 0.0f, 0.998f)) * 255.999f);
+        };
+        auto id_color = [](const float* value, unsigned char* out) {       // an arbitrary color for every id
+            auto hash = static_cast<uint32_t>(value[0]) * 2654435761u;
+            hash ^= hash >> 15;
+            for (int c = 0; c != 3; ++c) out[c] = value[0] == 0 ? 0 : static_cast<unsigned char>(hash >> (8 * c));
+        };
+        if (aovs.albedo && aov.albedo) add("albedo", mean(aov.albedo.get()), gamma);
+        if (aovs.emission && aov.emission) add("emission", mean(aov.emission.get()), gamma);
+        if (aovs.normal && aov.normal) {
+            add("normal", per_pixel([&](size_t p, float* out) {
+                const float* n = &aov.normal[p * 3];
+                auto length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int c = 0; c != 3; ++c) out[c] = length > 0 ? n[c] / length : 0.0f;
+            }), [](const float* value, unsigned char* out) {
+                bool none = value[0] == 0 && value[1] == 0 && value[2] == 0;
+                for (int c = 0; c != 3; ++c)
+                    out[c] = none ? 0 : static_cast<unsigned char>((value[c] * 0.5f + 0.5f) * 255.999f);
+            });
+        }
+        if (aovs.depth && aov.depth) {
+            float farthest = 0;
+            auto depth = per_pixel([&](size_t p, float* out) {
+                auto t = aov.hits[p] ? aov.depth[p] / static_cast<float>(aov.hits[p]) : 0.0f;
+                farthest = std::max(farthest, t);
+                out[0] = out[1] = out[2] = t;
+            });
+            add("depth", std::move(depth), [farthest](const float* value, unsigned char* out) {
+                auto gray = value[0] > 0 ? static_cast<unsigned char>((1 - value[0] / farthest) * 223.999f + 32) : 0;
+                out[0] = out[1] = out[2] = gray;                           // the farthest hit is dark gray, not 0
+            });
+        }
+        if (aovs.object_id && aov.object_id) {
+            add("object_id", per_pixel([&](size_t p, float* out) {
+                out[0] = out[1] = out[2] = static_cast<float>(aov.object_id[p]);
+            }), id_color);
+        }
+        if (aovs.material_id && aov.material_id) {
+            add("material_id", per_pixel([&](size_t p, float* out) {
+                out[0] = out[1] = out[2] = static_cast<float>(aov.material_id[p]);
+            }), id_color);
+        }
+        return [jobs = std::move(jobs)] { for (const auto& job: jobs) job(); };
+    }
+
+    // the mean of every pixel, filtered with the first-hit features as guides
+    [[nodiscard]] std::vector<float> denoised_image() {
+        auto pixels = static_cast<size_t>(image_width) * image_height;
+        std::vector<float> means(pixels * 3), albedo(pixels * 3);
+        image_file::to_linear(accumulation.get(), pixel_samples.get(), pixels, means.data());
+        for (size_t i = 0; i != pixels * 3; ++i)
+            albedo[i] = aov.albedo[i] / static_cast<float>(std::max(aov.samples[i / 3], 1u));
+        return denoiser::atrous(image_width, image_height, means.data(), albedo.data(), aov.normal.get(),
+                                pixel_samples.get(), worker_pool(), denoise_settings);
+    }
+
+    // adds the sum of sample_num samples to the pixel; tiles are disjoint, so no two threads share a pixel
+    void buffer_color(const color &pixel_color, unsigned int h, unsigned int w, unsigned int sample_num) {
+        auto pixel_index = h * image_width + w;
+        if (odd_accumulation && pixel_samples[pixel_index] / sample_num % 2 == 1) {        // adaptive, odd pass
+            odd_accumulation[pixel_index * 3] += pixel_color.x();
+            odd_accumulation[pixel_index * 3 + 1] += pixel_color.y();
+            odd_accumulation[pixel_index * 3 + 2] += pixel_color.z();
+            odd_pixel_samples[pixel_index] += sample_num;
+        }
+        accumulation[pixel_index * 3] += pixel_color.x();
+        accumulation[pixel_index * 3 + 1] += pixel_color.y();
+        accumulation[pixel_index * 3 + 2] += pixel_color.z();
+        pixel_samples[pixel_index] += sample_num;
     }
 
 };
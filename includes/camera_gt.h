@@ -145,9 +145,9 @@ class camera_gt {
 
         ray scattered;
         color attenuation;
-//        color color_from_emission = rec.surface_material->emitted(rec.u, rec.v, rec.p);
+//        color color_from_emission = rec.surface_material()->emitted(rec.u, rec.v, rec.p);
 //
-//        if (!rec.surface_material->scatter(r, rec, attenuation, scattered))
+//        if (!rec.surface_material()->scatter(r, rec, attenuation, scattered))
 //            return color_from_emission;
 
         color color_from_scatter = attenuation * ray_color(scattered, depth-1, world);
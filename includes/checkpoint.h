@@ -0,0 +1,95 @@
+#ifndef RAY_TRACING_CHECKPOINT_H
+#define RAY_TRACING_CHECKPOINT_H
+
+#include "mapped_file.h"
+#include "cstdint"
+#include "cstring"
+#include "cstdio"
+#include "string"
+#include "fstream"
+#include "iostream"
+
+// Binary render checkpoint: a fixed header, then the camera's linear accumulation buffer (3 doubles per pixel)
+// and its per-pixel sample counts, exactly as they are in memory. Pixels draw their random numbers from streams
+// keyed by (rng_seed, pixel, sample_count), so the seed and the sample count are all the RNG state there is, and
+// a resumed render continues bit for bit where the checkpoint was taken.
+namespace checkpoint {
+    inline constexpr char magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', '0', '1'};
+
+    struct header {
+        char magic[8];
+        uint32_t width, height;
+        uint32_t sample_count;                                              // samples per pixel of passes so far
+        uint32_t max_depth;
+        uint64_t rng_seed;
+        uint64_t fingerprint;                                               // of the camera and the scene
+    };
+
+    // FNV-1a over the raw bytes of the values that must match for a checkpoint to be resumed
+    class hasher {
+    public:
+        template<typename T>
+        hasher& add(const T& value) {
+            const auto* bytes = reinterpret_cast<const unsigned char*>(&value);
+            for (size_t i = 0; i != sizeof(T); ++i) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+            return *this;
+        }
+        [[nodiscard]] uint64_t value() const { return hash; }
+
+    private:
+        uint64_t hash = 0xcbf29ce484222325ull;
+    };
+
+    // Writes to filename.tmp and renames it over filename, so a crash while writing leaves the previous checkpoint.
+    inline bool write(const std::string& filename, const header& head, const double* accumulation,
+                      const unsigned int* pixel_samples) {
+        auto pixels = static_cast<size_t>(head.width) * head.height;
+        auto temporary = filename + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                std::cout << "[checkpoint]Error occurred while opening " << temporary << std::endl;
+                return false;
+            }
+            file.write(reinterpret_cast<const char*>(&head), sizeof(header));
+            file.write(reinterpret_cast<const char*>(accumulation), static_cast<std::streamsize>(pixels * 3 * sizeof(double)));
+            file.write(reinterpret_cast<const char*>(pixel_samples), static_cast<std::streamsize>(pixels * sizeof(unsigned int)));
+            file.flush();
+            if (!file) {
+                std::cout << "[checkpoint]Error occurred while writing " << temporary << std::endl;
+                return false;
+            }
+        }
+#ifdef _WIN32
+        bool renamed = MoveFileExA(temporary.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+        bool renamed = std::rename(temporary.c_str(), filename.c_str()) == 0;   // atomic on POSIX
+#endif
+        if (!renamed) std::cout << "[checkpoint]Error occurred while renaming " << temporary << std::endl;
+        return renamed;
+    }
+
+    // Maps the file read-only and hands its header and contents to use(), which checks the header and copies out
+    // what it needs before the mapping goes away. Returns false if the file doesn't exist, is too short for its
+    // header, or use() returns false.
+    template<typename Use>
+    bool read(const std::string& filename, Use&& use) {
+        mapped_file file(filename);
+        if (!file.is_open()) return false;
+        const auto* data = reinterpret_cast<const unsigned char*>(file.data);
+        auto size = file.size;
+        bool used = false;
+        header head{};
+        if (size >= sizeof(header)) {
+            std::memcpy(&head, data, sizeof(header));
+            auto pixels = static_cast<size_t>(head.width) * head.height;
+            bool complete = std::memcmp(head.magic, magic, sizeof(magic)) == 0
+                    && size == sizeof(header) + pixels * (3 * sizeof(double) + sizeof(unsigned int));
+            if (!complete) std::cout << "[checkpoint]" << filename << " is not a complete checkpoint." << std::endl;
+            else used = use(head, data + sizeof(header));
+        }
+        return used;
+    }
+}
+
+#endif //RAY_TRACING_CHECKPOINT_H
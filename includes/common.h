@@ -18,11 +18,19 @@
 #include "sphere.h"
 #include "camera.h"
 #include "material.h"
+#include "material_table.h"
 #include "lambertian.h"
 #include "metal.h"
 #include "dielectric.h"
 #include "aabb.h"
+#include "bvh_builder.h"
 #include "bvh_node.h"
+#include "linear_bvh.h"
+#include "bvh4.h"
+#include "light_list.h"
+#include "sphere_set.h"
+#include "triangle_mesh.h"
+#include "obj_file.h"
 #include "texture.h"
 #include "perlin.h"
 #include "quad.h"
@@ -12,14 +12,17 @@
 
 class constant_medium: public hittable {
 public:
-    constant_medium(std::shared_ptr<hittable> boundary, double density,     // boundary, density and isotropic texture
-        const std::shared_ptr<texture::texture_base>& texture): boundary(std::move(boundary)),
-        negative_inv_density(-1/density), phase_function(std::make_shared<material::volume::isotropic>(texture)) {}
-    constant_medium(std::shared_ptr<hittable> boundary, double density,     // boundary, density and isotropic color
-        const color& color): boundary(std::move(boundary)),
-        negative_inv_density(-1/density), phase_function(std::make_shared<material::volume::isotropic>(color)) {}
+    constant_medium(material::material_table& materials, std::shared_ptr<hittable> boundary, double density,
+        const std::shared_ptr<texture::texture_base>& texture): boundary(std::move(boundary)),  // isotropic texture
+        negative_inv_density(-1/density),
+        phase_function(materials.add(std::make_shared<material::volume::isotropic>(texture))) {}
+    constant_medium(material::material_table& materials, std::shared_ptr<hittable> boundary, double density,
+        const color& color): boundary(std::move(boundary)),                 // isotropic color
+        negative_inv_density(-1/density),
+        phase_function(materials.add(std::make_shared<material::volume::isotropic>(color))) {}
 
     [[nodiscard]] bool hit(const ray& r, const interval &inter, hit_record &rec) const override {
+        RAY_TRACING_COUNT_KIND(primitive_hits, "constant_medium");
         hit_record rec1, rec2;
         if (!boundary->hit(r, interval::universe, rec1))
             return false;                                                   // at least hit the boundary
@@ -41,7 +44,8 @@ public:
         rec.p = r.at(rec.t);
         rec.normal = vec3(1,0,0);                               // arbitrary
         rec.front_face = true;                                              // also arbitrary
-        rec.surface_material = phase_function;
+        rec.surface_id = phase_function;
+        rec.object = this;                                                  // complete already
 
         return true;
     }
@@ -50,12 +54,16 @@ public:
         return boundary->bounding_box();
     }
 
+    [[nodiscard]] aabb transformed_bounding_box(const affine_transform& to_world) const override {
+        return boundary->transformed_bounding_box(to_world);
+    }
+
 
 
 private:
     double negative_inv_density;
     std::shared_ptr<hittable> boundary;
-    std::shared_ptr<material::material_base> phase_function;
+    material::material_id phase_function;
 };
 
 #endif //RAY_TRACING_CONSTANT_MEDIUM_H
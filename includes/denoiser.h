@@ -0,0 +1,130 @@
+#ifndef RAY_TRACING_DENOISER_H
+#define RAY_TRACING_DENOISER_H
+
+#include "thread_pool.h"
+#include "algorithm"
+#include "bit"
+#include "cmath"
+#include "cstdint"
+#include "vector"
+
+// Edge-avoiding à-trous wavelet filter (Dammertz et al. 2010). Every iteration is a 5x5 B3-spline blur whose taps
+// are 2^i pixels apart, so five iterations cover a 125 pixel wide footprint with 25 taps each. A tap is weighted
+// down by how far it is from the center in color, normal and albedo, so the blur stops at edges the first hit can
+// see. The color is first divided by the albedo: what is filtered is the lighting, which is smooth across a
+// texture, and the texture is multiplied back in at the end, sharp. Noise shrinks as 1/sqrt(samples), and so does
+// the color distance a tap may have and still count: a pixel with many samples is filtered only where its
+// neighbours agree with it closely.
+namespace denoiser {
+    struct settings {
+        int iterations = 5;
+        float sigma_color = 3;                             // of the gamma-corrected lighting at one sample per
+                                                           // pixel, over sqrt(samples); halved every iteration
+        float sigma_albedo = 0.1;
+    };
+
+    namespace detail {
+        // e^-x for x >= 0, to about 1e-4 and without a call, so that the filter loop vectorizes (AVX2, see
+        // RAY_TRACING_NATIVE). e^-x = 2^-y: 2^-round(y) is put together in the exponent bits, 2^(round(y) - y) is a
+        // polynomial. y is rounded by adding and subtracting 1.5 * 2^23, GCC won't vectorize a float-to-int cast.
+        inline float exp_negative(float x) {
+            float y = std::min(x * 1.442695041f, 126.0f);
+            float shifted = y + 12582912.0f;                               // round(y) in the low mantissa bits
+            float fraction = (shifted - 12582912.0f) - y;                  // in [-0.5, 0.5]
+            float power = 1.0f + fraction * (0.693147f + fraction * (0.240227f + fraction * (0.0555041f
+                    + fraction * 0.00961813f)));
+            return power * std::bit_cast<float>((0x4b400000 + 127 - std::bit_cast<int32_t>(shifted)) << 23);
+        }
+    }
+
+    // color: linear rgb means, albedo: rgb, normal: xyz (any length, 0 where the camera ray missed), 3 floats per
+    // pixel each, rows top first; samples per pixel, or nullptr for 1. Returns the filtered linear rgb.
+    inline std::vector<float> atrous(int width, int height, const float* color, const float* albedo,
+                                     const float* normal, const unsigned int* samples, thread_pool& pool,
+                                     const settings& setting = {}) {
+        auto pixels = static_cast<size_t>(width) * height;
+        // one plane per channel, so that one tap over a whole row is one vector loop. Normals get a fourth component, 1 for
+        // a miss, which makes misses a surface of their own: dot products are 1 among them and 0 with any hit.
+        std::vector<float> lighting[3], filtered[3], gamma[3], guide_albedo[3], guide_normal[4];
+        for (int c = 0; c != 3; ++c) {
+            lighting[c].resize(pixels), filtered[c].resize(pixels), gamma[c].resize(pixels);
+            guide_albedo[c].resize(pixels);
+        }
+        for (auto& plane: guide_normal) plane.resize(pixels);
+        std::vector<float> color_falloff(pixels);
+        for (size_t p = 0; p != pixels; ++p) {
+            for (int c = 0; c != 3; ++c) {
+                guide_albedo[c][p] = albedo[p * 3 + c];
+                lighting[c][p] = color[p * 3 + c] / (albedo[p * 3 + c] > 0.01f ? albedo[p * 3 + c] : 1.0f);
+            }                                                              // black and missing albedo: keep color
+            auto length = std::sqrt(normal[p * 3] * normal[p * 3] + normal[p * 3 + 1] * normal[p * 3 + 1]
+                                    + normal[p * 3 + 2] * normal[p * 3 + 2]);
+            for (int c = 0; c != 3; ++c) guide_normal[c][p] = length > 0 ? normal[p * 3 + c] / length : 0.0f;
+            guide_normal[3][p] = length > 0 ? 0.0f : 1.0f;
+            color_falloff[p] = (samples ? static_cast<float>(std::max(samples[p], 1u)) : 1.0f)   // 1 / sigma^2,
+                    / (setting.sigma_color * setting.sigma_color);                                // ~ samples
+        }
+
+        static constexpr float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+        auto albedo_falloff = 1.0f / (setting.sigma_albedo * setting.sigma_albedo);
+        for (int iteration = 0; iteration != setting.iterations; ++iteration) {
+            int step = 1 << iteration;
+            auto narrowing = static_cast<float>(1 << (2 * iteration));      // sigma halves every iteration
+            for (int c = 0; c != 3; ++c)
+                for (size_t p = 0; p != pixels; ++p) gamma[c][p] = std::sqrt(std::max(lighting[c][p], 0.0f));
+            pool.parallel_for(height, [&](size_t row) {                    // every task writes one row
+                int y = static_cast<int>(row);
+                auto start = static_cast<size_t>(y) * width;
+                std::vector<float> sums(static_cast<size_t>(width) * 4);   // r, g, b and the total weight
+                float *sr = sums.data(), *sg = sr + width, *sb = sg + width, *total = sb + width;
+                for (int j = -2; j <= 2; ++j) {
+                    int qy = y + j * step;
+                    if (qy < 0 || qy >= height) continue;
+                    for (int i = -2; i <= 2; ++i) {
+                        int offset = (qy - y) * width + i * step;
+                        int x0 = std::max(0, -i * step), x1 = std::min(width, width - i * step);
+                        float tap = kernel[i + 2] * kernel[j + 2];
+                        const float *gr = gamma[0].data() + start, *gg = gamma[1].data() + start,
+                                *gb = gamma[2].data() + start, *ar = guide_albedo[0].data() + start,
+                                *ag = guide_albedo[1].data() + start, *ab = guide_albedo[2].data() + start,
+                                *nx = guide_normal[0].data() + start, *ny = guide_normal[1].data() + start,
+                                *nz = guide_normal[2].data() + start, *nw = guide_normal[3].data() + start,
+                                *lr = lighting[0].data() + start, *lg = lighting[1].data() + start,
+                                *lb = lighting[2].data() + start, *falloff = color_falloff.data() + start;
+#pragma omp simd
+                        for (int x = x0; x < x1; ++x) {
+                            int q = x + offset;
+                            float weight = std::max(nx[x] * nx[q] + ny[x] * ny[q] + nz[x] * nz[q] + nw[x] * nw[q], 0.0f);
+                            weight *= weight, weight *= weight, weight *= weight, weight *= weight;
+                            weight *= weight, weight *= weight, weight *= weight;           // dot^128
+                            float color_distance = (gr[q] - gr[x]) * (gr[q] - gr[x]) + (gg[q] - gg[x]) * (gg[q] - gg[x])
+                                    + (gb[q] - gb[x]) * (gb[q] - gb[x]);
+                            float albedo_distance = (ar[q] - ar[x]) * (ar[q] - ar[x])
+                                    + (ag[q] - ag[x]) * (ag[q] - ag[x]) + (ab[q] - ab[x]) * (ab[q] - ab[x]);
+                            weight *= tap * detail::exp_negative(color_distance * falloff[x] * narrowing
+                                                                 + albedo_distance * albedo_falloff);
+                            sr[x] += weight * lr[q];
+                            sg[x] += weight * lg[q];
+                            sb[x] += weight * lb[q];
+                            total[x] += weight;
+                        }
+                    }
+                }
+                for (int x = 0; x != width; ++x) {                         // the center always counts
+                    filtered[0][start + x] = sr[x] / total[x];
+                    filtered[1][start + x] = sg[x] / total[x];
+                    filtered[2][start + x] = sb[x] / total[x];
+                }
+            });
+            for (int c = 0; c != 3; ++c) lighting[c].swap(filtered[c]);
+        }
+
+        std::vector<float> result(pixels * 3);
+        for (size_t p = 0; p != pixels; ++p)
+            for (int c = 0; c != 3; ++c)
+                result[p * 3 + c] = lighting[c][p] * (albedo[p * 3 + c] > 0.01f ? albedo[p * 3 + c] : 1.0f);
+        return result;
+    }
+}
+
+#endif //RAY_TRACING_DENOISER_H
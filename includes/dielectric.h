@@ -13,14 +13,15 @@
 namespace material {
     class dielectric : public material::material_base {
     public:
-        explicit dielectric(double refract_coeff): refract_coeff(refract_coeff) {}
+        explicit dielectric(real refract_coeff): refract_coeff(refract_coeff) {}
 
         // TODO: pdf
-        bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, double& pdf) const override {
+        bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, real& pdf) const override {
+            RAY_TRACING_COUNT_KIND(scatters, "dielectric");
             attenuation = color{1.0, 1.0, 1.0};                                 // full pass glass
-            double refract_ratio = rec.front_face ? (1.0 / refract_coeff) : refract_coeff; // air to glass or vice versa
-            double cos_theta = fmin(dot(-in.direction(), rec.normal), 1.0);
-            double sin_theta = std::sqrt(1 - cos_theta * cos_theta);
+            real refract_ratio = rec.front_face ? (1.0 / refract_coeff) : refract_coeff; // air to glass or vice versa
+            real cos_theta = std::fmin(dot(-in.direction(), rec.normal), real(1.0));
+            real sin_theta = std::sqrt(1 - cos_theta * cos_theta);
             vec3 scatter_direction;
             point3 scatter_origin = rec.p;
             bool cannot_refract = refract_ratio * sin_theta > 1.0;                          // that will make sin_theta' > 1
@@ -35,8 +36,8 @@ namespace material {
         }
 
     private:
-        double refract_coeff;
-        static inline double reflectance(double cosine, double ref_idx) {
+        real refract_coeff;
+        static inline real reflectance(real cosine, real ref_idx) {
             auto r0 = (1-ref_idx) / (1+ref_idx);                                    // Schlick's approximation
             r0 = r0*r0;                                                                     // I copied the whole thing
             return r0 + (1-r0)*pow((1 - cosine),5);                                   // No idea how it works
@@ -6,22 +6,26 @@
 #define RAY_TRACING_HITTABLE_H
 
 #include "ray.h"
+#include "ray_packet.h"
 #include "utilities.h"
 #include "interval.h"
 #include "aabb.h"
+#include "affine_transform.h"
+#include "material_table.h"
+#include "vector"
 
-namespace material {
-    class material_base;
-}
+class hittable;
 
 class hit_record {
 public:
     point3 p;
     vec3 normal;
-    double t{};
-    double u{}, v{};
-    std::shared_ptr<material::material_base> surface_material;
+    real t{};
+    real u{}, v{};
+    material::material_id surface_id{};                                 // into the world's material table
     bool front_face{};
+    const hittable* object{};                                           // finishes the record, nullptr when done
+    uint32_t primitive_id{};                                            // which of object's primitives was hit
 
     hit_record() = default;
     hit_record(const hit_record& another) = default;
@@ -31,9 +35,11 @@ public:
         normal = another.normal;
         t = another.t;
         front_face = another.front_face;
-        surface_material = another.surface_material;
+        surface_id = another.surface_id;
         u = another.u;
         v = another.v;
+        object = another.object;
+        primitive_id = another.primitive_id;
     }
     hit_record& operator = (const hit_record& another) {
         if (this == &another) return *this;
@@ -41,12 +47,17 @@ public:
         normal = another.normal;
         t = another.t;
         front_face = another.front_face;
-        surface_material = another.surface_material;
+        surface_id = another.surface_id;
         u = another.u;
         v = another.v;
+        object = another.object;
+        primitive_id = another.primitive_id;
         return *this;
     }
 
+    // fills in what the closest hit's primitive left out, see hittable::compute_surface
+    inline void compute_surface(const ray& r);
+
     inline void set_face_normal(const ray& r, const vec3& outward_normal) {
         // outward_normal should have length 1
         front_face = dot(r.direction(), outward_normal) < 0;
@@ -59,6 +70,52 @@ public:
     virtual ~hittable() = default;
     virtual bool hit(const ray& r, const interval &inter, hit_record &rec) const = 0;       // pure-virtual function
     [[nodiscard]] virtual aabb bounding_box() const = 0;                                    // pure-virtual function
+
+    // Bounds of this object moved by to_world, for transform_instance: primitives bound their transformed
+    // geometry, containers pass it on to what they hold, anything else transforms bounding_box(), which is only
+    // tight for boxes.
+    [[nodiscard]] virtual aabb transformed_bounding_box(const affine_transform& to_world) const {
+        return to_world.box(bounding_box());
+    }
+
+    // Intersection is split in two: hit() only has to record t (u, v may hold barycentrics), point rec.object at
+    // itself and say which primitive it was; the point, normal, uv and material are left to compute_surface, which
+    // runs once on the closest hit instead of on every closer candidate found along the way. A hit() that fills
+    // the whole record itself (instances, media) points rec.object at itself too, and leaves this one empty.
+    virtual void compute_surface(const ray& r, hit_record& rec) const {}
+
+    // Appends what a hit can point rec.object at: containers pass it on to what they hold, anything else is one
+    // object. The order is fixed by the scene, so an index into it names an object (camera::aov_outputs).
+    virtual void gather_primitives(std::vector<const hittable*>& primitives) const { primitives.push_back(this); }
+
+    // Light sampling (see light_list). gather_lights appends the primitives with an emissive material, containers
+    // pass it on to what they hold. A light's random() is a direction from origin towards a random point of it,
+    // pdf_value() the solid-angle density random() has for a direction, 0 where the direction misses it.
+    virtual void gather_lights(std::vector<const hittable*>& lights) const {}
+    [[nodiscard]] virtual real pdf_value(const point3& origin, const vec3& direction) const { return 0; }
+    [[nodiscard]] virtual vec3 random(const point3& origin) const { return {1, 0, 0}; }
+
+    // Closest hit for the `active` lanes of a packet: a lane's record and t_max are updated only where a closer
+    // hit is found, and those lanes are returned. Accelerators and simple primitives override this with
+    // all-lanes-at-once versions, everything else traces the lanes one by one.
+    virtual uint32_t hit_packet(ray_packet& packet, uint32_t active, hit_record* records) const {
+        uint32_t hits = 0;
+        for (int i = 0; i != packet.size; ++i) {
+            if (!(active & (1u << i))) continue;
+            if (hit(packet.rays[i], interval(packet.t_min[i], packet.t_max[i]), records[i])) {
+                packet.t_max[i] = records[i].t;
+                hits |= 1u << i;
+            }
+        }
+        return hits;
+    }
 };
 
+inline void hit_record::compute_surface(const ray& r) {
+    if (object == nullptr) return;
+    auto deferred = object;
+    object = nullptr;
+    deferred->compute_surface(r, *this);
+}
+
 #endif //RAY_TRACING_HITTABLE_H
@@ -26,6 +26,19 @@ public:
         objects.emplace_back(std::move(object));
     }
 
+    // Replaces the objects with one that holds them, a BVH over the list, keeping the material table they were
+    // built with.
+    void wrap(std::shared_ptr<hittable> object) {
+        objects.clear();
+        bbox = aabb();
+        add(std::move(object));
+    }
+
+    // The materials of the scene this list is the world of: its primitives are built with this table, and the
+    // camera looks their hits' ids up in it. Copies of the list share the table; nested lists are built with
+    // their world's table, their own goes unused.
+    [[nodiscard]] material::material_table& materials() const { return *table; }
+
     bool hit(const ray& r, const interval &inter, hit_record &rec) const override {
         hit_record temp_rec;
         interval temp_interval(inter);
@@ -43,12 +56,45 @@ public:
         return hit_any;
     }
 
+    uint32_t hit_packet(ray_packet& packet, uint32_t active, hit_record* records) const override {
+        uint32_t hits = 0;                                                   // every object only ever shortens
+        for (const auto& object: objects)                                    // the lanes' t_max
+            hits |= object->hit_packet(packet, active, records);
+        return hits;
+    }
+
     [[nodiscard]] aabb bounding_box() const override {
         return bbox;
     }
 
+    [[nodiscard]] aabb transformed_bounding_box(const affine_transform& to_world) const override {
+        aabb bounds;
+        for (const auto& object: objects) bounds = aabb(bounds, object->transformed_bounding_box(to_world));
+        return bounds;
+    }
+
+    void gather_lights(std::vector<const hittable*>& lights) const override {
+        for (const auto& object: objects) object->gather_lights(lights);
+    }
+
+    void gather_primitives(std::vector<const hittable*>& primitives) const override {
+        for (const auto& object: objects) object->gather_primitives(primitives);
+    }
+
+    // Appends every object to flat, opening up nested lists: a nested list hits exactly like its objects, so
+    // acceleration structures can see all of them.
+    void flatten(std::vector<std::shared_ptr<hittable>>& flat) const {
+        for (const auto& object: objects) {
+            if (auto list = std::dynamic_pointer_cast<hittable_list>(object))
+                list->flatten(flat);
+            else
+                flat.push_back(object);
+        }
+    }
+
 private:
     aabb bbox;
+    std::shared_ptr<material::material_table> table = std::make_shared<material::material_table>();
 };
 
 #endif //RAY_TRACING_HITTABLE_LIST_H
@@ -0,0 +1,271 @@
+#ifndef RAY_TRACING_IMAGE_FILE_H
+#define RAY_TRACING_IMAGE_FILE_H
+
+#include "algorithm"
+#include "array"
+#include "cmath"
+#include "condition_variable"
+#include "cstdint"
+#include "cstring"
+#include "deque"
+#include "fstream"
+#include "functional"
+#include "iostream"
+#include "mutex"
+#include "string"
+#include "thread"
+#include "vector"
+
+// Writers for the camera's images. Pixels come as 8-bit rgb rows, top row first, from to_display(), or as linear
+// float rgb from to_linear() for PFM. Errors are printed and reported by returning false, like the rest of the
+// camera's output.
+namespace image_file {
+    enum class format {
+        automatic,                                         // by extension: .pfm, .png, anything else binary ppm
+        ppm_text,                                          // P3, what the camera always wrote before
+        ppm_binary,                                        // P6
+        pfm,                                               // linear floats, no tonemapping
+        png                                                // 8-bit rgb, uncompressed deflate
+    };
+
+    inline format format_of(const std::string& filename, format requested = format::automatic) {
+        if (requested != format::automatic) return requested;
+        auto dot = filename.find_last_of('.');
+        auto extension = dot == std::string::npos ? std::string() : filename.substr(dot);
+        if (extension == ".pfm") return format::pfm;
+        if (extension == ".png") return format::png;
+        return format::ppm_binary;
+    }
+
+    // Average of each pixel's samples, gamma-corrected for gamma=2.0 and quantized to [0, depth]; without
+    // pixel_samples, accumulation already holds the averages (a denoised image, in floats). Runs a block of
+    // pixels at a time through a loop with no branches and no calls, which the compiler turns into vector code
+    // (AVX2, see RAY_TRACING_NATIVE): the clamp is min/max, and it comes before the square root so that, with
+    // -fno-math-errno, sqrt is a single instruction. The bytes are packed in a second, also vectorized, loop.
+    template<typename Sum>
+    void to_display(const Sum* accumulation, const unsigned int* pixel_samples, size_t pixels,
+                    unsigned char* out, unsigned int depth = 255) {
+        constexpr size_t block = 256;
+        static const auto ones = [] { std::array<unsigned int, block> one{}; one.fill(1); return one; }();
+        const double coefficient = depth + 0.999;
+        int values[block * 3];
+        for (size_t start = 0; start < pixels; start += block) {
+            auto count = std::min(block, pixels - start);
+            const Sum* sums = accumulation + start * 3;
+            const unsigned int* samples = pixel_samples ? pixel_samples + start : ones.data();
+#pragma omp simd
+            for (size_t p = 0; p < count; ++p) {
+                double scale = 1.0 / static_cast<int>(samples[p] + (samples[p] == 0));     // the sum is 0 then
+                for (int c = 0; c != 3; ++c) {
+                    double value = std::min(std::max(0.0, sums[p * 3 + c] * scale), 0.999 * 0.999);
+                    values[p * 3 + c] = static_cast<int>(std::sqrt(value) * coefficient);
+                }
+            }
+            for (size_t i = 0; i != count * 3; ++i) out[start * 3 + i] = static_cast<unsigned char>(values[i]);
+        }
+    }
+
+    inline void to_linear(const double* accumulation, const unsigned int* pixel_samples, size_t pixels, float* out) {
+#pragma omp simd
+        for (size_t p = 0; p < pixels; ++p) {
+            double samples = pixel_samples[p] == 0 ? 1.0 : static_cast<double>(pixel_samples[p]);
+            for (int c = 0; c != 3; ++c)
+                out[p * 3 + c] = static_cast<float>(accumulation[p * 3 + c] / samples);
+        }
+    }
+
+    inline void write_ppm_text(std::ostream& out, int width, int height, const unsigned char* rgb,
+                               unsigned int depth = 255) {
+        std::string text = "P3\n" + std::to_string(width) + ' ' + std::to_string(height) + '\n'
+                + std::to_string(depth) + '\n';
+        text.reserve(text.size() + static_cast<size_t>(width) * height * 12);
+        char number[4];
+        for (size_t i = 0, n = static_cast<size_t>(width) * height * 3; i != n; ++i) {
+            int length = 0, value = rgb[i];                                 // at most three digits
+            if (value >= 100) number[length++] = static_cast<char>('0' + value / 100);
+            if (value >= 10) number[length++] = static_cast<char>('0' + value / 10 % 10);
+            number[length++] = static_cast<char>('0' + value % 10);
+            text.append(number, length);
+            text += i % 3 == 2 ? '\n' : ' ';
+        }
+        text += '\n';
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        out.flush();
+    }
+
+    namespace detail {
+        inline bool open(std::ofstream& file, const std::string& filename) {
+            file.open(filename, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) std::cout << "[image_file]Error occurred while opening " << filename << std::endl;
+            return file.is_open();
+        }
+
+        inline bool close(std::ofstream& file, const std::string& filename) {
+            file.close();
+            if (file.fail()) std::cout << "[image_file]Error occurred while writing " << filename << std::endl;
+            return !file.fail();
+        }
+
+        inline uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0) {
+            static const auto table = [] {
+                std::array<uint32_t, 256> entries{};
+                for (uint32_t n = 0; n != 256; ++n) {
+                    uint32_t c = n;
+                    for (int k = 0; k != 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    entries[n] = c;
+                }
+                return entries;
+            }();
+            crc = ~crc;
+            for (size_t i = 0; i != size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            return ~crc;
+        }
+
+        inline void put32(std::vector<unsigned char>& out, uint32_t value) {           // big endian
+            for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<unsigned char>(value >> shift));
+        }
+
+        inline void chunk(std::ofstream& file, const char* type, const std::vector<unsigned char>& data) {
+            std::vector<unsigned char> framed;
+            framed.reserve(data.size() + 12);
+            put32(framed, static_cast<uint32_t>(data.size()));
+            framed.insert(framed.end(), type, type + 4);
+            framed.insert(framed.end(), data.begin(), data.end());
+            put32(framed, crc32(framed.data() + 4, data.size() + 4));       // over type and data
+            file.write(reinterpret_cast<const char*>(framed.data()), static_cast<std::streamsize>(framed.size()));
+        }
+    }
+
+    inline bool write_ppm_text(const std::string& filename, int width, int height, const unsigned char* rgb,
+                               unsigned int depth = 255) {
+        std::ofstream file;
+        if (!detail::open(file, filename)) return false;
+        write_ppm_text(file, width, height, rgb, depth);
+        return detail::close(file, filename);
+    }
+
+    inline bool write_ppm_binary(const std::string& filename, int width, int height, const unsigned char* rgb,
+                                 unsigned int depth = 255) {
+        std::ofstream file;
+        if (!detail::open(file, filename)) return false;
+        file << "P6\n" << width << ' ' << height << '\n' << depth << '\n';
+        file.write(reinterpret_cast<const char*>(rgb), static_cast<std::streamsize>(width) * height * 3);
+        return detail::close(file, filename);
+    }
+
+    // Portable float map: rows bottom to top, a negative scale for little-endian floats.
+    inline bool write_pfm(const std::string& filename, int width, int height, const float* rgb) {
+        std::ofstream file;
+        if (!detail::open(file, filename)) return false;
+        file << "PF\n" << width << ' ' << height << "\n-1.0\n";
+        for (int row = height - 1; row >= 0; --row)
+            file.write(reinterpret_cast<const char*>(rgb + static_cast<size_t>(row) * width * 3),
+                       static_cast<std::streamsize>(width) * 3 * sizeof(float));
+        return detail::close(file, filename);
+    }
+
+    // 8-bit rgb PNG. The image data is a zlib stream of stored (uncompressed) deflate blocks: every decoder reads
+    // it, it needs no compression library, and costs one CRC and one Adler-32 pass over the pixels.
+    inline bool write_png(const std::string& filename, int width, int height, const unsigned char* rgb) {
+        std::ofstream file;
+        if (!detail::open(file, filename)) return false;
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+        std::vector<unsigned char> header;
+        detail::put32(header, width);
+        detail::put32(header, height);
+        header.insert(header.end(), {8, 2, 0, 0, 0});                      // 8 bits, rgb, deflate, no filter, no interlace
+        detail::chunk(file, "IHDR", header);
+
+        auto row_size = static_cast<size_t>(width) * 3;
+        std::vector<unsigned char> raw;                                     // every row starts with filter type 0
+        raw.reserve((row_size + 1) * height);
+        for (int row = 0; row != height; ++row) {
+            raw.push_back(0);
+            raw.insert(raw.end(), rgb + row * row_size, rgb + (row + 1) * row_size);
+        }
+        std::vector<unsigned char> zlib = {0x78, 0x01};
+        zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        bool last = false;
+        for (size_t offset = 0; !last; ) {
+            auto length = std::min<size_t>(65535, raw.size() - offset);
+            last = offset + length == raw.size();
+            zlib.insert(zlib.end(), {static_cast<unsigned char>(last), static_cast<unsigned char>(length),
+                                     static_cast<unsigned char>(length >> 8), static_cast<unsigned char>(~length),
+                                     static_cast<unsigned char>(~length >> 8)});
+            zlib.insert(zlib.end(), raw.begin() + static_cast<std::ptrdiff_t>(offset),
+                        raw.begin() + static_cast<std::ptrdiff_t>(offset + length));
+            offset += length;
+        }
+        uint32_t a = 1, b = 0;                                              // adler-32, reduced every 5552 bytes
+        for (size_t i = 0; i < raw.size(); ) {
+            for (size_t end = std::min(raw.size(), i + 5552); i != end; ++i) b += a += raw[i];
+            a %= 65521;
+            b %= 65521;
+        }
+        detail::put32(zlib, (b << 16) | a);
+        detail::chunk(file, "IDAT", zlib);
+        detail::chunk(file, "IEND", {});
+        return detail::close(file, filename);
+    }
+
+    // One background thread that runs writes in the order they were queued. The caller snapshots what it wants
+    // written into the job, so it can go on changing its buffers while the file is encoded and written.
+    class writer_thread {
+    public:
+        writer_thread() = default;
+        writer_thread(const writer_thread&) = delete;
+        writer_thread& operator=(const writer_thread&) = delete;
+
+        ~writer_thread() {
+            wait();
+            {
+                std::lock_guard<std::mutex> lock(m);
+                stopping = true;
+            }
+            changed.notify_all();
+            if (worker.joinable()) worker.join();
+        }
+
+        void submit(std::function<void()> job) {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                jobs.emplace_back(std::move(job));
+                if (!worker.joinable()) worker = std::thread([this] { run(); });
+            }
+            changed.notify_all();
+        }
+
+        void wait() {                                                       // until every queued write is done
+            std::unique_lock<std::mutex> lock(m);
+            changed.wait(lock, [this] { return jobs.empty() && !busy; });
+        }
+
+    private:
+        void run() {
+            std::unique_lock<std::mutex> lock(m);
+            while (true) {
+                changed.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;                                   // stopping, nothing left
+                auto job = std::move(jobs.front());
+                jobs.pop_front();
+                busy = true;
+                lock.unlock();
+                job();
+                lock.lock();
+                busy = false;
+                changed.notify_all();
+            }
+        }
+
+        std::mutex m;
+        std::condition_variable changed;
+        std::deque<std::function<void()>> jobs;
+        bool busy = false;
+        bool stopping = false;
+        std::thread worker;
+    };
+}
+
+#endif //RAY_TRACING_IMAGE_FILE_H
@@ -10,10 +10,12 @@
 #include "material.h"
 #include "sphere.h"
 #include "quad.h"
+#include "affine_transform.h"
+#include "iostream"
 
 namespace instance {
-    inline std::shared_ptr<hittable_list> box
-                                (const point3& a, const point3& b, const std::shared_ptr<material::material_base>& mat) {
+    inline std::shared_ptr<hittable_list> box(material::material_table& materials, const point3& a, const point3& b,
+                                              const std::shared_ptr<material::material_base>& mat) {
         // Returns the 3D box (six sides) that contains the two opposite vertices a & b.
 
         auto sides = std::make_shared<hittable_list>();
@@ -26,30 +28,50 @@ namespace instance {
         auto dy = vec3(0, max.y() - min.y(), 0);
         auto dz = vec3(0, 0, max.z() - min.z());
 
-        sides->add(make_shared<primitive::quad>(point3(min.x(), min.y(), max.z()),  dx,  dy, mat)); // front
-        sides->add(make_shared<primitive::quad>(point3(max.x(), min.y(), max.z()), -dz,  dy, mat)); // right
-        sides->add(make_shared<primitive::quad>(point3(max.x(), min.y(), min.z()), -dx,  dy, mat)); // back
-        sides->add(make_shared<primitive::quad>(point3(min.x(), min.y(), min.z()),  dz,  dy, mat)); // left
-        sides->add(make_shared<primitive::quad>(point3(min.x(), max.y(), max.z()),  dx, -dz, mat)); // top
-        sides->add(make_shared<primitive::quad>(point3(min.x(), min.y(), min.z()),  dx,  dz, mat)); // bottom
+        sides->add(make_shared<primitive::quad>(materials, point3(min.x(), min.y(), max.z()),  dx,  dy, mat)); // front
+        sides->add(make_shared<primitive::quad>(materials, point3(max.x(), min.y(), max.z()), -dz,  dy, mat)); // right
+        sides->add(make_shared<primitive::quad>(materials, point3(max.x(), min.y(), min.z()), -dx,  dy, mat)); // back
+        sides->add(make_shared<primitive::quad>(materials, point3(min.x(), min.y(), min.z()),  dz,  dy, mat)); // left
+        sides->add(make_shared<primitive::quad>(materials, point3(min.x(), max.y(), max.z()),  dx, -dz, mat)); // top
+        sides->add(make_shared<primitive::quad>(materials, point3(min.x(), min.y(), min.z()),  dx,  dz, mat)); // bottom
 
         return sides;
     }
 
 
-    class translate : public hittable {
+    // Any affine transform of an object: rays are carried into object space by the inverse matrix (keeping t, the
+    // direction isn't renormalized), hits back by the matrix. Instancing an instance doesn't nest: the matrices are
+    // multiplied here and the new instance holds the innermost object, so translate(rotate_y(x)) transforms a ray
+    // once. The bounds are those of the transformed geometry (see hittable::transformed_bounding_box), not the box
+    // around the transformed bounding box.
+    class transform_instance : public hittable {
     public:
-        translate(std::shared_ptr<hittable> object, vec3 displacement):
-                                        object(std::move(object)), offset(std::move(displacement)) {
-            bbox = this->object->bounding_box() + offset;
+        transform_instance(std::shared_ptr<hittable> object, const affine_transform& to_world) {
+            if (auto inner = std::dynamic_pointer_cast<transform_instance>(object)) {
+                this->to_world = to_world * inner->to_world;
+                this->object = inner->object;
+            } else {
+                this->to_world = to_world;
+                this->object = std::move(object);
+            }
+            if (this->to_world.determinant() == 0)
+                std::cout << "[transform_instance]Warning: the transform is singular, nothing will be hit" << std::endl;
+            to_object = this->to_world.inverse();
+            bbox = this->object->transformed_bounding_box(this->to_world).pad();
         }
 
         bool hit(const ray& r, const interval &inter, hit_record &rec) const override {
-            ray offset_r(r.origin() - offset, r.direction(), r.time());     // move ray instead of obj
-
-            if (!object->hit(offset_r, inter, rec))
+            RAY_TRACING_COUNT_KIND(primitive_hits, "transform_instance");
+            if (!bbox.hit(r, inter)) return false;                                       // before moving the ray
+            ray local{point3(to_object.point(point3d(r.origin()))), vec3(to_object.vector(vec3d(r.direction()))),
+                      r.time(), ray::keep_direction};                                    // same t in both spaces
+            if (!object->hit(local, inter, rec))
                 return false;
-            rec.p += offset;                                                                  // if hit, move rec.p
+            rec.compute_surface(local);                                     // needs the object space ray, so
+                                                                            // not deferred past the instance
+            rec.p = r.at(rec.t);
+            rec.normal = vec3(normalize(to_object.transposed_vector(vec3d(rec.normal))));  // keeps front_face
+            rec.object = this;                                              // complete, the instance was hit
             return true;
         }
 
@@ -57,80 +79,29 @@ namespace instance {
             return bbox;
         }
 
+        [[nodiscard]] aabb transformed_bounding_box(const affine_transform& outer) const override {
+            return object->transformed_bounding_box(outer * to_world);
+        }
+
+        [[nodiscard]] const affine_transform& object_to_world() const { return to_world; }
+
     private:
         std::shared_ptr<hittable> object;
-        vec3 offset;
+        affine_transform to_world;
+        affine_transform to_object;                                         // the inverse
         aabb bbox;
     };
 
-    class rotate_y : public hittable {
+    class translate : public transform_instance {
     public:
+        translate(std::shared_ptr<hittable> object, const vec3& displacement):
+                transform_instance(std::move(object), affine_transform::translation(vec3d(displacement))) {}
+    };
 
-        rotate_y(std::shared_ptr<hittable> object, double degree): object(std::move(object)) {
-            auto radians = utilities::degree_to_radian(degree);
-            sin_theta = sin(radians);
-            cos_theta = cos(radians);
-            bbox = this->object->bounding_box();                                             // copy construct
-            point3 min(utilities::infinity);                                             // auto broadcast
-            point3 max(-utilities::infinity);
-
-            for (int i = 0; i < 2; i++) {                                                    // For every combination of
-                for (int j = 0; j < 2; j++) {                                                // min, max of the original
-                    for (int k = 0; k < 2; k++) {                                            // bbox, rotate and then
-                        auto x = i*bbox.x.max + (1-i)*bbox.x.min;                    // store the value that will
-                        auto y = j*bbox.y.max + (1-j)*bbox.y.min;                    // expand the bbox to the
-                        auto z = k*bbox.z.max + (1-k)*bbox.z.min;                    // largest.
-
-                        auto newx =  cos_theta*x + sin_theta*z;
-                        auto newz = -sin_theta*x + cos_theta*z;
-
-                        vec3 tester(newx, y, newz);
-
-                        for (int c = 0; c < 3; c++) {
-                            min[c] = fmin(min[c], tester[c]);
-                            max[c] = fmax(max[c], tester[c]);
-                        }
-                    }
-                }
-            }
-            bbox = aabb{min, max};
-        }
-
-        bool hit(const ray& r, const interval &inter, hit_record &rec) const override {
-            auto origin = r.origin();                                                // pipeline: w->o->w
-            auto direction = r.direction();                                           // first world to object
-
-            origin.x() = cos_theta * r.origin().x() - sin_theta * r.origin().z();           // x'=cos*x-sin*z
-            origin.z() = sin_theta * r.origin().x() + cos_theta * r.origin().z();           // z'=sin*x+cos*z
-
-            direction.x() = cos_theta * r.direction().x() - sin_theta * r.direction().z();  // same as ray origin
-            direction.z() = sin_theta * r.direction().x() + cos_theta * r.direction().z();
-
-            ray rotated_ray{origin, direction, r.time()};
-            if (!object->hit(rotated_ray, inter, rec))
-                return false;                                                               // test for object hit
-
-            auto p = rec.p;                                                          // now object to world
-            p.x() = cos_theta * p.x() + sin_theta * p.z();                                  // x'=cos*x+sin*z
-            p.z() = -sin_theta * p.x() + cos_theta * p.z();                                 // z'=sin*x+cos*z
-            auto normal = rec.normal;
-            normal.x() = cos_theta * normal.x() + sin_theta * normal.z();                   // same for hit surface n
-            normal.z() = -sin_theta * normal.x() + cos_theta * normal.z();
-
-            rec.p = p;
-            rec.normal = normal;
-            return true;
-        }
-
-        [[nodiscard]] aabb bounding_box() const override {
-            return bbox;
-        }
-
-    private:
-        std::shared_ptr<hittable> object;
-        double cos_theta;
-        double sin_theta;
-        aabb bbox;
+    class rotate_y : public transform_instance {
+    public:
+        rotate_y(std::shared_ptr<hittable> object, double degree):
+                transform_instance(std::move(object), affine_transform::rotation(vec3d(0, 1, 0), degree)) {}
     };
 }
 
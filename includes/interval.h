@@ -3,45 +3,62 @@
 
 #include "common.h"
 #include "utilities.h"
+#include "scalar.h"
+#include "limits"
+#include "type_traits"
 
-class interval {
+template<typename T>
+class basic_interval {
 public:
-    double min, max;
-    interval(): min(+utilities::infinity), max(-utilities::infinity) {}         // default interval is empty
-    interval(double min_, double max_): min(min_), max(max_) {}                 // constructor below merges two interval
-    interval(const interval& i1, const interval& i2): min(fmin(i1.min, i2.min)), max(fmax(i1.max, i2.max)) {}
+    T min, max;
+    basic_interval(): min(+infinity()), max(-infinity()) {}                    // default interval is empty
+    basic_interval(T min_, T max_): min(min_), max(max_) {}                    // constructor below merges two interval
+    template<typename A, typename B, typename = std::enable_if_t<std::is_arithmetic_v<A> && std::is_arithmetic_v<B>
+                                                                 && !(std::is_same_v<A, T> && std::is_same_v<B, T>)>>
+    basic_interval(A min_, B max_): min(static_cast<T>(min_)), max(static_cast<T>(max_)) {}  // e.g. double bounds
+    basic_interval(const basic_interval& i1, const basic_interval& i2):        // plain compares, fmin/fmax are
+            min(i1.min <= i2.min ? i1.min : i2.min), max(i1.max >= i2.max ? i1.max : i2.max) {}  // library calls
 
-    [[nodiscard]] inline bool contains(double val) const {
+    [[nodiscard]] inline bool contains(T val) const {
         return min <= val && val <= max;
     }
-    [[nodiscard]] inline bool surrounds(double val) const {
+    [[nodiscard]] inline bool surrounds(T val) const {
         return min < val && val < max;
     }
-    [[nodiscard]] inline double clamp(double val) const {
+    [[nodiscard]] inline T clamp(T val) const {
         if (val < min) return min;
         if (val > max) return max;
         return val;
     }
-    [[nodiscard]] inline double size() const {
+    [[nodiscard]] inline T size() const {
         return max - min;
     }
-    [[nodiscard]] inline interval expand(double delta) const {
+    [[nodiscard]] inline basic_interval expand(T delta) const {
         auto padding = delta / 2;
         return {min - padding, max + padding};
     }
-    static const interval empty;
-    static const interval universe;
+    static const basic_interval empty;
+    static const basic_interval universe;
+
+private:
+    static constexpr T infinity() { return std::numeric_limits<T>::infinity(); }
 };
 
-interval operator+(const interval& ival, double displacement) {
-    return interval(ival.min + displacement, ival.max + displacement);
+using interval = basic_interval<real>;
+
+template<typename T>
+basic_interval<T> operator+(const basic_interval<T>& ival, std::type_identity_t<T> displacement) {
+    return basic_interval<T>(ival.min + displacement, ival.max + displacement);
 }
 
-interval operator+(double displacement, const interval& ival) {
+template<typename T>
+basic_interval<T> operator+(std::type_identity_t<T> displacement, const basic_interval<T>& ival) {
     return ival + displacement;
 }
 
-const interval interval::empty(+utilities::infinity, -utilities::infinity);
-const interval interval::universe(-utilities::infinity, +utilities::infinity);
+template<typename T>
+const basic_interval<T> basic_interval<T>::empty(+basic_interval<T>::infinity(), -basic_interval<T>::infinity());
+template<typename T>
+const basic_interval<T> basic_interval<T>::universe(-basic_interval<T>::infinity(), +basic_interval<T>::infinity());
 
 #endif //RAY_TRACING_INTERVAL_H
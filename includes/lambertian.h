@@ -18,7 +18,8 @@ namespace material {
         explicit lambertian(const color& albedo): tex(std::make_shared<texture::solid_color>(albedo)) {}
         explicit lambertian(std::shared_ptr<texture::texture_base> tex): tex(std::move(tex)) {}
 
-        bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, double& pdf) const override {
+        bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, real& pdf) const override {
+            RAY_TRACING_COUNT_KIND(scatters, "lambertian");
 //                                                                            // already satisfying the scattering_pdf
 //            auto scatter_direction = rec.normal + vec3::random_unit_vec_on_sphere();  // lambertian scatter
 
@@ -30,21 +31,22 @@ namespace material {
                 scatter_direction = rec.normal;
             }
             auto scatter_origin = rec.p;
-            out = ray{scatter_origin, scatter_direction, in.time()};
+            out = ray{scatter_origin, scatter_direction, in.time(), ray::keep_direction};  // onb keeps it unit
             attenuation = tex->value(rec.u, rec.v, rec.p);
             pdf = dot(uvw.w(), out.direction()) / utilities::pi;    // pdf=cos(theta)/pi
             return true;
         }
 
-        [[nodiscard]] double scattering_pdf(const ray& in, const hit_record& rec, const ray& scattered) const override {
-            onb uvw;
-            uvw.build_from_normal(rec.normal);
-            return dot(uvw.w(), scattered.direction()) / utilities::pi;
+        [[nodiscard]] real scattering_pdf(const ray& in, const hit_record& rec, const ray& scattered) const override {
             auto normal = rec.normal;
             auto cos_theta = dot(normal, scattered.direction());
             return cos_theta > 0 ? cos_theta/utilities::pi :  0;                           // pdf=cos(theta)/pi
         }
 
+        [[nodiscard]] color albedo(const hit_record& rec) const override {
+            return tex->value(rec.u, rec.v, rec.p);
+        }
+
     private:
         std::shared_ptr<texture::texture_base> tex;
     };
@@ -0,0 +1,40 @@
+#ifndef RAY_TRACING_LIGHT_LIST_H
+#define RAY_TRACING_LIGHT_LIST_H
+
+#include "hittable.h"
+#include "rng.h"
+#include "algorithm"
+#include "vector"
+
+// The emissive primitives of a scene, gathered once before rendering, for next-event estimation. A light is picked
+// uniformly and sampled by its own random(); the density of a direction is the average of every light's pdf_value,
+// so a shadow ray that reaches a different light than the one picked is still weighted correctly. Lights inside
+// instances aren't gathered, paths still find them by chance.
+class light_list {
+public:
+    light_list() = default;
+    explicit light_list(const hittable& world) { world.gather_lights(lights); }
+
+    [[nodiscard]] bool empty() const { return lights.empty(); }
+    [[nodiscard]] size_t size() const { return lights.size(); }
+
+    [[nodiscard]] bool contains(const hittable* object) const {
+        return object != nullptr && std::find(lights.begin(), lights.end(), object) != lights.end();
+    }
+
+    [[nodiscard]] vec3 random(const point3& origin) const {
+        auto index = sampler::thread_rng().bounded(static_cast<uint32_t>(lights.size()));
+        return lights[index]->random(origin);
+    }
+
+    [[nodiscard]] real pdf_value(const point3& origin, const vec3& direction) const {
+        real sum = 0;
+        for (const auto* light: lights) sum += light->pdf_value(origin, direction);
+        return sum / static_cast<real>(lights.size());
+    }
+
+private:
+    std::vector<const hittable*> lights;
+};
+
+#endif //RAY_TRACING_LIGHT_LIST_H
@@ -12,12 +12,19 @@ namespace material {
     public:
         explicit diffuse_light(std::shared_ptr<texture::texture_base> tex): emit_texture(std::move(tex)) {}
         explicit diffuse_light(const color& c): emit_texture(std::make_shared<texture::solid_color>(c)) {}
-        bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, double& pdf) const override {
+        bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, real& pdf) const override {
+            RAY_TRACING_COUNT_KIND(scatters, "diffuse_light");
             return false;                                         // when we hit a light_source, we won't scatter
         }
-        [[nodiscard]] color emitted(double u, double v, const point3& p) const override {
+        [[nodiscard]] color emitted(real u, real v, const point3& p) const override {
             return emit_texture->value(u, v, p);
         }
+        [[nodiscard]] bool is_emissive() const override { return true; }
+        [[nodiscard]] color albedo(const hit_record& rec) const override {  // the emission's hue, at most white
+            auto c = emit_texture->value(rec.u, rec.v, rec.p);
+            auto brightest = std::max(c.x(), std::max(c.y(), c.z()));
+            return brightest > 1 ? c / brightest : c;
+        }
     private:
         std::shared_ptr<texture::texture_base> emit_texture;
     };
@@ -0,0 +1,227 @@
+#ifndef RAY_TRACING_LINEAR_BVH_H
+#define RAY_TRACING_LINEAR_BVH_H
+
+#include "hittable_list.h"
+#include "hittable.h"
+#include "aabb.h"
+#include "bvh_builder.h"
+#include "cstdint"
+#include "cmath"
+#include "vector"
+#include "algorithm"
+
+// 32 bytes, two nodes per cache line. Bounds are stored as floats rounded outwards, so the box never shrinks.
+struct linear_bvh_node {
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t offset;                                                         // leaf: first primitive
+                                                                             // interior: index of the second child
+    uint16_t count;                                                          // primitives in a leaf, 0 = interior
+    uint8_t axis;                                                            // split axis of an interior node
+    uint8_t padding;
+};
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node should stay 32 bytes");
+
+// A flattened BVH: nodes live in one array in depth-first order (the first child directly follows its parent),
+// primitives are reordered so every leaf references a contiguous range. Traversal is iterative with a small
+// explicit stack and visits the nearer child first.
+class linear_bvh: public hittable {
+public:
+    explicit linear_bvh(const hittable_list& world, const bvh_build_options& options = {}) {
+        std::vector<std::shared_ptr<hittable>> flat;
+        world.flatten(flat);
+        build(flat, options);
+    }
+
+    bool hit(const ray& r, const interval &inter, hit_record &rec) const override {
+        return traverse(nodes, r, inter, [&](uint32_t offset, uint32_t count, interval& ray_t) {
+            bool hit_any = false;
+            for (uint32_t i = offset; i != offset + count; ++i) {
+                if (primitives[i]->hit(r, ray_t, rec)) {
+                    hit_any = true;
+                    ray_t.max = rec.t;
+                }
+            }
+            return hit_any;
+        });
+    }
+
+    // The closest-hit loop over any flattened tree: leaf(offset, count, ray_t) tests one leaf, shrinks ray_t.max on
+    // a hit and returns whether it hit. sphere_set runs it over its own nodes.
+    template<typename Leaf>
+    static bool traverse(const std::vector<linear_bvh_node>& nodes, const ray& r, interval ray_t, Leaf&& leaf) {
+        if (nodes.empty()) return false;
+
+        bool hit_any = false;
+        uint32_t stack[bvh_builder::max_depth];                             // one entry per level
+        int stack_size = 0;
+        uint32_t current = 0;
+        while (true) {
+            const auto& node = nodes[current];
+            RAY_TRACING_COUNT(bvh_node_visits);
+            if (box_hit(node, r, ray_t)) {
+                if (node.count > 0) {                                        // leaf: test its primitives
+                    hit_any |= leaf(node.offset, static_cast<uint32_t>(node.count), ray_t);
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                } else if (r.sign(node.axis)) {                              // second child is nearer
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+            } else {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+        return hit_any;
+    }
+
+    // Depth-first copy of a builder's tree, so the first child always directly follows its parent. leaf(source)
+    // lays out a leaf's primitives and returns the offset to store in it.
+    template<typename Leaf>
+    static uint32_t linearize(const bvh_builder& builder, uint32_t index, std::vector<linear_bvh_node>& nodes,
+                              Leaf& leaf) {
+        const auto& source = builder.nodes[index];
+        auto flat_index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        set_bounds(nodes[flat_index], source.box);
+        if (source.count > 0) {
+            auto offset = leaf(source);
+            nodes[flat_index].offset = offset;
+            nodes[flat_index].count = static_cast<uint16_t>(source.count);
+            return flat_index;
+        }
+        linearize(builder, source.left, nodes, leaf);
+        auto second = linearize(builder, source.right, nodes, leaf);
+        nodes[flat_index].offset = second;
+        nodes[flat_index].count = 0;
+        nodes[flat_index].axis = static_cast<uint8_t>(source.axis);
+        return flat_index;
+    }
+
+    // Same traversal for a whole packet on one shared stack: a node is entered if any active lane hits its box,
+    // children are ordered by lane 0's direction, and leaves hand the lanes that reached them to the primitives.
+    uint32_t hit_packet(ray_packet& packet, uint32_t active, hit_record* records) const override {
+        if (nodes.empty()) return 0;
+
+        uint32_t hits = 0;
+        uint32_t stack[bvh_builder::max_depth];                             // one entry per level
+        int stack_size = 0;
+        uint32_t current = 0;
+        while (true) {
+            const auto& node = nodes[current];
+            RAY_TRACING_COUNT(bvh_node_visits);
+            auto lanes = box_hit_packet(node, packet) & active;
+            if (lanes) {
+                if (node.count > 0) {
+                    for (uint32_t i = node.offset; i != node.offset + node.count; ++i)
+                        hits |= primitives[i]->hit_packet(packet, lanes, records);
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                } else if (packet.sign[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+            } else {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+        return hits;
+    }
+
+    [[nodiscard]] aabb bounding_box() const override {
+        return bbox;
+    }
+
+    [[nodiscard]] aabb transformed_bounding_box(const affine_transform& to_world) const override {
+        aabb bounds;
+        for (const auto& primitive: primitives) bounds = aabb(bounds, primitive->transformed_bounding_box(to_world));
+        return bounds;
+    }
+
+    void gather_lights(std::vector<const hittable*>& lights) const override {
+        for (const auto& primitive: primitives) primitive->gather_lights(lights);
+    }
+
+    void gather_primitives(std::vector<const hittable*>& objects) const override {
+        for (const auto& primitive: primitives) primitive->gather_primitives(objects);
+    }
+
+    [[nodiscard]] size_t node_count() const { return nodes.size(); }
+    [[nodiscard]] size_t primitive_count() const { return primitives.size(); }
+
+private:
+    std::vector<linear_bvh_node> nodes;
+    std::vector<std::shared_ptr<hittable>> primitives;                       // in leaf order
+    aabb bbox;
+
+    // same branchless slab kernel as aabb::hit, on the float bounds
+    static inline bool box_hit(const linear_bvh_node& node, const ray& r, const interval& ray_t) {
+        const auto& orig = r.origin();
+        const auto& inv = r.inv_direction();
+        real t_min = ray_t.min, t_max = ray_t.max;
+        for (int a = 0; a != 3; ++a) {
+            auto t0 = ((r.sign(a) ? node.bounds_max[a] : node.bounds_min[a]) - orig[a]) * inv[a];
+            auto t1 = ((r.sign(a) ? node.bounds_min[a] : node.bounds_max[a]) - orig[a]) * inv[a];
+            t_min = std::max(t_min, t0);
+            t_max = std::min(t_max, t1);
+        }
+        return t_min < t_max;
+    }
+
+    // the slab test for every lane of a packet, one bit per lane that hits
+    static inline uint32_t box_hit_packet(const linear_bvh_node& node, const ray_packet& packet) {
+        alignas(64) int inside[ray_packet::max_size]{};
+        const real lo[3] = {node.bounds_min[0], node.bounds_min[1], node.bounds_min[2]};
+        const real hi[3] = {node.bounds_max[0], node.bounds_max[1], node.bounds_max[2]};
+        const int n = packet.size;
+#pragma omp simd
+        for (int i = 0; i < n; ++i) {
+            real t_min = packet.t_min[i], t_max = packet.t_max[i];
+            for (int a = 0; a != 3; ++a) {
+                auto t0 = (lo[a] - packet.origin[a][i]) * packet.inv_direction[a][i];
+                auto t1 = (hi[a] - packet.origin[a][i]) * packet.inv_direction[a][i];
+                auto t_near = t0 < t1 ? t0 : t1, t_far = t0 < t1 ? t1 : t0;     // no per-lane sign lookups
+                t_min = t_near > t_min ? t_near : t_min;
+                t_max = t_far < t_max ? t_far : t_max;
+            }
+            inside[i] = t_min < t_max;
+        }
+        uint32_t mask = 0;
+        for (int i = 0; i != n; ++i) mask |= static_cast<uint32_t>(inside[i]) << i;
+        return mask;
+    }
+
+    void build(const std::vector<std::shared_ptr<hittable>>& objects, const bvh_build_options& options) {
+        if (objects.empty()) return;
+        auto leaf_options = options;                                         // a leaf count must fit in 16 bits
+        leaf_options.max_leaf_size = std::min<size_t>(options.max_leaf_size, UINT16_MAX);
+        bvh_builder builder(objects, leaf_options);
+        bbox = builder.nodes[0].box;
+        nodes.reserve(builder.nodes.size());
+        primitives.reserve(objects.size());
+        auto leaf = [&](const bvh_builder::node& source) {
+            auto offset = static_cast<uint32_t>(primitives.size());
+            for (uint32_t i = source.start; i != source.start + source.count; ++i)
+                primitives.push_back(objects[builder.indices[i]]);
+            return offset;
+        };
+        linearize(builder, 0, nodes, leaf);
+    }
+
+    static void set_bounds(linear_bvh_node& node, const aabb& box) {
+        for (int a = 0; a != 3; ++a) {                                       // round outwards to float
+            node.bounds_min[a] = std::nextafter(static_cast<float>(box.axis(a).min), -INFINITY);
+            node.bounds_max[a] = std::nextafter(static_cast<float>(box.axis(a).max), INFINITY);
+        }
+    }
+};
+
+#endif //RAY_TRACING_LINEAR_BVH_H
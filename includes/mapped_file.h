@@ -0,0 +1,75 @@
+#ifndef RAY_TRACING_MAPPED_FILE_H
+#define RAY_TRACING_MAPPED_FILE_H
+
+#include "cstddef"
+#include "string"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include "windows.h"
+#else
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
+#endif
+
+// Read-only view of a whole file, released with the object: mmap on POSIX, a file mapping on Windows. is_open()
+// is false if the file can't be opened or mapped, or is empty.
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& filename) {
+#ifdef _WIN32
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER file_size{};
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) return;
+        auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) return;
+        data = static_cast<const char*>(view);
+        size = static_cast<size_t>(file_size.QuadPart);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info{};
+        void* view = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+            view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);                                                          // the mapping stays valid
+        if (view == MAP_FAILED) return;
+        madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+        data = static_cast<const char*>(view);
+        size = static_cast<size_t>(info.st_size);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator = (const mapped_file&) = delete;
+
+    ~mapped_file() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    [[nodiscard]] bool is_open() const { return data != nullptr; }
+
+    const char* data = nullptr;
+    size_t size = 0;
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+#endif //RAY_TRACING_MAPPED_FILE_H
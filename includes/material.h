@@ -12,13 +12,19 @@ namespace material {
     public:
         virtual ~material_base() = default;
 
-        virtual bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, double& pdf) const = 0;
-        [[nodiscard]] virtual color emitted(double u, double v, const point3& p) const {
+        virtual bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, real& pdf) const = 0;
+        [[nodiscard]] virtual color emitted(real u, real v, const point3& p) const {
             return {0, 0, 0};                                                 // default is no emission
         }
-        [[nodiscard]] virtual double scattering_pdf(const ray& in, const hit_record& rec, const ray& scattered) const {
+        [[nodiscard]] virtual real scattering_pdf(const ray& in, const hit_record& rec, const ray& scattered) const {
             return 0.0;                                                                   // default is not a pdf
         }
+        [[nodiscard]] virtual bool is_emissive() const {                  // surfaces with it are sampled as lights
+            return false;
+        }
+        [[nodiscard]] virtual color albedo(const hit_record& rec) const {   // the surface's color, a denoiser guide
+            return {1, 1, 1};                                                   // default is white, like clear glass
+        }
     };
 }
 
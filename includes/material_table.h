@@ -0,0 +1,36 @@
+#ifndef RAY_TRACING_MATERIAL_TABLE_H
+#define RAY_TRACING_MATERIAL_TABLE_H
+
+#include "memory"
+#include "vector"
+#include "unordered_map"
+#include "cstdint"
+
+namespace material {
+    class material_base;
+
+    using material_id = uint32_t;
+
+    // Owns the materials of one scene; its world (hittable_list::materials) holds it, primitives get it at
+    // construction. Primitives and hit records refer to materials by id, so a hit copies four bytes instead of a
+    // shared_ptr, whose atomic refcount made a popular material one cache line every render thread wrote to.
+    // Materials are added while the scene is built and only read while it renders; adding the same material again
+    // returns its existing id.
+    class material_table {
+    public:
+        material_id add(const std::shared_ptr<material_base>& obj_material) {
+            auto [found, inserted] = ids.try_emplace(obj_material.get(), static_cast<material_id>(entries.size()));
+            if (inserted) entries.push_back(obj_material);
+            return found->second;
+        }
+
+        [[nodiscard]] material_base* get(material_id id) const { return entries[id].get(); }
+        [[nodiscard]] size_t size() const { return entries.size(); }
+
+    private:
+        std::vector<std::shared_ptr<material_base>> entries;
+        std::unordered_map<const material_base*, material_id> ids;
+    };
+}
+
+#endif //RAY_TRACING_MATERIAL_TABLE_H
@@ -12,21 +12,26 @@
 namespace material {
     class metal: public material::material_base {
     public:
-        explicit metal(color albedo): albedo(std::move(albedo)), fuzz(0.0) {}
-        metal(color albedo, double f): albedo(std::move(albedo)), fuzz(f) {}
+        explicit metal(color albedo): albedo_color(std::move(albedo)), fuzz(0.0) {}
+        metal(color albedo, real f): albedo_color(std::move(albedo)), fuzz(f) {}
 
         // TODO: pdf
-        bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, double& pdf) const override {
+        bool scatter(const ray& in, const hit_record& rec, color& attenuation, ray& out, real& pdf) const override {
+            RAY_TRACING_COUNT_KIND(scatters, "metal");
             auto scatter_direction = reflect(in.direction(), rec.normal) + fuzz * vec3::random_unit_vec_on_sphere();
             auto scatter_origin = rec.p;
             out = ray{scatter_origin, scatter_direction, in.time()};
-            attenuation = albedo;
+            attenuation = albedo_color;
             return (dot(rec.normal, scatter_direction) > 0);
         }
 
+        [[nodiscard]] color albedo(const hit_record& rec) const override {
+            return albedo_color;
+        }
+
     private:
-        color albedo;
-        double fuzz;
+        color albedo_color;
+        real fuzz;
     };
 }
 
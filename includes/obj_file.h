@@ -0,0 +1,207 @@
+#ifndef RAY_TRACING_OBJ_FILE_H
+#define RAY_TRACING_OBJ_FILE_H
+
+#include "triangle_mesh.h"
+#include "mapped_file.h"
+#include "charconv"
+#include "cstdint"
+#include "iostream"
+#include "memory"
+#include "string"
+#include "vector"
+
+// Wavefront OBJ geometry as a primitive::triangle_mesh. The file is mapped into memory and parsed in one pass
+// straight from the mapping: no line copies, no per-line allocation, numbers read with from_chars. Understood are
+// v (x y z, a fourth coordinate is ignored), vt (u v), vn and f with any of the v, v/vt, v//vn and v/vt/vn corner
+// forms, negative (relative) indices included; faces with more than three corners are split into a fan. Every
+// other statement (o, g, s, usemtl, mtllib, l, p, ...) is skipped, so the whole mesh gets the material given to
+// load(). Indices must refer to vertices defined before the face, as every exporter writes them.
+namespace obj_file {
+    namespace detail {
+        // one pass over the mapping; every read stops at the end of the line
+        class parser {
+        public:
+            parser(const char* begin, const char* end, primitive::triangle_mesh::buffers& mesh):
+                    next(begin), end(end), mesh(mesh) {}
+
+            std::string error;
+            size_t line = 0;
+
+            bool run() {
+                while (next != end) {
+                    ++line;
+                    skip_blanks();
+                    if (!statement()) return false;
+                    while (next != end && *next != '\n') ++next;           // the rest of the line, or a comment
+                    if (next != end) ++next;
+                }
+                return true;
+            }
+
+        private:
+            struct corner {
+                uint32_t position, uv, normal;
+            };
+
+            const char* next;
+            const char* end;
+            primitive::triangle_mesh::buffers& mesh;
+            std::vector<corner> polygon;                                    // of the current face, reused
+
+            static bool blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+            void skip_blanks() {
+                while (next != end && blank(*next)) ++next;
+            }
+
+            [[nodiscard]] bool at_line_end() const { return next == end || *next == '\n' || *next == '#'; }
+
+            bool fail(const char* message) {
+                error = message;
+                return false;
+            }
+
+            bool keyword(const char* word) {
+                auto start = next;
+                for (; *word; ++word, ++next)
+                    if (next == end || *next != *word) {
+                        next = start;
+                        return false;
+                    }
+                if (next != end && !blank(*next) && *next != '\n') {
+                    next = start;
+                    return false;
+                }
+                return true;
+            }
+
+            bool number(float& out) {
+                skip_blanks();
+                if (next != end && *next == '+') ++next;                    // from_chars takes no plus sign
+                auto [rest, status] = std::from_chars(next, end, out);
+                if (status != std::errc()) return false;
+                next = rest;
+                return true;
+            }
+
+            bool floats(float* out, int count) {
+                for (int i = 0; i != count; ++i)
+                    if (!number(out[i])) return false;
+                return true;
+            }
+
+            // a 1-based index, or a negative one counting back from the last element defined, into [0, size)
+            bool index(size_t size, uint32_t& out) {
+                long long value;
+                auto [rest, status] = std::from_chars(next, end, value);
+                if (status != std::errc()) return false;
+                next = rest;
+                long long resolved = value > 0 ? value - 1 : static_cast<long long>(size) + value;
+                if (value == 0 || resolved < 0 || resolved >= static_cast<long long>(size)) return false;
+                out = static_cast<uint32_t>(resolved);
+                return true;
+            }
+
+            bool statement() {
+                if (at_line_end()) return true;
+                if (keyword("v")) {
+                    float p[3];
+                    if (!floats(p, 3)) return fail("expected v <x> <y> <z>");
+                    mesh.positions.emplace_back(p[0], p[1], p[2]);
+                    return true;
+                }
+                if (keyword("vn")) {
+                    float n[3];
+                    if (!floats(n, 3)) return fail("expected vn <x> <y> <z>");
+                    mesh.normals.emplace_back(n[0], n[1], n[2]);
+                    return true;
+                }
+                if (keyword("vt")) {
+                    float t[2] = {0.0f, 0.0f};
+                    if (!number(t[0])) return fail("expected vt <u> [v]");
+                    number(t[1]);
+                    mesh.uvs.push_back({t[0], t[1]});
+                    return true;
+                }
+                if (keyword("f")) return face();
+                return true;                                                 // anything else is skipped
+            }
+
+            bool face() {
+                polygon.clear();
+                while (true) {
+                    skip_blanks();
+                    if (at_line_end()) break;
+                    corner c{primitive::triangle_mesh::no_index, primitive::triangle_mesh::no_index,
+                             primitive::triangle_mesh::no_index};
+                    if (!index(mesh.positions.size(), c.position)) return fail("bad vertex index in face");
+                    if (next != end && *next == '/') {
+                        ++next;
+                        if (next != end && *next != '/' && !index(mesh.uvs.size(), c.uv))
+                            return fail("bad texture coordinate index in face");
+                        if (next != end && *next == '/') {
+                            ++next;
+                            if (!index(mesh.normals.size(), c.normal)) return fail("bad normal index in face");
+                        }
+                    }
+                    if (next != end && !blank(*next) && *next != '\n' && *next != '#')
+                        return fail("bad corner in face");
+                    polygon.push_back(c);
+                }
+                if (polygon.size() < 3) return fail("a face needs three corners");
+                for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+                    const corner* triangle[3] = {&polygon[0], &polygon[i], &polygon[i + 1]};
+                    bool has_uv = false, has_normal = false;
+                    for (auto c: triangle) {
+                        mesh.indices.push_back(c->position);
+                        has_uv |= c->uv != primitive::triangle_mesh::no_index;
+                        has_normal |= c->normal != primitive::triangle_mesh::no_index;
+                    }
+                    // the optional index buffers start out when the first face needs them
+                    if (has_uv && mesh.uv_indices.empty())
+                        mesh.uv_indices.assign(mesh.indices.size() - 3, primitive::triangle_mesh::no_index);
+                    if (has_normal && mesh.normal_indices.empty())
+                        mesh.normal_indices.assign(mesh.indices.size() - 3, primitive::triangle_mesh::no_index);
+                    for (auto c: triangle) {
+                        if (!mesh.uv_indices.empty()) mesh.uv_indices.push_back(c->uv);
+                        if (!mesh.normal_indices.empty()) mesh.normal_indices.push_back(c->normal);
+                    }
+                }
+                return true;
+            }
+        };
+    }
+
+    // Parses filename into mesh; prints the error with its line and returns false if it can't.
+    inline bool read(const std::string& filename, primitive::triangle_mesh::buffers& mesh) {
+        mapped_file file(filename);
+        if (!file.is_open()) {
+            std::cout << "Error occurred while opening " << filename << std::endl;
+            return false;
+        }
+        detail::parser parser(file.data, file.data + file.size, mesh);
+        if (!parser.run()) {
+            std::cout << "Error in the OBJ file " << filename << ", line " << parser.line << ": " << parser.error
+                      << std::endl;
+            return false;
+        }
+        if (mesh.indices.empty()) {
+            std::cout << "Error in the OBJ file " << filename << ": no faces" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // the whole file as one mesh of one material (registered in materials), nullptr if it can't be read
+    inline std::shared_ptr<primitive::triangle_mesh> load(material::material_table& materials,
+                                                         const std::string& filename,
+                                                         const std::shared_ptr<material::material_base>& surface,
+                                                         const bvh_build_options& options =
+                                                                 primitive::triangle_mesh::default_options()) {
+        primitive::triangle_mesh::buffers mesh;
+        if (!read(filename, mesh)) return nullptr;
+        return std::make_shared<primitive::triangle_mesh>(materials, std::move(mesh), surface, options);
+    }
+}
+
+#endif //RAY_TRACING_OBJ_FILE_H
@@ -23,7 +23,7 @@ public:
     [[nodiscard]] vec3& v() { return axis[1]; }
     [[nodiscard]] vec3& w() { return axis[2]; }
 
-    vec3 local_to_global(double x, double y, double z) { return axis[0] * x + axis[1] * y + axis[2] * z; }
+    vec3 local_to_global(real x, real y, real z) { return axis[0] * x + axis[1] * y + axis[2] * z; }
     vec3 local_to_global(const vec3& local_coords) {
         return axis[0] * local_coords.x() + axis[1] * local_coords.y() + axis[2] * local_coords.z();
     }
@@ -83,8 +83,9 @@ private:
 
 
     static void permute(int* p, int n) {
+        auto& rng = sampler::thread_rng();
         for (int i = n-1; i > 0; i--) {
-            int target = utilities::random_int(0, i);
+            int target = static_cast<int>(rng.bounded(i + 1));           // Fisher-Yates, unbiased in [0, i]
             int tmp = p[i];
             p[i] = p[target];
             p[target] = tmp;
@@ -9,29 +9,43 @@
 #include "interval.h"
 #include "aabb.h"
 #include "hittable.h"
+#include "material.h"
 // I do think life's ultimate goal is to make a quad(written by copilot)
 namespace primitive {
     class quad : public hittable {
     public:
-        quad(point3 Q, vec3 u, vec3 v, std::shared_ptr<material::material_base> obj_material):
-                    Q(std::move(Q)), u(std::move(u)), v(std::move(v)), obj_material(std::move(obj_material)) {
+        quad(material::material_table& materials, point3 Q, vec3 u, vec3 v,
+             const std::shared_ptr<material::material_base>& obj_material):
+                    Q(std::move(Q)), u(std::move(u)), v(std::move(v)),
+                    obj_material(materials.add(obj_material)), emissive(obj_material->is_emissive()) {
 
-            bbox = aabb(this->Q, this->Q + this->u + this->v);                // bounding box
+            bbox = aabb(this->Q, this->Q + this->u + this->v).pad();          // bounding box, padded so an
+                                                                                 // axis-aligned quad isn't flat
             auto n = cross(this->u, this->v);                          // pull out the n, because of w
             normal = normalize(n);                                               // normal = cross(u, v)
             D = dot(normal, this->Q);
             w = n / dot(n, n);                                               // w is a common vec3 in calc step
+            area = n.length();
         }
 
         virtual void set_bounding_box() {                                            // TODO: why virtual?
-            bbox = aabb(Q, Q + u + v);
+            bbox = aabb(Q, Q + u + v).pad();
         }
 
         [[nodiscard]] aabb bounding_box() const override {
             return bbox;
         }
 
+        [[nodiscard]] aabb transformed_bounding_box(const affine_transform& to_world) const override {
+            auto corner = [&](const point3& p) {
+                auto moved = to_world.point(point3d(p));
+                return affine_transform::outward(moved, moved);
+            };
+            return aabb(aabb(corner(Q), corner(Q + u)), aabb(corner(Q + v), corner(Q + u + v))).pad();
+        }
+
         bool hit(const ray& r, const interval &inter, hit_record &rec) const override {
+            RAY_TRACING_COUNT_KIND(primitive_hits, "quad");
             auto denominator = dot(normal, r.direction());
             if (fabs(denominator) < utilities::epsilon)
                 return false;
@@ -49,14 +63,75 @@ namespace primitive {
             if (!is_inside) return false;
 
             rec.t = t;                                                                  // if hit, update rec
-            rec.p = P;
-            rec.surface_material = this->obj_material;
+            rec.object = this;                                                          // the rest waits for
+                                                                                        // compute_surface
+            return true;
+        }
+
+        void compute_surface(const ray& r, hit_record& rec) const override {
+            rec.p = r.at(rec.t);
+            rec.surface_id = this->obj_material;
             rec.set_face_normal(r, normal);
+        }
 
-            return true;
+        // Plane intersection and the (alpha, beta) coordinates for all lanes at once, then the interior test
+        // (virtual, so shapes built on quad keep working) only for lanes that hit the plane in range.
+        uint32_t hit_packet(ray_packet& packet, uint32_t active, hit_record* records) const override {
+            RAY_TRACING_COUNT_KIND(primitive_hits, "quad_packet");
+            alignas(64) real ts[ray_packet::max_size], alphas[ray_packet::max_size], betas[ray_packet::max_size];
+            alignas(64) int found[ray_packet::max_size];
+            const real nx = normal[0], ny = normal[1], nz = normal[2];
+            const vec3 w_cross_v = cross(v, w), u_cross_w = cross(w, u);     // w.(p x v) = p.(v x w), and so on
+            const real ax = w_cross_v[0], ay = w_cross_v[1], az = w_cross_v[2];
+            const real bx = u_cross_w[0], by = u_cross_w[1], bz = u_cross_w[2];
+            const real qx = Q[0], qy = Q[1], qz = Q[2];
+            const int n = packet.size;
+#pragma omp simd
+            for (int i = 0; i < n; ++i) {
+                auto ox = packet.origin[0][i], oy = packet.origin[1][i], oz = packet.origin[2][i];
+                auto dx = packet.direction[0][i], dy = packet.direction[1][i], dz = packet.direction[2][i];
+                auto denominator = nx * dx + ny * dy + nz * dz;
+                auto t = (D - (nx * ox + ny * oy + nz * oz)) / denominator;
+                auto px = ox + t * dx - qx, py = oy + t * dy - qy, pz = oz + t * dz - qz;
+                ts[i] = t;
+                alphas[i] = px * ax + py * ay + pz * az;
+                betas[i] = px * bx + py * by + pz * bz;
+                found[i] = std::fabs(denominator) >= utilities::epsilon
+                        && t >= packet.t_min[i] && t <= packet.t_max[i];
+            }
+            uint32_t hits = 0;
+            for (int i = 0; i != n; ++i) {
+                if (!found[i] || !(active & (1u << i))) continue;
+                if (!is_interior(alphas[i], betas[i], records[i])) continue;
+                records[i].t = ts[i];
+                records[i].object = this;
+                packet.t_max[i] = ts[i];
+                hits |= 1u << i;
+            }
+            return hits;
+        }
+
+        void gather_lights(std::vector<const hittable*>& lights) const override {
+            if (emissive) lights.push_back(this);
+        }
+
+        // uniform over the area, so the solid-angle density is distance^2 / (cos * area)
+        [[nodiscard]] real pdf_value(const point3& origin, const vec3& direction) const override {
+            ray towards(origin, direction);
+            hit_record rec;
+            if (!hit(towards, interval(min_hit_distance(towards), utilities::infinity), rec)) return 0;
+            auto cosine = std::fabs(dot(towards.direction(), normal));
+            if (cosine < utilities::epsilon) return 0;
+            return rec.t * rec.t / (cosine * area);
+        }
+
+        [[nodiscard]] vec3 random(const point3& origin) const override {
+            double draws[2];
+            sampler::thread_rng().fill(draws, 2);
+            return Q + static_cast<real>(draws[0]) * u + static_cast<real>(draws[1]) * v - origin;
         }
 
-        [[nodiscard]] virtual inline bool is_interior(double a, double b, hit_record& rec) const {
+        [[nodiscard]] virtual inline bool is_interior(real a, real b, hit_record& rec) const {
             // given the length on basis u and v, update the rec's material u,v index(not the same concept of u, v!)
             // return if the hit point is inside the primitive
             if ((a < 0) || (a > 1) || (b < 0) || (b > 1))                  // TODO: can this if optimized by statistics?
@@ -72,9 +147,11 @@ namespace primitive {
         point3 Q;                                                                   // start-point(bottom-left)
         vec3 u, v;                                                                  // basis vector(span the quad)
         aabb bbox;                                                                  // bounding box
-        std::shared_ptr<material::material_base> obj_material;                      // material
+        material::material_id obj_material;                                         // material
+        bool emissive;                                                              // sampled as a light
         vec3 normal;                                                                // normalize(cross(u, v)) = normal
-        double D;                                                                 // Ax+By+Cz=D
+        real D;                                                                 // Ax+By+Cz=D
+        real area;                                                                  // |cross(u, v)|
         vec3 w;
     };
 }
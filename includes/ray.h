@@ -8,36 +8,77 @@
 #include <utility>
 
 #include "vec3.h"
+#include "algorithm"
+#include "type_traits"
 
-class ray {
+template<typename T>
+class basic_ray {
 public:
-    ray(): ray_o(), ray_d() {}
-    ray(point3 ray_o, vec3 ray_d): ray_o(std::move(ray_o)), ray_d(std::move(normalize(ray_d))), tm(0) {}
-    ray(point3 ray_o, vec3 ray_d, double time):                                         // also init tm
-                                ray_o(std::move(ray_o)), ray_d(std::move(normalize(ray_d))), tm(time) {}
+    using vec_type = basic_vec3<T>;
+    struct keep_direction_t {};                                        // tag: the caller's direction is used as-is,
+    static constexpr keep_direction_t keep_direction{};               // either already unit length or not needed
 
-    [[nodiscard]] point3 origin() const { return ray_o; }
-    [[nodiscard]] vec3 direction() const { return ray_d; }
-    [[nodiscard]] double time() const { return tm; }
+    basic_ray(): ray_o(), ray_d(), tm(0) { precompute(); }
+    basic_ray(vec_type ray_o, vec_type ray_d): ray_o(std::move(ray_o)), ray_d(normalize(ray_d)), tm(0) { precompute(); }
+    basic_ray(vec_type ray_o, vec_type ray_d, double time):                             // also init tm
+                                ray_o(std::move(ray_o)), ray_d(normalize(ray_d)), tm(static_cast<T>(time)) { precompute(); }
+    basic_ray(vec_type ray_o, vec_type ray_d, double time, keep_direction_t):           // skip the normalize()
+                                ray_o(std::move(ray_o)), ray_d(std::move(ray_d)), tm(static_cast<T>(time)) { precompute(); }
 
-    [[nodiscard]] point3 at(double t) const {
+    [[nodiscard]] const vec_type& origin() const { return ray_o; }
+    [[nodiscard]] const vec_type& direction() const { return ray_d; }
+    [[nodiscard]] T time() const { return tm; }
+    [[nodiscard]] const vec_type& inv_direction() const { return inv_d; } // 1 / direction, per component
+    [[nodiscard]] int sign(int axis) const { return sign_bits[axis]; }    // 1 if direction[axis] < 0
+
+    [[nodiscard]] basic_ray with_origin(const vec_type& new_origin) const {  // same direction, reuses inv_d
+        basic_ray moved = *this;
+        moved.ray_o = new_origin;
+        return moved;
+    }
+
+    [[nodiscard]] vec_type at(T t) const {
         return ray_o + t * ray_d;
     }
 
-    friend inline std::ostream& operator << (std::ostream& out, const ray& r);
+    template<typename U>
+    friend inline std::ostream& operator << (std::ostream& out, const basic_ray<U>& r);
 
 private:
-    point3 ray_o;
-    vec3 ray_d;
-    double tm;
+    vec_type ray_o;
+    vec_type ray_d;
+    T tm;
+    vec_type inv_d;                                                     // computed once here instead of once per
+    int sign_bits[3]{};                                                 // visited bvh node
+
+    void precompute() {
+        inv_d = vec_type{T(1) / ray_d[0], T(1) / ray_d[1], T(1) / ray_d[2]};
+        for (int a = 0; a != 3; ++a) sign_bits[a] = inv_d[a] < 0;
+    }
 };
 
-inline std::ostream& operator << (std::ostream& out, const ray& r) {
+using ray = basic_ray<real>;
+
+template<typename T>
+inline std::ostream& operator << (std::ostream& out, const basic_ray<T>& r) {
     out << "ray_o = " << r.ray_o.x() << ' ' << r.ray_o.y() << ' ' << r.ray_o.z() << "  "
         << "ray_d = " << r.ray_d.x() << ' ' << r.ray_d.y() << ' ' << r.ray_d.z() << '\n';
     return out;
 }
 
+// Smallest t worth intersecting for a ray. 0.0001 in double; a float32 hit point is only good to a few ulps of its
+// largest coordinate, so there the bound grows with the origin, or rays leaving a surface would hit it again.
+template<typename T>
+inline T min_hit_distance(const basic_ray<T>& r) {
+    T t = T(0.0001);
+    if constexpr (std::is_same_v<T, float>) {
+        const auto& o = r.origin();
+        T extent = std::max(std::fabs(o[0]), std::max(std::fabs(o[1]), std::fabs(o[2])));
+        t = std::max(t, extent * T(0x1.0p-16));
+    }
+    return t;
+}
+
 
 namespace unit_test {
     void ray_test() {
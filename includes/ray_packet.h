@@ -0,0 +1,46 @@
+#ifndef RAY_TRACING_RAY_PACKET_H
+#define RAY_TRACING_RAY_PACKET_H
+
+#include "ray.h"
+#include "interval.h"
+#include "cstdint"
+
+// Up to 16 rays traced together. Every lane keeps its ray (for the single-ray fallback and for shading), plus the
+// same data in SoA arrays so box and primitive tests can run over all lanes in one `#pragma omp simd` loop.
+// Lanes are selected by 32-bit masks, bit i = lane i.
+struct ray_packet {
+    static constexpr int max_size = 16;
+
+    int size = 0;
+    ray rays[max_size];
+    alignas(64) real origin[3][max_size];
+    alignas(64) real direction[3][max_size];
+    alignas(64) real inv_direction[3][max_size];
+    alignas(64) real time[max_size];
+    alignas(64) real t_min[max_size];
+    alignas(64) real t_max[max_size];                                      // shrinks to the closest hit so far
+    int sign[3]{};                                                           // lane 0's, orders bvh children
+                                                                             // for the whole packet
+    // each lane's range starts at its own ray's min_hit_distance, as a single-ray trace of it would
+    void assign(const ray* source, int count) {
+        size = count < max_size ? count : max_size;
+        for (int i = 0; i != size; ++i) {
+            rays[i] = source[i];
+            for (int a = 0; a != 3; ++a) {
+                origin[a][i] = source[i].origin()[a];
+                direction[a][i] = source[i].direction()[a];
+                inv_direction[a][i] = source[i].inv_direction()[a];
+            }
+            time[i] = source[i].time();
+            t_min[i] = min_hit_distance(source[i]);
+            t_max[i] = utilities::infinity;
+        }
+        for (int a = 0; a != 3; ++a) sign[a] = size > 0 ? source[0].sign(a) : 0;
+    }
+
+    [[nodiscard]] uint32_t all_lanes() const {
+        return (1u << size) - 1;
+    }
+};
+
+#endif //RAY_TRACING_RAY_PACKET_H
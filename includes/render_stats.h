@@ -0,0 +1,114 @@
+#ifndef RAY_TRACING_RENDER_STATS_H
+#define RAY_TRACING_RENDER_STATS_H
+
+#include "algorithm"
+#include "cstddef"
+#include "cstdint"
+#include "mutex"
+#include "sstream"
+#include "string"
+#include "vector"
+
+// What the renderer does, counted: closest-hit queries by bounce, aabb::hit calls, BVH node visits, hit calls by
+// primitive type and scatter calls by material type. The counting macros below compile to nothing unless
+// RAY_TRACING_STATS is defined (a CMake option). Every thread counts into its own thread_local block, and
+// camera::internal_render adds them up into camera::statistics() as each tile finishes.
+namespace render_stats {
+    constexpr size_t max_depth = 64;                                   // deeper rays count at the last depth
+    constexpr size_t max_kinds = 32;                                   // primitive and material types
+
+    struct counters {
+        uint64_t rays_by_depth[max_depth];                             // closest-hit queries, 0: camera rays
+        uint64_t shadow_rays;
+        uint64_t aabb_hits;                                            // aabb::hit calls
+        uint64_t bvh_node_visits;                                      // bvh_node, linear_bvh (and sphere_set), bvh4
+        uint64_t primitive_hits[max_kinds];                            // by kind_names() slot
+        uint64_t scatters[max_kinds];
+
+        void add(const counters& other) {
+            for (size_t i = 0; i != max_depth; ++i) rays_by_depth[i] += other.rays_by_depth[i];
+            shadow_rays += other.shadow_rays;
+            aabb_hits += other.aabb_hits;
+            bvh_node_visits += other.bvh_node_visits;
+            for (size_t i = 0; i != max_kinds; ++i) {
+                primitive_hits[i] += other.primitive_hits[i];
+                scatters[i] += other.scatters[i];
+            }
+        }
+    };
+
+    inline counters& local() {
+        static thread_local counters thread_counters{};
+        return thread_counters;
+    }
+
+    inline std::mutex& kind_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    // type names, in slot order; primitives and materials share the slots
+    inline std::vector<std::string>& kind_names() {
+        static std::vector<std::string> names;
+        return names;
+    }
+
+    // slot of name, added on first use; every counting call site looks its slot up once
+    inline size_t kind_slot(const char* name) {
+        std::lock_guard<std::mutex> lock(kind_mutex());
+        auto& names = kind_names();
+        auto found = std::find(names.begin(), names.end(), name);
+        if (found != names.end()) return found - names.begin();
+        if (names.size() == max_kinds - 1) return max_kinds - 1;            // the last slot takes the overflow
+        names.emplace_back(name);
+        return names.size() - 1;
+    }
+
+    // every nonzero counter as (name, value): rays.depth_0, ..., shadow_rays, aabb_hits, bvh_node_visits,
+    // hit.sphere, ..., scatter.lambertian, ...
+    template<typename F>
+    void for_each(const counters& stats, F&& visit) {
+        for (size_t i = 0; i != max_depth; ++i)
+            if (stats.rays_by_depth[i]) visit("rays.depth_" + std::to_string(i), stats.rays_by_depth[i]);
+        visit(std::string("shadow_rays"), stats.shadow_rays);
+        visit(std::string("aabb_hits"), stats.aabb_hits);
+        visit(std::string("bvh_node_visits"), stats.bvh_node_visits);
+        std::vector<std::string> names;
+        {
+            std::lock_guard<std::mutex> lock(kind_mutex());
+            names = kind_names();
+        }
+        names.resize(max_kinds, "other");
+        for (size_t i = 0; i != max_kinds; ++i)
+            if (stats.primitive_hits[i]) visit("hit." + names[i], stats.primitive_hits[i]);
+        for (size_t i = 0; i != max_kinds; ++i)
+            if (stats.scatters[i]) visit("scatter." + names[i], stats.scatters[i]);
+    }
+
+    inline std::string report(const counters& stats) {
+        std::ostringstream out;
+        out << "Render statistics:\n";
+        for_each(stats, [&](const std::string& name, uint64_t value) {
+            out << "  " << name << std::string(name.size() < 28 ? 28 - name.size() : 1, ' ') << value << '\n';
+        });
+        return out.str();
+    }
+}
+
+#ifdef RAY_TRACING_STATS
+#define RAY_TRACING_COUNT(field) (++render_stats::local().field)
+#define RAY_TRACING_ADD(field, n) (render_stats::local().field += (n))
+#define RAY_TRACING_COUNT_DEPTH(depth) \
+    (++render_stats::local().rays_by_depth[std::min<size_t>((depth), render_stats::max_depth - 1)])
+#define RAY_TRACING_COUNT_KIND(table, name) do { \
+        static const size_t stats_slot = render_stats::kind_slot(name); \
+        ++render_stats::local().table[stats_slot]; \
+    } while (false)
+#else
+#define RAY_TRACING_COUNT(field) ((void)0)
+#define RAY_TRACING_ADD(field, n) ((void)0)
+#define RAY_TRACING_COUNT_DEPTH(depth) ((void)0)
+#define RAY_TRACING_COUNT_KIND(table, name) ((void)0)
+#endif
+
+#endif //RAY_TRACING_RENDER_STATS_H
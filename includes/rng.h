@@ -0,0 +1,101 @@
+#ifndef RAY_TRACING_RNG_H
+#define RAY_TRACING_RNG_H
+
+#include "cstdint"
+#include "cstddef"
+#include "random"
+
+namespace sampler {
+    // splitmix64 finalizer, a good 64-bit mixer. Used to expand seeds and to hash counters into stream seeds.
+    inline constexpr uint64_t mix64(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // Counter-based stream seed: the same (seed, index, pass) always gives the same stream, no matter which
+    // thread renders the pixel or in which order.
+    inline constexpr uint64_t stream_seed(uint64_t seed, uint64_t index, uint64_t pass = 0) {
+        return mix64(mix64(mix64(seed) ^ index) ^ pass);
+    }
+
+    // xoshiro256+ (Blackman & Vigna): 32 bytes of state, a handful of ALU ops per draw. The "+" variant has
+    // weak low bits, which is fine since we only keep the high 53 bits for doubles.
+    class rng {
+    public:
+        constexpr rng(): s{0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                           0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL} {}
+        explicit rng(uint64_t seed_value) { seed(seed_value); }
+
+        void seed(uint64_t seed_value) {
+            for (auto& word: s) {                                            // splitmix64 sequence, never all zero
+                word = mix64(seed_value);
+                seed_value += 0x9e3779b97f4a7c15ULL;
+            }
+        }
+
+        inline uint64_t next_u64() {
+            const uint64_t result = s[0] + s[3];
+            const uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return result;
+        }
+
+        inline double uniform() {                                            // [0, 1)
+            return static_cast<double>(next_u64() >> 11) * 0x1.0p-53;
+        }
+
+        inline double uniform(double min, double max) {                      // [min, max)
+            return min + (max - min) * uniform();
+        }
+
+        // [0, range), unbiased: Lemire's multiply-shift, redrawing the few low products that would favour some
+        // results; the threshold's division only runs in that rare case
+        inline uint32_t bounded(uint32_t range) {
+            uint64_t m = (next_u64() >> 32) * range;
+            auto low = static_cast<uint32_t>(m);
+            if (low < range) {
+                const uint32_t threshold = -range % range;                  // 2^32 mod range
+                while (low < threshold) {
+                    m = (next_u64() >> 32) * range;
+                    low = static_cast<uint32_t>(m);
+                }
+            }
+            return static_cast<uint32_t>(m >> 32);
+        }
+
+        void fill(double* out, size_t n) {                                   // batched [0, 1)
+            for (size_t i = 0; i != n; ++i)
+                out[i] = static_cast<double>(next_u64() >> 11) * 0x1.0p-53;
+        }
+
+        void fill(double* out, size_t n, double min, double max) {          // batched [min, max)
+            const double span = max - min;
+            for (size_t i = 0; i != n; ++i)
+                out[i] = min + span * (static_cast<double>(next_u64() >> 11) * 0x1.0p-53);
+        }
+
+    private:
+        uint64_t s[4];
+
+        static inline constexpr uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+    };
+
+    // One generator per thread, seeded from the OS on first use. The camera reseeds it per pixel with
+    // stream_seed(), so renders do not depend on how tiles were scheduled.
+    inline rng& thread_rng() {
+        static thread_local rng generator{(static_cast<uint64_t>(std::random_device{}()) << 32)
+                                          ^ std::random_device{}()};
+        return generator;
+    }
+}
+
+#endif //RAY_TRACING_RNG_H
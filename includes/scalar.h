@@ -0,0 +1,14 @@
+#ifndef RAY_TRACING_SCALAR_H
+#define RAY_TRACING_SCALAR_H
+
+// The scalar type of the render path: vec3, ray, interval, aabb, hit records and primitives are all built on it.
+// Define RAY_TRACING_FLOAT32 (CMake option of the same name) for a float32 build, which halves the size of rays,
+// records and boxes. Code that needs the range or precision regardless (sphere roots, bvh construction, sample
+// accumulation) uses double explicitly.
+#ifdef RAY_TRACING_FLOAT32
+using real = float;
+#else
+using real = double;
+#endif
+
+#endif //RAY_TRACING_SCALAR_H
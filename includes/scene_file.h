@@ -0,0 +1,712 @@
+#ifndef RAY_TRACING_SCENE_FILE_H
+#define RAY_TRACING_SCENE_FILE_H
+
+#include "common.h"
+#include "obj_file.h"
+#include "charconv"
+#include "cstring"
+#include "deque"
+#include "fstream"
+#include "string"
+#include "string_view"
+#include "unordered_map"
+#include "vector"
+
+// Scenes as files, so a scene change needs no recompile. A text scene is one statement per line: a keyword and
+// its arguments, separated by spaces; '#' starts a comment. Names start with a letter (so nan and inf are names),
+// numbers with a digit or '.' after an optional sign. Every statement maps onto a class of includes/:
+//
+//   camera width 600 aspect 1 spp 100 depth 100 vfov 40 from 278 278 -800 at 278 278 0 up 0 1 0
+//   camera defocus <angle> <focus distance>  exposure <t>  background <r g b> | sky  seed <n>  output <file>
+//   camera integrator recursive|iterative  light_sampling 0|1  roulette <depth>  adaptive 0|1
+//   texture <name> solid <r g b> | checker <scale> <r g b> <r g b> | checker <scale> <texture> <texture>
+//   texture <name> image <file> | noise <frequency>
+//   material <name> lambertian <r g b> | lambertian <texture> | metal <r g b> [fuzz] | dielectric <ior>
+//   material <name> diffuse_light <r g b> | diffuse_light <texture>
+//   sphere <center> <radius> <material>        sphere <center> <center at t=1> <radius> <material>
+//   quad <corner> <u> <v> <material>           box <corner> <opposite corner> <material>
+//   mesh <file.obj> <material>                 a triangle_mesh of the OBJ file's faces
+//   group <name> [list|bvh|bvh4|sphere_set] ... end     the statements between build a named object, not added
+//   instance <group> [translate <x y z>] [rotate_x|rotate_y|rotate_z <degrees>] [rotate <axis> <degrees>]
+//            [scale <x y z>] ...                         adds the group, transformed in that order
+//   medium <group> <density> <r g b> | <texture>        adds a constant_medium bounded by the group
+//   world list|bvh|bvh4                                 how the top level is put together in the end, list by default
+//
+// The binary variant (convert) holds the same statements: names are stored once in a string table, numbers in
+// the smallest of float32, a decimal and float64 that holds them exactly. Both are read in chunks, never as a
+// whole, and neither allocates per statement, so loading a scene costs little more than building its objects; for
+// millions of spheres, put them in a sphere_set group. Errors are printed with their line (text) or record
+// (binary) and make load fail.
+namespace scene_file {
+    constexpr size_t max_arguments = 64;
+    constexpr size_t chunk_size = 1 << 20;
+    constexpr char binary_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '1'};
+
+    struct argument {
+        std::string_view text;                                              // empty for a number
+        double number = 0.0;
+        [[nodiscard]] bool is_number() const { return text.empty(); }
+    };
+
+    struct statement {
+        std::string_view keyword;                                           // empty for a blank line
+        argument arguments[max_arguments];
+        size_t count = 0;
+        size_t line = 0;                                                    // or record, in a binary file
+    };
+
+    // the statements the binary format knows, its record code is the index + 1 (0 defines a string)
+    constexpr std::string_view keywords[] = {"camera", "texture", "material", "sphere", "quad", "box", "group",
+                                             "end", "instance", "medium", "world", "mesh"};
+    constexpr size_t keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+
+    namespace detail {
+        struct name_hash {
+            using is_transparent = void;
+            size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+        };
+        template<typename T>
+        using name_map = std::unordered_map<std::string, T, name_hash, std::equal_to<>>;
+
+        inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+        // a digit or '.' first, after at most one sign
+        inline bool looks_numeric(std::string_view token) {
+            if (!token.empty() && (token[0] == '+' || token[0] == '-')) token.remove_prefix(1);
+            return !token.empty() && ((token[0] >= '0' && token[0] <= '9') || token[0] == '.');
+        }
+
+        // splits one line into out; false with error for too many arguments
+        inline bool tokenize(std::string_view line, size_t number, statement& out, std::string& error) {
+            out.keyword = {};
+            out.count = 0;
+            out.line = number;
+            size_t i = 0;
+            while (true) {
+                while (i < line.size() && is_space(line[i])) ++i;
+                if (i == line.size() || line[i] == '#') return true;
+                size_t start = i;
+                while (i < line.size() && !is_space(line[i]) && line[i] != '#') ++i;
+                std::string_view token = line.substr(start, i - start);
+                if (out.keyword.empty()) {
+                    out.keyword = token;
+                    continue;
+                }
+                if (out.count == max_arguments) {
+                    error = "more than " + std::to_string(max_arguments) + " arguments";
+                    return false;
+                }
+                auto& arg = out.arguments[out.count++];
+                arg.text = token;
+                if (!looks_numeric(token)) continue;                         // nan and inf stay names
+                auto first = token.data() + (token[0] == '+');               // from_chars takes no plus sign
+                auto [end, status] = std::from_chars(first, token.data() + token.size(), arg.number);
+                if (status == std::errc() && end == token.data() + token.size()) arg.text = {};
+            }
+        }
+
+        // How a binary statement stores its numbers: decimal is a 32-bit mantissa and a power of ten to divide
+        // it by, which is one correctly rounded division, so it gives back exactly what from_chars read.
+        enum class number_encoding: uint8_t { float64, float32, decimal };
+        constexpr size_t number_size[] = {8, 4, 5};
+        constexpr double powers_of_ten[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+        inline bool to_decimal(double x, int32_t& mantissa, uint8_t& scale) {
+            for (uint8_t k = 0; k != 10; ++k) {
+                auto scaled = std::nearbyint(x * powers_of_ten[k]);
+                if (std::abs(scaled) >= 2147483648.0) return false;
+                if (scaled / powers_of_ten[k] == x) {
+                    mantissa = static_cast<int32_t>(scaled);
+                    scale = k;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Refills a buffer from a stream so that at least n bytes are available, keeping the unread ones.
+        class byte_reader {
+        public:
+            explicit byte_reader(std::istream& in): in(in), buffer(chunk_size) {}
+
+            bool need(size_t n) {
+                if (end - position >= n) return true;
+                std::memmove(buffer.data(), buffer.data() + position, end - position);
+                end -= position;
+                position = 0;
+                if (buffer.size() < n) buffer.resize(n);
+                in.read(buffer.data() + end, static_cast<std::streamsize>(buffer.size() - end));
+                end += static_cast<size_t>(in.gcount());
+                return end - position >= n;
+            }
+            [[nodiscard]] bool at_end() { return !need(1); }
+            const char* take(size_t n) {                                    // after need(n)
+                position += n;
+                return buffer.data() + position - n;
+            }
+            template<typename T>
+            T read() {                                                      // after need(sizeof(T))
+                T value;
+                std::memcpy(&value, take(sizeof(T)), sizeof(T));
+                return value;
+            }
+
+        private:
+            std::istream& in;
+            std::vector<char> buffer;
+            size_t position = 0, end = 0;
+        };
+    }
+
+    // Calls visit(const statement&) for every statement of a text scene, in order, one chunk of lines at a time.
+    // Stops when visit returns false; returns false then or on a syntax error, which is in error.
+    template<typename Visit>
+    bool for_each_text_statement(std::istream& in, Visit&& visit, std::string& error) {
+        std::vector<char> buffer(chunk_size);
+        size_t kept = 0, line = 0;
+        statement current;
+        auto parse = [&](std::string_view text) {
+            if (!detail::tokenize(text, ++line, current, error)) {
+                error = "line " + std::to_string(line) + ": " + error;
+                return false;
+            }
+            return current.keyword.empty() || visit(current);
+        };
+        while (true) {
+            in.read(buffer.data() + kept, static_cast<std::streamsize>(buffer.size() - kept));
+            size_t filled = kept + static_cast<size_t>(in.gcount());
+            bool last = !in;
+            size_t begin = 0;
+            while (auto newline = static_cast<const char*>(std::memchr(buffer.data() + begin, '\n', filled - begin))) {
+                auto end = static_cast<size_t>(newline - buffer.data());
+                if (!parse(std::string_view(buffer.data() + begin, end - begin))) return false;
+                begin = end + 1;
+            }
+            if (last) return begin == filled || parse(std::string_view(buffer.data() + begin, filled - begin));
+            kept = filled - begin;
+            std::memmove(buffer.data(), buffer.data() + begin, kept);
+            if (kept == buffer.size()) buffer.resize(buffer.size() * 2);   // a line longer than a chunk
+        }
+    }
+
+    // The same for a binary scene, after its magic.
+    template<typename Visit>
+    bool for_each_binary_statement(std::istream& in, Visit&& visit, std::string& error) {
+        detail::byte_reader reader(in);
+        std::deque<std::string> strings;                                    // a deque keeps the views valid
+        statement current;
+        for (size_t record = 1; !reader.at_end(); ++record) {
+            auto fail = [&](const char* message) {
+                error = "record " + std::to_string(record) + ": " + message;
+                return false;
+            };
+            auto code = reader.read<uint8_t>();
+            if (code == 0) {
+                if (!reader.need(2)) return fail("truncated string");
+                auto length = reader.read<uint16_t>();
+                if (!reader.need(length)) return fail("truncated string");
+                strings.emplace_back(reader.take(length), length);
+                continue;
+            }
+            if (code > keyword_count) return fail("unknown statement");
+            if (!reader.need(2)) return fail("truncated statement");
+            current.keyword = keywords[code - 1];
+            current.line = record;
+            current.count = reader.read<uint8_t>();
+            auto encoding = reader.read<uint8_t>();
+            if (encoding > 2) return fail("unknown number encoding");
+            size_t mask_bytes = (current.count + 7) / 8, size = 0;
+            if (current.count > max_arguments) return fail("too many arguments");
+            if (!reader.need(mask_bytes)) return fail("truncated statement");
+            uint8_t mask[max_arguments / 8];
+            std::memcpy(mask, reader.take(mask_bytes), mask_bytes);
+            for (size_t i = 0; i != current.count; ++i)
+                size += mask[i / 8] & (1u << (i % 8)) ? 4 : detail::number_size[encoding];
+            if (!reader.need(size)) return fail("truncated statement");
+            for (size_t i = 0; i != current.count; ++i) {
+                auto& arg = current.arguments[i];
+                if (mask[i / 8] & (1u << (i % 8))) {
+                    auto index = reader.read<uint32_t>();
+                    if (index >= strings.size()) return fail("undefined string");
+                    arg.text = strings[index];
+                } else {
+                    arg.text = {};
+                    if (encoding == 0) arg.number = reader.read<double>();
+                    else if (encoding == 1) arg.number = reader.read<float>();
+                    else {
+                        auto mantissa = reader.read<int32_t>();
+                        auto scale = reader.read<uint8_t>();
+                        if (scale >= 10) return fail("bad decimal");
+                        arg.number = mantissa / detail::powers_of_ten[scale];
+                    }
+                }
+            }
+            if (!visit(current)) return false;
+        }
+        return true;
+    }
+
+    // Builds the world and sets the camera up from statements, see the top of this file.
+    class builder {
+    public:
+        builder(hittable_list& world, camera& cam): world(world), cam(cam) {}
+
+        std::string error;                                                  // of the last apply or finish
+
+        bool apply(const statement& s) {
+            reader in{s};
+            error.clear();
+            const auto& keyword = s.keyword;
+            if (keyword == "camera") return camera_settings(in);
+            if (keyword == "texture") return define_texture(in);
+            if (keyword == "material") return define_material(in);
+            if (keyword == "sphere") return add_sphere(in);
+            if (keyword == "quad") {
+                vec3 q, u, v;
+                std::shared_ptr<material::material_base> surface;
+                if (!(in.vec(q) && in.vec(u) && in.vec(v) && material_argument(in, surface) && in.done()))
+                    return fail(in, "quad <corner> <u> <v> <material>");
+                return add(std::make_shared<primitive::quad>(world.materials(), q, u, v, surface));
+            }
+            if (keyword == "box") {
+                vec3 a, b;
+                std::shared_ptr<material::material_base> surface;
+                if (!(in.vec(a) && in.vec(b) && material_argument(in, surface) && in.done()))
+                    return fail(in, "box <corner> <opposite corner> <material>");
+                return add(instance::box(world.materials(), a, b, surface));
+            }
+            if (keyword == "mesh") {
+                std::string_view file;
+                std::shared_ptr<material::material_base> surface;
+                if (!(in.name(file) && material_argument(in, surface) && in.done()))
+                    return fail(in, "mesh <file.obj> <material>");
+                auto mesh = obj_file::load(world.materials(), std::string(file), surface);
+                if (!mesh) {
+                    error = "can't load the mesh " + std::string(file);
+                    return false;
+                }
+                return add(std::move(mesh));
+            }
+            if (keyword == "group") return open_group(in);
+            if (keyword == "end") return close_group(in);
+            if (keyword == "instance") return add_instance(in);
+            if (keyword == "medium") return add_medium(in);
+            if (keyword == "world") {
+                std::string_view kind;
+                if (!(in.name(kind) && in.done() && (kind == "list" || kind == "bvh" || kind == "bvh4")))
+                    return fail(in, "world list|bvh|bvh4");
+                world_kind = kind;
+                return true;
+            }
+            error = "unknown statement '" + std::string(keyword) + "'";
+            return false;
+        }
+
+        // puts the top level together once every statement is applied
+        bool finish() {
+            if (!groups.empty()) {
+                error = "group '" + groups.back().name + "' has no end";
+                return false;
+            }
+            if (world_kind == "bvh") world.wrap(std::make_shared<linear_bvh>(world));
+            else if (world_kind == "bvh4") world.wrap(std::make_shared<bvh4>(world));
+            return true;
+        }
+
+    private:
+        // reads a statement's arguments in order; any read that doesn't match fails, and so do the later ones
+        struct reader {
+            const statement& s;
+            size_t next = 0;
+
+            bool number(double& out) {
+                if (next == s.count || !s.arguments[next].is_number()) return false;
+                out = s.arguments[next++].number;
+                return true;
+            }
+            bool vec(vec3& out) {
+                double x, y, z;
+                if (!(number(x) && number(y) && number(z))) return false;
+                out = vec3(x, y, z);
+                return true;
+            }
+            bool name(std::string_view& out) {
+                if (next == s.count || s.arguments[next].is_number()) return false;
+                out = s.arguments[next++].text;
+                return true;
+            }
+            [[nodiscard]] bool next_is_number() const { return next != s.count && s.arguments[next].is_number(); }
+            [[nodiscard]] bool done() const { return next == s.count; }
+        };
+
+        struct group {
+            std::string name, kind;
+            hittable_list objects;
+            std::shared_ptr<primitive::sphere_set> spheres;                 // for kind sphere_set
+        };
+
+        hittable_list& world;
+        camera& cam;
+        detail::name_map<std::shared_ptr<texture::texture_base>> textures;
+        detail::name_map<std::shared_ptr<material::material_base>> materials;
+        detail::name_map<std::shared_ptr<hittable>> objects;                // closed groups
+        std::vector<group> groups;                                          // open ones, innermost last
+        std::string world_kind = "list";
+
+        bool fail(const reader& in, const char* usage) {
+            if (!error.empty()) return false;                               // an undefined name says more
+            error = "expected " + std::string(usage);
+            if (in.next < in.s.count) error += " (at argument " + std::to_string(in.next + 1) + ")";
+            return false;
+        }
+
+        bool undefined(const char* what, std::string_view name) {
+            error = std::string(what) + " '" + std::string(name) + "' is not defined";
+            return false;
+        }
+
+        bool add(std::shared_ptr<hittable> object) {
+            if (groups.empty()) {
+                world.add(std::move(object));
+                return true;
+            }
+            if (groups.back().spheres) {
+                error = "a sphere_set group holds only spheres";
+                return false;
+            }
+            groups.back().objects.add(std::move(object));
+            return true;
+        }
+
+        // a defined material's name
+        bool material_argument(reader& in, std::shared_ptr<material::material_base>& out) {
+            std::string_view name;
+            if (!in.name(name)) return false;
+            auto found = materials.find(name);
+            if (found == materials.end()) return undefined("material", name);
+            out = found->second;
+            return true;
+        }
+
+        // a color or a texture name
+        bool texture_argument(reader& in, std::shared_ptr<texture::texture_base>& out, color* solid = nullptr) {
+            if (in.next_is_number()) {
+                vec3 c;
+                if (!in.vec(c)) return false;
+                if (solid) *solid = c;
+                else out = std::make_shared<texture::solid_color>(c);
+                return true;
+            }
+            std::string_view name;
+            if (!in.name(name)) return false;
+            auto found = textures.find(name);
+            if (found == textures.end()) return undefined("texture", name);
+            out = found->second;
+            return true;
+        }
+
+        template<typename Map>
+        bool define(Map& map, std::string_view name, typename Map::mapped_type value) {
+            if (!map.try_emplace(std::string(name), std::move(value)).second) {
+                error = "'" + std::string(name) + "' is already defined";
+                return false;
+            }
+            return true;
+        }
+
+        bool camera_settings(reader& in) {
+            std::string_view key;
+            while (in.name(key)) {
+                double a, b;
+                vec3 v;
+                bool ok = true;
+                if (key == "width") { if ((ok = in.number(a))) cam.set_image_width(static_cast<int>(a)); }
+                else if (key == "aspect") { if ((ok = in.number(a))) cam.set_aspect_ratio(a); }
+                else if (key == "spp") { if ((ok = in.number(a))) cam.samples_per_pixel = static_cast<unsigned>(a); }
+                else if (key == "depth") { if ((ok = in.number(a))) cam.max_depth = static_cast<unsigned>(a); }
+                else if (key == "vfov") { if ((ok = in.number(a))) cam.vfov = a; }
+                else if (key == "from") { if ((ok = in.vec(v))) cam.lookfrom = v; }
+                else if (key == "at") { if ((ok = in.vec(v))) cam.lookat = v; }
+                else if (key == "up") { if ((ok = in.vec(v))) cam.vup = v; }
+                else if (key == "defocus") { if ((ok = in.number(a) && in.number(b))) cam.set_focus_parameter(a, b); }
+                else if (key == "exposure") { if ((ok = in.number(a))) cam.exposure_time = a; }
+                else if (key == "seed") { if ((ok = in.number(a))) cam.rng_seed = static_cast<unsigned long long>(a); }
+                else if (key == "roulette") { if ((ok = in.number(a))) cam.roulette_depth = static_cast<unsigned>(a); }
+                else if (key == "light_sampling") { if ((ok = in.number(a))) cam.light_sampling = a != 0; }
+                else if (key == "adaptive") { if ((ok = in.number(a))) cam.adaptive_sampling = a != 0; }
+                else if (key == "background") {
+                    std::string_view sky;
+                    if (in.next_is_number() ? (ok = in.vec(v)) : (ok = in.name(sky) && sky == "sky")) {
+                        if (sky.empty()) cam.background_function = [c = color(v)](double) -> color { return c; };
+                        else cam.background_function = camera().background_function;
+                    }
+                } else if (key == "integrator") {
+                    std::string_view kind;
+                    ok = in.name(kind) && (kind == "recursive" || kind == "iterative");
+                    if (ok) cam.integrator = kind == "iterative" ? camera::integrator_type::iterative
+                                                               : camera::integrator_type::recursive;
+                } else if (key == "output") {
+                    std::string_view file;
+                    if ((ok = in.name(file))) cam.set_output_file(std::string(file));
+                } else {
+                    error = "unknown camera setting '" + std::string(key) + "'";
+                    return false;
+                }
+                if (!ok) {
+                    error = "bad value for camera setting '" + std::string(key) + "'";
+                    return false;
+                }
+            }
+            if (!in.done()) return fail(in, "camera <setting> <value>...");
+            return true;
+        }
+
+        bool define_texture(reader& in) {
+            std::string_view name, kind;
+            if (!(in.name(name) && in.name(kind))) return fail(in, "texture <name> <kind> ...");
+            std::shared_ptr<texture::texture_base> texture;
+            double a;
+            vec3 c;
+            if (kind == "solid" && in.vec(c) && in.done()) {
+                texture = std::make_shared<texture::solid_color>(c);
+            } else if (kind == "checker" && in.number(a)) {
+                std::shared_ptr<texture::texture_base> odd, even;
+                if (!(texture_argument(in, odd) && texture_argument(in, even) && in.done()))
+                    return error.empty() ? fail(in, "texture <name> checker <scale> <odd> <even>") : false;
+                texture = std::make_shared<texture::checker_texture>(a, odd, even);
+            } else if (std::string_view file; kind == "image" && in.name(file) && in.done()) {
+                texture = std::make_shared<texture::image_texture>(std::string(file).c_str());
+            } else if (kind == "noise" && in.number(a) && in.done()) {
+                texture = std::make_shared<texture::noise_texture>(a);
+            } else {
+                return fail(in, "texture <name> solid|checker|image|noise ...");
+            }
+            return define(textures, name, std::move(texture));
+        }
+
+        bool define_material(reader& in) {
+            std::string_view name, kind;
+            if (!(in.name(name) && in.name(kind))) return fail(in, "material <name> <kind> ...");
+            std::shared_ptr<material::material_base> surface;
+            std::shared_ptr<texture::texture_base> texture;
+            double a = 0;
+            vec3 c;
+            if (kind == "lambertian" && texture_argument(in, texture) && in.done())
+                surface = std::make_shared<material::lambertian>(texture);
+            else if (kind == "metal" && in.vec(c) && (in.done() || in.number(a)) && in.done())
+                surface = std::make_shared<material::metal>(c, a);
+            else if (kind == "dielectric" && in.number(a) && in.done())
+                surface = std::make_shared<material::dielectric>(a);
+            else if (kind == "diffuse_light" && texture_argument(in, texture) && in.done())
+                surface = std::make_shared<material::diffuse_light>(texture);
+            else if (!error.empty()) return false;
+            else return fail(in, "material <name> lambertian|metal|dielectric|diffuse_light ...");
+            return define(materials, name, std::move(surface));
+        }
+
+        bool add_sphere(reader& in) {
+            vec3 center, center2;
+            double radius;
+            std::shared_ptr<material::material_base> surface;
+            if (!in.vec(center)) return fail(in, "sphere <center> [<center at t=1>] <radius> <material>");
+            bool moving = in.s.count - in.next == 5;
+            if (!((!moving || in.vec(center2)) && in.number(radius) && material_argument(in, surface) && in.done()))
+                return error.empty() ? fail(in, "sphere <center> [<center at t=1>] <radius> <material>") : false;
+            if (!groups.empty() && groups.back().spheres) {
+                if (moving) {
+                    error = "a sphere_set holds only spheres that stay put";
+                    return false;
+                }
+                groups.back().spheres->add(center, radius, surface);
+                return true;
+            }
+            auto& materials = world.materials();
+            if (moving) return add(std::make_shared<primitive::sphere>(materials, center, center2, radius, surface));
+            return add(std::make_shared<primitive::sphere>(materials, center, radius, surface));
+        }
+
+        bool open_group(reader& in) {
+            std::string_view name, kind = "list";
+            if (!(in.name(name) && (in.done() || in.name(kind)) && in.done()
+                  && (kind == "list" || kind == "bvh" || kind == "bvh4" || kind == "sphere_set")))
+                return fail(in, "group <name> [list|bvh|bvh4|sphere_set]");
+            auto spheres = kind == "sphere_set" ? std::make_shared<primitive::sphere_set>(world.materials()) : nullptr;
+            groups.push_back({std::string(name), std::string(kind), hittable_list(), std::move(spheres)});
+            return true;
+        }
+
+        bool close_group(reader& in) {
+            if (!in.done()) return fail(in, "end");
+            if (groups.empty()) {
+                error = "end without a group";
+                return false;
+            }
+            auto closed = std::move(groups.back());
+            groups.pop_back();
+            std::shared_ptr<hittable> object;
+            if (closed.spheres) {
+                closed.spheres->build();
+                object = closed.spheres;
+            } else if (closed.kind == "bvh") object = std::make_shared<linear_bvh>(closed.objects);
+            else if (closed.kind == "bvh4") object = std::make_shared<bvh4>(closed.objects);
+            else if (closed.objects.objects.size() == 1) object = closed.objects.objects.front();
+            else object = std::make_shared<hittable_list>(closed.objects);
+            return define(objects, closed.name, std::move(object));
+        }
+
+        bool group_argument(reader& in, std::shared_ptr<hittable>& out) {
+            std::string_view name;
+            if (!in.name(name)) return false;
+            auto found = objects.find(name);
+            if (found == objects.end()) return undefined("group", name);
+            out = found->second;
+            return true;
+        }
+
+        // the operations compose into one matrix, applied to the group in the order they are listed
+        bool add_instance(reader& in) {
+            const char* usage = "instance <group> [translate <x y z>] [rotate_x|rotate_y|rotate_z <degrees>] "
+                                "[rotate <axis x y z> <degrees>] [scale <x y z>]...";
+            std::shared_ptr<hittable> object;
+            if (!group_argument(in, object)) return fail(in, usage);
+            affine_transform to_world;
+            std::string_view operation;
+            while (in.name(operation)) {
+                double degrees;
+                vec3 v;
+                if (operation == "translate" && in.vec(v))
+                    to_world = affine_transform::translation(vec3d(v)) * to_world;
+                else if (operation.size() == 8 && operation.substr(0, 7) == "rotate_" && operation[7] >= 'x'
+                         && operation[7] <= 'z' && in.number(degrees))
+                    to_world = affine_transform::rotation(vec3d(operation[7] == 'x', operation[7] == 'y',
+                                                                operation[7] == 'z'), degrees) * to_world;
+                else if (operation == "rotate" && in.vec(v) && v.length_square() > 0 && in.number(degrees))
+                    to_world = affine_transform::rotation(vec3d(v), degrees) * to_world;
+                else if (operation == "scale" && in.vec(v))
+                    to_world = affine_transform::scaling(vec3d(v)) * to_world;
+                else return fail(in, usage);
+            }
+            if (!in.done()) return fail(in, usage);
+            return add(std::make_shared<instance::transform_instance>(object, to_world));
+        }
+
+        bool add_medium(reader& in) {
+            std::shared_ptr<hittable> boundary;
+            std::shared_ptr<texture::texture_base> texture;
+            double density;
+            color solid;
+            if (!(group_argument(in, boundary) && in.number(density) && texture_argument(in, texture, &solid)
+                  && in.done()))
+                return error.empty() ? fail(in, "medium <group> <density> <r g b>|<texture>") : false;
+            if (texture) return add(std::make_shared<constant_medium>(world.materials(), boundary, density, texture));
+            return add(std::make_shared<constant_medium>(world.materials(), boundary, density, solid));
+        }
+    };
+
+    // Applies the statements of a scene file, text or binary, to world and cam. Prints what went wrong and
+    // returns false on an error.
+    inline bool load(const std::string& filename, hittable_list& world, camera& cam) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            std::cout << "Error occurred while opening the scene file " << filename << "." << std::endl;
+            return false;
+        }
+        char magic[sizeof(binary_magic)] = {};
+        file.read(magic, sizeof(magic));
+        bool binary = file.gcount() == sizeof(magic) && std::memcmp(magic, binary_magic, sizeof(magic)) == 0;
+        if (!binary) {
+            file.clear();
+            file.seekg(0);
+        }
+        builder scene(world, cam);
+        std::string error;
+        size_t where = 0;
+        auto apply = [&](const statement& s) {
+            where = s.line;
+            return scene.apply(s);
+        };
+        bool loaded = binary ? for_each_binary_statement(file, apply, error)
+                             : for_each_text_statement(file, apply, error);
+        if (loaded) loaded = scene.finish();
+        if (!loaded) {
+            if (error.empty()) error = (binary ? "record " : "line ") + std::to_string(where) + ": " + scene.error;
+            std::cout << "Error in the scene file " << filename << ", " << error << std::endl;
+        }
+        return loaded;
+    }
+
+    // Writes the text scene text_filename as a binary scene.
+    inline bool convert(const std::string& text_filename, const std::string& binary_filename) {
+        std::ifstream in(text_filename, std::ios::binary);
+        std::ofstream out(binary_filename, std::ios::binary);
+        if (!in.is_open() || !out.is_open()) {
+            std::cout << "Error occurred while opening " << (in.is_open() ? binary_filename : text_filename) << "."
+                      << std::endl;
+            return false;
+        }
+        out.write(binary_magic, sizeof(binary_magic));
+        detail::name_map<uint32_t> indices;
+        std::vector<char> record;
+        std::string error;
+        auto write = [&](const statement& s) {
+            size_t code = 0;
+            while (code != keyword_count && keywords[code] != s.keyword) ++code;
+            if (code == keyword_count) {
+                error = "line " + std::to_string(s.line) + ": unknown statement '" + std::string(s.keyword) + "'";
+                return false;
+            }
+            bool single = true, decimal = true;                            // the smallest exact encoding
+            for (size_t i = 0; i != s.count; ++i) {
+                const auto& arg = s.arguments[i];
+                int32_t mantissa;
+                uint8_t scale;
+                if (arg.is_number() && static_cast<double>(static_cast<float>(arg.number)) != arg.number)
+                    single = false;
+                if (arg.is_number() && !detail::to_decimal(arg.number, mantissa, scale)) decimal = false;
+                if (arg.is_number() || indices.contains(arg.text)) continue;
+                if (arg.text.size() > 0xffff) {
+                    error = "line " + std::to_string(s.line) + ": name too long";
+                    return false;
+                }
+                auto length = static_cast<uint16_t>(arg.text.size());
+                out.put(0);
+                out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                out.write(arg.text.data(), length);
+                indices.emplace(std::string(arg.text), static_cast<uint32_t>(indices.size()));
+            }
+            auto encoding = single ? detail::number_encoding::float32
+                                   : decimal ? detail::number_encoding::decimal : detail::number_encoding::float64;
+            record.assign({static_cast<char>(code + 1), static_cast<char>(s.count), static_cast<char>(encoding)});
+            uint8_t mask[max_arguments / 8] = {};
+            for (size_t i = 0; i != s.count; ++i)
+                if (!s.arguments[i].is_number()) mask[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+            record.insert(record.end(), mask, mask + (s.count + 7) / 8);
+            auto append = [&](const auto& value) {
+                auto bytes = reinterpret_cast<const char*>(&value);
+                record.insert(record.end(), bytes, bytes + sizeof(value));
+            };
+            for (size_t i = 0; i != s.count; ++i) {
+                const auto& arg = s.arguments[i];
+                if (!arg.is_number()) append(indices.find(arg.text)->second);
+                else if (encoding == detail::number_encoding::float32) append(static_cast<float>(arg.number));
+                else if (encoding == detail::number_encoding::float64) append(arg.number);
+                else {
+                    int32_t mantissa;
+                    uint8_t scale;
+                    detail::to_decimal(arg.number, mantissa, scale);
+                    append(mantissa);
+                    append(scale);
+                }
+            }
+            out.write(record.data(), static_cast<std::streamsize>(record.size()));
+            return true;
+        };
+        bool converted = for_each_text_statement(in, write, error);
+        out.close();
+        if (!converted) std::cout << "Error in the scene file " << text_filename << ", " << error << std::endl;
+        else if (out.fail()) std::cout << "Error occurred while writing " << binary_filename << "." << std::endl;
+        return converted && !out.fail();
+    }
+}
+
+#endif //RAY_TRACING_SCENE_FILE_H
@@ -0,0 +1,419 @@
+#ifndef RAY_TRACING_SCENES_H
+#define RAY_TRACING_SCENES_H
+
+#include "common.h"
+#include "vector"
+
+// The scenes of main.cpp. Each fills in the world and sets the camera up (view, image size, samples, output file)
+// without rendering or initializing it, so that main.cpp renders it as it likes and rt_bench can still change the
+// image size and the sample count first.
+namespace scenes {
+    inline void sample_scene(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        // create materials
+        auto material_ground = std::make_shared<material::lambertian>(color(0.8, 0.8, 0.0));
+        auto material_center = std::make_shared<material::lambertian>(color(0.7, 0.3, 0.3));
+        auto material_left   = std::make_shared<material::lambertian>(color(0.9, 0.9, 0.9));
+        auto material_right  = std::make_shared<material::metal>(color(0.95, 0.95, 0.95), 0.0);
+        auto material_behind = std::make_shared<material::lambertian>(color(0.4, 0.9, 0.4));
+        auto material_front = std::make_shared<material::dielectric>(1.5);
+
+        // create world scene
+        world.add(std::make_shared<primitive::sphere>  // ground
+                          (materials, point3( 0.0, -100.5, -1.0), 100.0, material_ground));
+        world.add(std::make_shared<primitive::sphere>  // center1
+                          (materials, point3( 0.0,    0.5, -1.0),   0.3, material_center));
+        world.add(std::make_shared<primitive::sphere>  // left
+                          (materials, point3(-0.6,    0.0, -1.0),   0.5, material_left));
+        world.add(std::make_shared<primitive::sphere>  // right
+                          (materials, point3( 0.6,    0.0, -1.0),   0.5, material_right));
+        world.add(std::make_shared<primitive::sphere>  // behind
+                          (materials, point3(0.0, -0.3, -1.5),      0.2, material_behind));
+        world.add(std::make_shared<primitive::sphere>  // glass ball
+                          (materials, point3(-0.05, 0.0, -0.3),      0.15, material_front));
+        world.add(std::make_shared<primitive::sphere>  // hollow glass ball inner side, notice r < 0
+                          (materials, point3(-0.04, 0.02, -0.3),     -0.01, material_front));
+        world.add(std::make_shared<primitive::sphere>  // hollow glass ball inner side, notice r < 0
+                          (materials, point3(-0.07, -0.04, -0.26),     -0.01, material_front));
+        world.add(std::make_shared<primitive::sphere>  // hollow glass ball inner side, notice r < 0
+                          (materials, point3(0.04, -0.04, -0.33),     -0.01, material_front));
+
+        cam.vfov = 40;
+        cam.lookfrom = point3(-2,2,1);
+        cam.lookat   = point3(0,0,-1);
+        cam.vup      = vec3(0,1,0);
+        cam.set_camera_parameter(16.0 / 9.0, 1600);
+        cam.samples_per_pixel = 500;                                        // at most, see adaptive_sampling
+        cam.max_depth = 50;
+        cam.adaptive_sampling = true;                                       // the sky converges long before the glass
+        cam.sample_map_file = "output/output_samples.png";
+        cam.set_output_file("output/output.ppm");
+        cam.set_focus_parameter(10.0, cam.focus_test(world));
+    }
+
+    inline void fancy_scene(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        auto checker = std::make_shared<texture::checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+        world.add(std::make_shared<primitive::sphere>(materials, point3(0, -1000, 0), 1000,
+                std::make_shared<material::lambertian>(checker)));
+
+        for (int a = -11; a < 11; a++) {
+            for (int b = -11; b < 11; b++) {
+                auto choose_mat = utilities::random_double();
+                point3 center(a + 0.9*utilities::random_double(), 0.2, b + 0.9*utilities::random_double());
+
+                if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                    std::shared_ptr<material::material_base> sphere_material;
+
+                    if (choose_mat < 0.8) {
+                        // diffuse
+                        auto albedo = color::random_vec() * color::random_vec();
+                        sphere_material = std::make_shared<material::lambertian>(albedo);
+//                        auto center2 = center + vec3(0, utilities::random_double(0,.5), 0);
+//                        world.add(make_shared<primitive::sphere>(materials, center, center2, 0.2, sphere_material));
+                        world.add(make_shared<primitive::sphere>(materials, center, 0.2, sphere_material));
+                    } else if (choose_mat < 0.95) {
+                        // metal
+                        auto albedo = color::random_vec(0.5, 1);
+                        auto fuzz = utilities::random_double(0, 0.5);
+                        sphere_material = std::make_shared<material::metal>(albedo, fuzz);
+                        world.add(make_shared<primitive::sphere>(materials, center, 0.2, sphere_material));
+                    } else {
+                        // glass
+                        sphere_material = std::make_shared<material::dielectric>(1.5);
+                        world.add(make_shared<primitive::sphere>(materials, center, 0.2, sphere_material));
+                    }
+                }
+            }
+        }
+
+        auto material1 = std::make_shared<material::dielectric>(1.5);
+        world.add(make_shared<primitive::sphere>(materials, point3(0, 1, 0), 1.0, material1));
+
+        auto material2 = std::make_shared<material::lambertian>(color(0.4, 0.2, 0.1));
+        world.add(make_shared<primitive::sphere>(materials, point3(-4, 1, 0), 1.0, material2));
+
+        auto material3 = std::make_shared<material::metal>(color(0.7, 0.6, 0.5), 0.0);
+        world.add(make_shared<primitive::sphere>(materials, point3(4, 1, 0), 1.0, material3));
+
+        world.wrap(std::make_shared<linear_bvh>(world));          // use a bvh to accelerate(up tp 10x)
+
+        cam.set_camera_parameter(16.0 / 9.0, 400);
+        cam.samples_per_pixel = 500;
+        cam.max_depth         = 50;
+        cam.exposure_time = 0.0;                                                    // static scene
+
+        cam.vfov     = 20;
+        cam.lookfrom = point3(13,2,3);
+        cam.lookat   = point3(0,0,0);
+        cam.vup      = vec3(0,1,0);
+        cam.set_output_file("output/fancy.ppm");
+        cam.set_focus_parameter(0.6, 10.0);
+    }
+
+    inline void two_spheres(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        auto checker = std::make_shared<texture::checker_texture>(0.8, color(.2, .3, .1), color(.9, .9, .9));
+
+        world.add(make_shared<primitive::sphere>(materials, point3(0, -10, 0), 10,
+                std::make_shared<material::lambertian>(checker)));
+        world.add(make_shared<primitive::sphere>(materials, point3(0, 10, 0), 10,
+                std::make_shared<material::lambertian>(checker)));
+
+        cam.set_camera_parameter(16.0 / 9.0, 400);
+        cam.samples_per_pixel = 500;
+        cam.max_depth         = 50;
+        cam.exposure_time = 0.0;                                                    // static scene
+
+        cam.vfov     = 20;
+        cam.lookfrom = point3(13,2,3);
+        cam.lookat   = point3(0,0,0);
+        cam.vup      = vec3(0,1,0);
+        cam.set_output_file("fancy.ppm");
+        cam.set_focus_parameter(0.6, 10.0);
+    }
+
+    inline void earth(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        auto earth_texture = std::make_shared<texture::image_texture>("earthmap.jpg");
+        auto earth_surface = std::make_shared<material::lambertian>(earth_texture);
+        auto globe = std::make_shared<primitive::sphere>
+                (materials, point3(0,0,0), 2, earth_surface);
+        world.add(globe);
+
+        cam.set_camera_parameter(16.0 / 9.0, 400);
+        cam.samples_per_pixel = 100;
+        cam.max_depth         = 50;
+
+        cam.vfov     = 30;
+        cam.lookfrom = point3(0,0,12);
+        cam.lookat   = point3(0,0,0);
+        cam.vup      = vec3(0,1,0);
+
+        cam.set_output_file("output/earth.ppm");
+//        cam.set_focus_parameter(0.0, cam.focus_test(world));
+    }
+
+    inline void two_perlin_spheres(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        auto pertext = std::make_shared<texture::noise_texture>(4);
+        world.add(make_shared<primitive::sphere>(materials, point3(0, -1000, 0), 1000,
+                make_shared<material::lambertian>(pertext)));
+        world.add(make_shared<primitive::sphere>(materials, point3(0, 2, 0), 2,
+                make_shared<material::lambertian>(pertext)));
+
+        cam.set_camera_parameter(16.0 / 9.0, 400);
+        cam.samples_per_pixel = 100;
+        cam.max_depth         = 50;
+
+        cam.vfov     = 20;
+        cam.lookfrom = point3(13,2,3);
+        cam.lookat   = point3(0,0,0);
+        cam.vup      = vec3(0,1,0);
+
+        cam.set_output_file("output/perlin.ppm");
+        cam.set_focus_parameter(0);
+    }
+
+    inline void quads(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        // Materials
+        auto left_red     = std::make_shared<material::lambertian>(color(1.0, 0.2, 0.2));
+        auto back_green   = std::make_shared<material::lambertian>(color(0.2, 1.0, 0.2));
+        auto right_blue   = std::make_shared<material::lambertian>(color(0.2, 0.2, 1.0));
+        auto upper_orange = std::make_shared<material::lambertian>(color(1.0, 0.5, 0.0));
+        auto lower_teal   = std::make_shared<material::lambertian>(color(0.2, 0.8, 0.8));
+
+        // Quads
+        world.add(make_shared<primitive::quad>(materials, point3(-3,-2, 5), vec3(0, 0,-4), vec3(0, 4, 0), left_red));
+        world.add(make_shared<primitive::quad>(materials, point3(-2,-2, 0), vec3(4, 0, 0), vec3(0, 4, 0), back_green));
+        world.add(make_shared<primitive::quad>(materials, point3( 3,-2, 1), vec3(0, 0, 4), vec3(0, 4, 0), right_blue));
+        world.add(make_shared<primitive::quad>(materials, point3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4),
+                upper_orange));
+        world.add(make_shared<primitive::quad>(materials, point3(-2,-3, 5), vec3(4, 0, 0), vec3(0, 0,-4), lower_teal));
+
+        cam.set_camera_parameter(1.0, 400);
+        cam.samples_per_pixel = 100;
+        cam.max_depth         = 50;
+
+        cam.vfov     = 80;
+        cam.lookfrom = point3(0,0,9);
+        cam.lookat   = point3(0,0,0);
+        cam.vup      = vec3(0,1,0);
+
+        cam.set_output_file("output/quad.ppm");
+        cam.set_focus_parameter(0.0, 10.0);
+    }
+
+    inline void simple_light(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        auto pertext = std::make_shared<texture::noise_texture>(4);
+        world.add(make_shared<primitive::sphere>(materials, point3(0,-1000,0), 1000,
+                make_shared<material::lambertian>(pertext)));
+        world.add(make_shared<primitive::sphere>(materials, point3(0,2,0), 2,
+                make_shared<material::lambertian>(pertext)));
+
+        // note the color is brighter than (1, 1, 1) so that it can light up other thingss
+        auto difflight = std::make_shared<material::diffuse_light>(color(4,4,4));
+        world.add(std::make_shared<primitive::quad>(materials, point3(3,1,-2), vec3(2,0,0), vec3(0,2,0), difflight));
+        world.add(make_shared<primitive::sphere>(materials, point3(0,7,0), 2, difflight));
+
+        cam.set_camera_parameter(16.0 / 9.0, 800);
+        cam.samples_per_pixel = 100;
+        cam.max_depth         = 50;
+        cam.integrator        = camera::integrator_type::iterative;
+        cam.light_sampling    = true;                                       // small lights: sample them directly
+        cam.background_function = [](double blend_factor) -> color {
+            return color{0, 0, 0};
+        };                                                                  // dark black night...
+
+        cam.vfov     = 20;
+        cam.lookfrom = point3(26,3,6);
+        cam.lookat   = point3(0,2,0);
+        cam.vup      = vec3(0,1,0);
+
+        cam.set_focus_parameter(0.0);
+        cam.set_output_file("output/simple_light.ppm");
+    }
+
+    inline void cornell_box(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        auto red   = std::make_shared<material::lambertian>(color(.65, .05, .05));
+        auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+        auto green = std::make_shared<material::lambertian>(color(.12, .45, .15));
+        auto light = std::make_shared<material::diffuse_light>(color(15, 15, 15));
+
+        world.add(make_shared<primitive::quad>(materials, point3(555,0,0), vec3(0,555,0), vec3(0,0,555), green));
+        world.add(make_shared<primitive::quad>(materials, point3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
+        world.add(make_shared<primitive::quad>(materials, point3(343, 554, 332), vec3(-130,0,0), vec3(0,0,-105),
+                light));
+        world.add(make_shared<primitive::quad>(materials, point3(0,0,0), vec3(555,0,0), vec3(0,0,555), white));
+        world.add(make_shared<primitive::quad>(materials, point3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), white));
+        world.add(make_shared<primitive::quad>(materials, point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white));
+
+        std::shared_ptr<hittable> box1 = instance::box(materials, point3(0,0,0), point3(165,330,165), white);
+        box1 = std::make_shared<instance::rotate_y>(box1, 15);
+        box1 = std::make_shared<instance::translate>(box1, vec3(265,0,295));
+        world.add(box1);
+
+        std::shared_ptr<hittable> box2 = instance::box(materials, point3(0,0,0), point3(165,165,165), white);
+        box2 = std::make_shared<instance::rotate_y>(box2, -18);
+        box2 = std::make_shared<instance::translate>(box2, vec3(130,0,65));
+        world.add(box2);
+
+        world.wrap(std::make_shared<linear_bvh>(world));
+
+        cam.set_camera_parameter(1.0, 600);
+        cam.samples_per_pixel = 100;
+        cam.max_depth         = 100;
+        cam.integrator        = camera::integrator_type::iterative;
+        cam.light_sampling    = true;
+        cam.background_function = [](double _) -> color { return color{0, 0, 0}; };
+
+        cam.vfov     = 40;
+        cam.lookfrom = point3(278, 278, -800);
+        cam.lookat   = point3(278, 278, 0);
+        cam.vup      = vec3(0,1,0);
+
+        cam.set_output_file("output/cornell.ppm");
+        cam.set_focus_parameter(0.0);
+    }
+
+    inline void cornell_smoke(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        auto red   = std::make_shared<material::lambertian>(color(.65, .05, .05));
+        auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+        auto green = std::make_shared<material::lambertian>(color(.12, .45, .15));
+        auto light = std::make_shared<material::diffuse_light>(color(7, 7, 7));
+
+        world.add(make_shared<primitive::quad>(materials, point3(555,0,0), vec3(0,555,0), vec3(0,0,555), green));
+        world.add(make_shared<primitive::quad>(materials, point3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
+        world.add(make_shared<primitive::quad>(materials, point3(113,554,127), vec3(330,0,0), vec3(0,0,305), light));
+        world.add(make_shared<primitive::quad>(materials, point3(0,555,0), vec3(555,0,0), vec3(0,0,555), white));
+        world.add(make_shared<primitive::quad>(materials, point3(0,0,0), vec3(555,0,0), vec3(0,0,555), white));
+        world.add(make_shared<primitive::quad>(materials, point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white));
+
+        std::shared_ptr<hittable> box1 = instance::box(materials, point3(0,0,0), point3(165,330,165), white);
+        box1 = make_shared<instance::rotate_y>(box1, 15);
+        box1 = make_shared<instance::translate>(box1, vec3(265,0,295));
+
+        std::shared_ptr<hittable> box2 = instance::box(materials, point3(0,0,0), point3(165,165,165), white);
+        box2 = make_shared<instance::rotate_y>(box2, -18);
+        box2 = make_shared<instance::translate>(box2, vec3(130,0,65));
+
+        world.add(make_shared<constant_medium>(materials, box1, 0.01, color(0,0,0)));
+        world.add(make_shared<constant_medium>(materials, box2, 0.01, color(1,1,1)));
+
+        cam.set_camera_parameter(1.0, 600);
+        cam.samples_per_pixel = 50;
+        cam.max_depth         = 50;
+        cam.background_function = [](double _) -> color { return color{0, 0, 0}; };
+
+        cam.vfov     = 40;
+        cam.lookfrom = point3(278, 278, -800);
+        cam.lookat   = point3(278, 278, 0);
+        cam.vup      = vec3(0,1,0);
+        cam.set_output_file("output/cornell_smoke.ppm");
+
+        cam.set_focus_parameter(0.0);
+    }
+
+    inline void final_scene(hittable_list& world, camera& cam) {
+        auto& materials = world.materials();
+        hittable_list boxes1;
+        auto ground = std::make_shared<material::lambertian>(color(0.48, 0.83, 0.53));
+
+        int boxes_per_side = 20;
+        for (int i = 0; i < boxes_per_side; i++) {
+            for (int j = 0; j < boxes_per_side; j++) {
+                auto w = 100.0;
+                auto x0 = -1000.0 + i*w;
+                auto z0 = -1000.0 + j*w;
+                auto y0 = 0.0;
+                auto x1 = x0 + w;
+                auto y1 = 1 + sin(i + j) * 101;
+                auto z1 = z0 + w;
+
+                boxes1.add(instance::box(materials, point3(x0,y0,z0), point3(x1,y1,z1), ground));
+            }
+        }
+
+        world.add(std::make_shared<linear_bvh>(boxes1));
+
+        auto light = std::make_shared<material::diffuse_light>(color(7, 7, 7));
+        world.add(make_shared<primitive::quad>(materials, point3(123,554,147), vec3(300,0,0), vec3(0,0,265), light));
+
+        auto center1 = point3(400, 400, 200);
+        auto center2 = center1 + vec3(30,0,0);
+        auto sphere_material = std::make_shared<material::lambertian>(color(0.7, 0.3, 0.1));
+        world.add(make_shared<primitive::sphere>(materials, center1, center2, 50, sphere_material));
+
+        world.add(make_shared<primitive::sphere>(materials, point3(260, 150, 45), 50,
+                std::make_shared<material::dielectric>(1.5)));
+        world.add(make_shared<primitive::sphere>(materials,
+                point3(0, 150, 145), 50, std::make_shared<material::metal>(color(0.8, 0.8, 0.9), 1.0)
+        ));
+
+        auto boundary = std::make_shared<primitive::sphere>(materials, point3(360,150,145), 70,
+                std::make_shared<material::dielectric>(1.5));
+        world.add(boundary);
+        world.add(make_shared<constant_medium>(materials, boundary, 0.2, color(0.2, 0.4, 0.9)));
+        boundary = make_shared<primitive::sphere>(materials, point3(0,0,0), 5000,
+                std::make_shared<material::dielectric>(1.5));
+        world.add(make_shared<constant_medium>(materials, boundary, .0001, color(1,1,1)));
+
+        auto emat = make_shared<material::lambertian>(std::make_shared<texture::image_texture>("earthmap.jpg"));
+        world.add(make_shared<primitive::sphere>(materials, point3(400,200,400), 100, emat));
+        auto pertext = std::make_shared<texture::noise_texture>(0.1);
+        world.add(make_shared<primitive::sphere>(materials, point3(220,280,300), 80,
+                make_shared<material::lambertian>(pertext)));
+
+        auto boxes2 = std::make_shared<primitive::sphere_set>(materials);
+        auto white = std::make_shared<material::lambertian>(color(.73, .73, .73));
+        int ns = 1000;
+        for (int j = 0; j < ns; j++) {
+            auto linear_arrange_center = normalize(vec3(sin(j), cos(j), tan(j))) * 165.0;
+            boxes2->add(linear_arrange_center, 10, white);
+        }
+        boxes2->build();
+
+        world.add(make_shared<instance:: translate>(
+                          make_shared<instance::rotate_y>(boxes2, 15),
+                          vec3(-100,270,395)
+                  )
+        );
+
+        cam.set_camera_parameter(1.0, 800);
+        cam.samples_per_pixel = 50;
+        cam.max_depth         = 40;
+        cam.integrator        = camera::integrator_type::iterative;
+        cam.light_sampling    = true;
+        cam.background_function = [](double _) -> color { return color{0, 0, 0}; };
+
+        cam.vfov     = 40;
+        cam.lookfrom = point3(478, 278, -600);
+        cam.lookat   = point3(278, 278, 0);
+        cam.vup      = vec3(0,1,0);
+
+        cam.set_output_file("output/final/final.ppm");
+        cam.set_focus_parameter(0.0);
+        cam.checkpoint_file = "output/final/final.ckpt";                    // rerun to resume after a crash
+    }
+
+    struct entry {
+        const char* name;
+        void (*setup)(hittable_list& world, camera& cam);
+    };
+
+    // in main.cpp's switch order
+    inline const std::vector<entry>& all() {
+        static const std::vector<entry> entries = {
+                {"sample_scene", sample_scene}, {"fancy_scene", fancy_scene}, {"two_spheres", two_spheres},
+                {"earth", earth}, {"two_perlin_spheres", two_perlin_spheres}, {"quads", quads},
+                {"simple_light", simple_light}, {"cornell_box", cornell_box}, {"cornell_smoke", cornell_smoke},
+                {"final_scene", final_scene}};
+        return entries;
+    }
+}
+
+#endif //RAY_TRACING_SCENES_H
@@ -12,6 +12,7 @@
 #include "interval.h"
 #include "material.h"
 #include "aabb.h"
+#include "onb.h"
 #include "cmath"
 
 namespace primitive {
@@ -19,61 +20,165 @@ namespace primitive {
     public:
         sphere(): center1(), radius(0.0), moving_obj(false), bbox() {}
         sphere(const sphere &another) = default;
-        sphere(point3 center, double radius, const std::shared_ptr<material::material_base>& obj_material):    // stationary sphere
-                center1(std::move(center)), radius(radius), obj_material(obj_material), moving_obj(false) {
-            auto half_edge = vec3{radius, radius, radius};
-            bbox = aabb{center1 - half_edge, center1 + half_edge};
+        sphere(material::material_table& materials, const point3& center, double radius,     // stationary sphere
+               const std::shared_ptr<material::material_base>& obj_material):
+                center1(center), radius(radius), obj_material(materials.add(obj_material)),
+                emissive(obj_material->is_emissive()), moving_obj(false) {
+            auto half_edge = vec3d{radius, radius, radius};
+            bbox = aabb{point3(center1 - half_edge), point3(center1 + half_edge)};
         }
 
-        sphere(const point3 &center, const point3 &center2, double radius, const std::shared_ptr<material::material_base>& obj_material):
+        sphere(material::material_table& materials, const point3 &center, const point3 &center2, double radius,
+               const std::shared_ptr<material::material_base>& obj_material):
                 center1(center), center_moving_direction(center2 - center), radius(radius),
-                obj_material(obj_material), moving_obj(true) {
+                obj_material(materials.add(obj_material)), emissive(obj_material->is_emissive()), moving_obj(true) {
             // TODO: add bvh split here
         }
 
         bool hit(const ray& r, const interval& inter, hit_record &rec) const override {
+            RAY_TRACING_COUNT_KIND(primitive_hits, "sphere");
+            point3d center = moving_obj ? get_center(r.time()) : center1;
+            double root;
+            if (!solve(r, inter, center, radius, root)) return false;
+            rec.t = static_cast<real>(root);
+            rec.object = this;
+            return true;
+        }
+
+        void compute_surface(const ray& r, hit_record& rec) const override {
+            fill_record(r, rec.t, moving_obj ? get_center(r.time()) : center1, radius, obj_material, rec);
+        }
+
+        // Nearest root of the ray against a sphere inside inter, false if there is none. Public for sphere_set,
+        // which culls in float and solves its candidates here.
+        static bool solve(const ray& r, const interval& inter, const point3d& center, double radius, double& root) {
             // a = dir . dir = ||dir||_2^2 = 1, h_b = dir . (origin-center1), c = ||origin- center1||_2^2 - radius^2
             // h_discriminant = h_b - a*c
-            point3 center = moving_obj ? get_center(r.time()) : center1;
-            vec3 oc = r.origin() - center;
-            auto a = r.direction().length_square();         // must be +
-            auto half_b = dot(r.direction(), oc);  // if collides, must be -
+            // Solved in double even in a float32 build: half_b^2 - a*c cancels badly when the ray starts far away
+            // compared to the radius, or the radius is huge (final_scene's 5000-unit fog boundary).
+            vec3d direction(r.direction());
+            vec3d oc = vec3d(r.origin()) - center;
+            auto a = direction.length_square();             // must be +
+            auto half_b = dot(direction, oc);      // if collides, must be -
             auto c = oc.length_square() - radius * radius;  // not known, but normally it should be +
             auto discriminant = half_b * half_b - a * c;
             if (discriminant < 0) return false;
             auto sqrt_d = std::sqrt(discriminant);
-            auto root = (-half_b - sqrt_d) / a;            // first we use the smaller solution(closest hit)
-            if (!inter.surrounds(root)) {
+            root = (-half_b - sqrt_d) / a;                 // first we use the smaller solution(closest hit)
+            if (!inter.surrounds(static_cast<real>(root))) {
                 root = (-half_b + sqrt_d) / a;                     // switch to the larger solution
-                if (!inter.surrounds(root)) {
+                if (!inter.surrounds(static_cast<real>(root))) {
                     return false;                                  // if it still not work, return false
                 }
             }                                                      // now root must be within the range of t_min and t_max
-            rec.t = root;
-            rec.p = r.at(root);                                 // update the hit record
-            rec.surface_material = obj_material;
-            vec3 outward_normal = (rec.p - center) / radius;
+            return true;
+        }
+
+        static void fill_record(const ray& r, double root, const point3d& center, double radius,
+                                material::material_id surface_id, hit_record& rec) {
+            rec.t = static_cast<real>(root);
+            rec.p = r.at(rec.t);                                // update the hit record
+            rec.surface_id = surface_id;
+            auto hit_point = vec3d(r.origin()) + root * vec3d(r.direction());
+            vec3 outward_normal((hit_point - center) / radius);
             rec.set_face_normal(r, outward_normal);
             get_sphere_uv(outward_normal, rec.u, rec.v);
+        }
 
-            return true;
+        // The root finding above for all lanes at once (still in double); like hit(), a lane that hits only records
+        // t and the sphere.
+        uint32_t hit_packet(ray_packet& packet, uint32_t active, hit_record* records) const override {
+            RAY_TRACING_COUNT_KIND(primitive_hits, "sphere_packet");
+            alignas(64) double roots[ray_packet::max_size];
+            alignas(64) int found[ray_packet::max_size];
+            const double cx = center1[0], cy = center1[1], cz = center1[2];
+            const double mx = center_moving_direction[0], my = center_moving_direction[1],
+                         mz = center_moving_direction[2];
+            const double moving = moving_obj ? 1.0 : 0.0, radius_square = radius * radius;
+            const int n = packet.size;
+#pragma omp simd
+            for (int i = 0; i < n; ++i) {
+                auto ocx = packet.origin[0][i] - (cx + moving * packet.time[i] * mx);
+                auto ocy = packet.origin[1][i] - (cy + moving * packet.time[i] * my);
+                auto ocz = packet.origin[2][i] - (cz + moving * packet.time[i] * mz);
+                auto dx = packet.direction[0][i], dy = packet.direction[1][i], dz = packet.direction[2][i];
+                auto a = dx * dx + dy * dy + dz * dz;
+                auto half_b = dx * ocx + dy * ocy + dz * ocz;
+                auto c = ocx * ocx + ocy * ocy + ocz * ocz - radius_square;
+                auto discriminant = half_b * half_b - a * c;
+                auto sqrt_d = std::sqrt(discriminant > 0 ? discriminant : 0.0);
+                auto near_root = (-half_b - sqrt_d) / a, far_root = (-half_b + sqrt_d) / a;
+                auto near_t = static_cast<real>(near_root), far_t = static_cast<real>(far_root);
+                bool near_ok = near_t > packet.t_min[i] && near_t < packet.t_max[i];
+                bool far_ok = far_t > packet.t_min[i] && far_t < packet.t_max[i];
+                roots[i] = near_ok ? near_root : far_root;
+                found[i] = discriminant >= 0 && (near_ok || far_ok);
+            }
+            uint32_t hits = 0;
+            for (int i = 0; i != n; ++i) {
+                if (!found[i] || !(active & (1u << i))) continue;
+                records[i].t = static_cast<real>(roots[i]);
+                records[i].object = this;
+                packet.t_max[i] = records[i].t;
+                hits |= 1u << i;
+            }
+            return hits;
         }
 
         [[nodiscard]] aabb bounding_box() const override { return bbox; }
 
+        [[nodiscard]] aabb transformed_bounding_box(const affine_transform& to_world) const override {
+            auto bounds = to_world.sphere_box(center1, radius);
+            if (moving_obj) bounds = aabb(bounds, to_world.sphere_box(center1 + center_moving_direction, radius));
+            return bounds;
+        }
+
+        void gather_lights(std::vector<const hittable*>& lights) const override {    // moving lights aren't sampled
+            if (!moving_obj && emissive) lights.push_back(this);
+        }
+
+        // Uniform over the cone of directions from origin that hit the sphere, so the density is one over its
+        // solid angle. Nothing is sampled from inside the sphere.
+        [[nodiscard]] real pdf_value(const point3& origin, const vec3& direction) const override {
+            ray towards(origin, direction);
+            double root;
+            if (!solve(towards, interval(min_hit_distance(towards), utilities::infinity), center1, radius, root))
+                return 0;
+            auto distance_squared = (center1 - vec3d(origin)).length_square();
+            if (distance_squared <= radius * radius) return 0;
+            auto cos_theta_max = std::sqrt(1 - radius * radius / distance_squared);
+            return static_cast<real>(1 / (2 * utilities::pi * (1 - cos_theta_max)));
+        }
+
+        [[nodiscard]] vec3 random(const point3& origin) const override {
+            vec3d to_center = center1 - vec3d(origin);
+            auto distance_squared = to_center.length_square();
+            if (distance_squared <= radius * radius) return vec3(to_center);
+            double draws[2];
+            sampler::thread_rng().fill(draws, 2);
+            auto z = 1 + draws[1] * (std::sqrt(1 - radius * radius / distance_squared) - 1);
+            auto phi = 2 * utilities::pi * draws[0];
+            auto sin_theta = std::sqrt(1 - z * z);
+            onb uvw;
+            uvw.build_from_normal(vec3(to_center));
+            return uvw.local_to_global(static_cast<real>(std::cos(phi) * sin_theta),
+                                       static_cast<real>(std::sin(phi) * sin_theta), static_cast<real>(z));
+        }
+
     private:
-        point3 center1;
-        vec3 center_moving_direction;
+        point3d center1;                                                     // double, like the root solve
+        vec3d center_moving_direction;
         bool moving_obj;
         double radius;
         aabb bbox;
-        std::shared_ptr<material::material_base> obj_material;
+        material::material_id obj_material{};
+        bool emissive = false;                                              // sampled as a light
 
-        point3 get_center(double time) const {
+        point3d get_center(double time) const {
             if (!moving_obj) return center1;
             return center1 + time * center_moving_direction;      // center1 + time * (center2 - center1) interpolation
         }
-        static void get_sphere_uv(const point3& p, double& u, double& v) {
+        static void get_sphere_uv(const point3& p, real& u, real& v) {
             // p: a given point on the sphere of radius one, centered at the origin.
             // u: returned value [0,1] of angle around the Y axis from X=-1.
             // v: returned value [0,1] of angle from Y=-1 to Y=+1.
@@ -84,8 +189,8 @@ namespace primitive {
             auto theta = acos(-p.y());
             auto phi = atan2(-p.z(), p.x()) + utilities::pi;
 
-            u = phi / (2 * utilities::pi);
-            v = theta / utilities::pi;
+            u = static_cast<real>(phi / (2 * utilities::pi));
+            v = static_cast<real>(theta / utilities::pi);
         }
     };
 }
@@ -0,0 +1,204 @@
+#ifndef RAY_TRACING_SPHERE_SET_H
+#define RAY_TRACING_SPHERE_SET_H
+
+#include "hittable.h"
+#include "sphere.h"
+#include "linear_bvh.h"
+#include "bvh_builder.h"
+#include "material.h"
+#include "cstdint"
+#include "cmath"
+#include "bit"
+#include "vector"
+
+namespace primitive {
+    // Many stationary spheres as one hittable: centers and radii in SoA blocks of eight behind a linear_bvh-style
+    // tree whose leaves are whole blocks, materials as a per-sphere material table id. A leaf is culled in
+    // float, all eight spheres per loop, which the compiler turns into two SSE or one AVX instruction per step;
+    // only the surviving candidates get sphere's exact double solve, and only the closest one its surface.
+    //
+    // Usage: add() every sphere, then build() once before rendering. The materials go into the table given at
+    // construction, which must outlive the adds.
+    class sphere_set : public hittable {
+    public:
+        static constexpr uint32_t lanes = 8;                                // spheres per block
+
+        explicit sphere_set(material::material_table& materials): materials(&materials) {}
+
+        void add(const point3& center, double radius, const std::shared_ptr<material::material_base>& obj_material) {
+            pending.push_back({point3d(center), radius, materials->add(obj_material)});
+        }
+
+        // Leaves hold up to one block; the SAH prices a sphere at 1/lanes of a box test, so they fill up.
+        void build(bvh_build_options options = default_options()) {
+            nodes.clear();
+            blocks.clear();
+            spheres.clear();
+            if (pending.empty()) return;
+            options.max_leaf_size = std::min<size_t>(options.max_leaf_size, lanes);
+            bvh_builder builder(pending.size(), [this](size_t i) { return box_of(pending[i]); }, options);
+            bbox = builder.nodes[0].box;
+            nodes.reserve(builder.nodes.size());
+            auto leaf = [&](const bvh_builder::node& source) {             // every leaf starts a new block
+                auto offset = static_cast<uint32_t>(blocks.size() * lanes);
+                blocks.resize(blocks.size() + (source.count + lanes - 1) / lanes);
+                spheres.resize(blocks.size() * lanes);
+                for (uint32_t i = 0; i != source.count; ++i) {
+                    const auto& sphere = pending[builder.indices[source.start + i]];
+                    auto slot = offset + i;
+                    auto& block = blocks[slot / lanes];
+                    for (int a = 0; a != 3; ++a) block.center[a][slot % lanes] = static_cast<float>(sphere.center[a]);
+                    block.radius[slot % lanes] = static_cast<float>(sphere.radius);
+                    spheres[slot] = sphere;
+                }
+                return offset;
+            };
+            linear_bvh::linearize(builder, 0, nodes, leaf);
+            pending.clear();
+            pending.shrink_to_fit();
+        }
+
+        static bvh_build_options default_options() {
+            bvh_build_options options;
+            options.max_leaf_size = lanes;
+            options.intersection_cost = 1.0 / lanes;                       // a whole block ~ one box test
+            return options;
+        }
+
+        bool hit(const ray& r, const interval& inter, hit_record& rec) const override {
+            RAY_TRACING_COUNT_KIND(primitive_hits, "sphere_set");
+            const cull_ray query(r);
+            uint32_t best = 0;
+            real best_t = 0;
+            bool hit_any = linear_bvh::traverse(nodes, r, inter, [&](uint32_t offset, uint32_t count, interval& ray_t) {
+                bool hit_leaf = false;
+                for (uint32_t first = offset; first < offset + count; first += lanes) {
+                    auto remaining = offset + count - first;
+                    auto candidates = cull(blocks[first / lanes], query, ray_t);
+                    if (remaining < lanes) candidates &= (1u << remaining) - 1;
+                    while (candidates) {                                    // exact solve, nearest one wins
+                        auto slot = first + static_cast<uint32_t>(std::countr_zero(candidates));
+                        candidates &= candidates - 1;
+                        double root;
+                        if (sphere::solve(r, ray_t, spheres[slot].center, spheres[slot].radius, root)) {
+                            best = slot;
+                            best_t = ray_t.max = static_cast<real>(root);
+                            hit_leaf = true;
+                        }
+                    }
+                }
+                return hit_leaf;
+            });
+            if (hit_any) {
+                rec.t = best_t;
+                rec.object = this;
+                rec.primitive_id = best;
+            }
+            return hit_any;
+        }
+
+        void compute_surface(const ray& r, hit_record& rec) const override {
+            const auto& sphere = spheres[rec.primitive_id];
+            sphere::fill_record(r, rec.t, sphere.center, sphere.radius, sphere.material, rec);
+        }
+
+        [[nodiscard]] aabb bounding_box() const override { return bbox; }
+
+        [[nodiscard]] aabb transformed_bounding_box(const affine_transform& to_world) const override {
+            aabb bounds;
+            for (const auto& node: nodes)                                   // leaves, without the padding slots
+                for (uint32_t slot = node.offset; slot != node.offset + node.count; ++slot)
+                    bounds = aabb(bounds, to_world.sphere_box(spheres[slot].center, spheres[slot].radius));
+            return bounds;
+        }
+
+        [[nodiscard]] size_t sphere_count() const {
+            size_t count = 0;
+            for (const auto& node: nodes) count += node.count;
+            return count;
+        }
+        [[nodiscard]] size_t node_count() const { return nodes.size(); }
+        [[nodiscard]] size_t block_count() const { return blocks.size(); }
+        [[nodiscard]] size_t memory_bytes() const {                         // everything the set owns
+            return sizeof(*this) + nodes.size() * sizeof(linear_bvh_node) + blocks.size() * sizeof(sphere_block)
+                   + spheres.size() * sizeof(exact_sphere);
+        }
+
+    private:
+        // the float copy the cull reads, one cache line pair per block
+        struct alignas(32) sphere_block {
+            float center[3][lanes]{};                                       // [axis][lane]
+            float radius[lanes]{};
+        };
+
+        struct exact_sphere {                                               // what sphere::solve gets, per slot
+            point3d center;
+            double radius = 0.0;
+            material::material_id material = 0;
+        };
+
+        // the ray in float, plus what every lane would otherwise recompute
+        struct cull_ray {
+            float origin[3], direction[3];
+            float inv_a, inv_length, magnitude;
+
+            explicit cull_ray(const ray& r) {
+                magnitude = 0.0f;
+                float a = 0.0f;
+                for (int i = 0; i != 3; ++i) {
+                    origin[i] = static_cast<float>(r.origin()[i]);
+                    direction[i] = static_cast<float>(r.direction()[i]);
+                    magnitude += std::fabs(origin[i]);
+                    a += direction[i] * direction[i];
+                }
+                inv_a = 1.0f / a;
+                inv_length = 1.0f / std::sqrt(a);
+            }
+        };
+
+        std::vector<linear_bvh_node> nodes;
+        std::vector<sphere_block> blocks;
+        std::vector<exact_sphere> spheres;                                  // by slot, block * lanes + lane
+        std::vector<exact_sphere> pending;                                  // added, not built yet
+        material::material_table* materials;                                // where add() registers materials
+        aabb bbox;
+
+        static aabb box_of(const exact_sphere& sphere) {
+            auto half_edge = vec3d{sphere.radius, sphere.radius, sphere.radius};
+            return aabb{point3(sphere.center - half_edge), point3(sphere.center + half_edge)};
+        }
+
+        // One bit per lane whose sphere may have a root inside ray_t. The distance from the center to the ray line
+        // decides a hit, which stays accurate in float where half_b^2 - a*c would cancel. The radius and the t
+        // range are widened by far more than the float error of the coordinates involved, so a sphere the double
+        // solve would hit is never culled. No sqrt, so the loop vectorizes without -fno-math-errno.
+        static uint32_t cull(const sphere_block& block, const cull_ray& q, const interval& ray_t) {
+            alignas(32) int candidate[lanes];
+            const float t_min = static_cast<float>(ray_t.min), t_max = static_cast<float>(ray_t.max);
+#pragma omp simd
+            for (uint32_t i = 0; i < lanes; ++i) {
+                float ocx = block.center[0][i] - q.origin[0];
+                float ocy = block.center[1][i] - q.origin[1];
+                float ocz = block.center[2][i] - q.origin[2];
+                float tc = (q.direction[0] * ocx + q.direction[1] * ocy + q.direction[2] * ocz) * q.inv_a;
+                float lx = ocx - tc * q.direction[0], ly = ocy - tc * q.direction[1], lz = ocz - tc * q.direction[2];
+                float error = (std::fabs(ocx) + std::fabs(ocy) + std::fabs(ocz) + std::fabs(block.center[0][i])
+                               + std::fabs(block.center[1][i]) + std::fabs(block.center[2][i]) + q.magnitude)
+                              * 0x1.0p-18f;
+                float rc = block.radius[i] + error;
+                float h2 = (rc * rc - (lx * lx + ly * ly + lz * lz)) * q.inv_a;  // squared half chord, in t
+                float tolerance = error * q.inv_length;
+                float to_min = t_min - tolerance - tc;                     // the far root must reach t_min
+                float to_max = tc - t_max - tolerance;                     // and the near one stay below t_max
+                int reaches_min = (to_min <= 0.0f) | (h2 >= to_min * to_min);  // bitwise: no branches in the loop
+                int below_max = (to_max <= 0.0f) | (h2 >= to_max * to_max);
+                candidate[i] = (h2 >= 0.0f) & reaches_min & below_max;
+            }
+            uint32_t mask = 0;
+            for (uint32_t i = 0; i != lanes; ++i) mask |= static_cast<uint32_t>(candidate[i]) << i;
+            return mask;
+        }
+    };
+}
+
+#endif //RAY_TRACING_SPHERE_SET_H
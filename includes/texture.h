@@ -16,14 +16,14 @@ namespace texture {
     class texture_base {
     public:
         virtual ~texture_base() = default;
-        [[nodiscard]] virtual color value(double u, double v, const point3 &p) const = 0;
+        [[nodiscard]] virtual color value(real u, real v, const point3 &p) const = 0;
     };
 
     class solid_color: public texture_base {
     public:
         explicit solid_color(color val): c(std::move(val)) {}
         solid_color(double r, double g, double b): c(r, g, b) {}
-        [[nodiscard]] color value(double u, double v, const point3 &p) const override {
+        [[nodiscard]] color value(real u, real v, const point3 &p) const override {
             return c;
         }
 
@@ -38,7 +38,7 @@ namespace texture {
         checker_texture(double scale, const color &c1, const color &c2): inv_scale(1.0 / scale),
                                                                          odd_tex(std::make_shared<solid_color>(c1)), even_tex(std::make_shared<solid_color>(c2)) {}
 
-        [[nodiscard]] color value(double u, double v, const point3 &p) const override {
+        [[nodiscard]] color value(real u, real v, const point3 &p) const override {
             auto x = static_cast<int>(std::floor(p.x() * inv_scale));                          // floor for consistency
             auto y = static_cast<int>(std::floor(p.y() * inv_scale));
             auto z = static_cast<int>(std::floor(p.z() * inv_scale));
@@ -57,7 +57,7 @@ namespace texture {
         explicit image_texture(std::shared_ptr<image_object> img): img(std::move(img)) {}   // construct by obj or by name
         explicit image_texture(const char *filename): img(std::make_shared<image_object>(filename)) {}
 
-        [[nodiscard]] color value(double u, double v, const point3 &p) const override {
+        [[nodiscard]] color value(real u, real v, const point3 &p) const override {
             if (img->height() <= 0) return {0, 1, 1};               // If the image is not loaded correctly, use
             // solid cyan for debugging(universal rule).
             u = interval(0, 1).clamp(u);                        // Clamp u, v to valid range. no need to flip
@@ -78,7 +78,7 @@ namespace texture {
     public:
         noise_texture(): noise(std::make_shared<perlin>()), freq(1.0) {}
         noise_texture(double freq): noise(std::make_shared<perlin>()), freq(freq) {}
-        [[nodiscard]] color value(double u, double v, const point3 &p) const override {
+        [[nodiscard]] color value(real u, real v, const point3 &p) const override {
             auto s = freq * p;
             return color{1, 1, 1} * 0.5 * (1 + sin(s.z() + 10*noise->turbulence(s)));
         }
@@ -0,0 +1,170 @@
+#ifndef RAY_TRACING_THREAD_POOL_H
+#define RAY_TRACING_THREAD_POOL_H
+
+#include "atomic"
+#include "cassert"
+#include "condition_variable"
+#include "deque"
+#include "functional"
+#include "memory"
+#include "mutex"
+#include "thread"
+#include "vector"
+
+// A small work-stealing pool: every worker owns a deque, pops its own work from the back (LIFO, cache-warm)
+// and steals from the front of the others (FIFO, the biggest/oldest chunks) once its own deque runs dry.
+class thread_pool {
+public:
+    explicit thread_pool(unsigned int threads = 0) {
+        if (threads == 0) threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;                                       // hardware_concurrency may return 0
+        for (unsigned int i = 0; i != threads; ++i)
+            queues.emplace_back(std::make_unique<worker_queue>());
+        for (unsigned int i = 0; i != threads; ++i)
+            workers.emplace_back([this, i] { worker_loop(i); });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker: workers) worker.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    [[nodiscard]] unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    void submit(std::function<void()> task) {
+        // a worker pushes onto its own deque, everyone else spreads the tasks round-robin
+        auto target = (current_worker >= 0 && current_owner == this) ?
+                static_cast<size_t>(current_worker) : next_queue++ % queues.size();
+        pending.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);                 // lock so no worker misses the wakeup;
+            ++queued;                                                      // counted before anyone can pop it, so
+        }                                                                  // try_run's decrement never wraps
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->m);
+            queues[target]->tasks.emplace_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Block until every submitted task has finished. The caller does not idle: it runs queued tasks as well. Only
+    // for threads outside the pool: a task waiting here would count itself as unfinished forever. Inside a task,
+    // parallel_for waits for its own batch.
+    void wait() {
+        assert(running_pool != this && "thread_pool::wait() from inside one of its tasks never returns");
+        wait_until([this] { return pending.load() == 0; });
+    }
+
+    // Run body(i) for i in [0, count), one task per index, and wait for those tasks only, so a task of this pool
+    // may call it too.
+    template<typename F>
+    void parallel_for(size_t count, F&& body) {
+        std::atomic<size_t> remaining{count};
+        for (size_t i = 0; i != count; ++i) {
+            submit([this, &body, &remaining, i] {
+                body(i);
+                if (remaining.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> lock(sleep_mutex);
+                    done.notify_all();
+                }
+            });
+        }
+        wait_until([&remaining] { return remaining.load() == 0; });
+    }
+
+private:
+    struct worker_queue {
+        std::mutex m;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending{0};                                          // submitted but not finished
+    std::atomic<size_t> next_queue{0};
+    size_t queued = 0;                                                       // submitted but not started, sleep_mutex
+    bool stopping = false;                                                   // guarded by sleep_mutex
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    static inline thread_local int current_worker = -1;                     // index of the calling worker, if any
+    static inline thread_local const thread_pool* current_owner = nullptr;
+    static inline thread_local const thread_pool* running_pool = nullptr;   // whose task the thread runs, worker
+                                                                             // or a caller helping in wait()
+
+    // runs queued tasks, or sleeps briefly when there are none, until finished() holds
+    template<typename Finished>
+    void wait_until(Finished&& finished) {
+        while (!finished()) {
+            if (!try_run(current_owner == this ? current_worker : -1)) {
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                done.wait_for(lock, std::chrono::milliseconds(1), finished);
+            }
+        }
+    }
+
+    bool pop_task(int self, std::function<void()>& task) {
+        if (self >= 0) {                                                     // own deque: newest first
+            auto& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.m);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        auto n = queues.size();
+        auto start = (self >= 0) ? static_cast<size_t>(self) + 1 : 0;
+        for (size_t k = 0; k != n; ++k) {                                    // steal: oldest first
+            auto victim = (start + k) % n;
+            if (static_cast<int>(victim) == self) continue;
+            auto& other = *queues[victim];
+            std::lock_guard<std::mutex> lock(other.m);
+            if (!other.tasks.empty()) {
+                task = std::move(other.tasks.front());
+                other.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool try_run(int self) {
+        std::function<void()> task;
+        if (!pop_task(self, task)) return false;
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            --queued;
+        }
+        auto outer = running_pool;
+        running_pool = this;
+        task();
+        running_pool = outer;
+        if (pending.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            done.notify_all();
+        }
+        return true;
+    }
+
+    void worker_loop(unsigned int index) {
+        current_worker = static_cast<int>(index);
+        current_owner = this;
+        while (true) {
+            if (try_run(current_worker)) continue;
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] { return queued > 0 || stopping; });
+            if (stopping && queued == 0) return;
+        }
+    }
+};
+
+#endif //RAY_TRACING_THREAD_POOL_H
@@ -0,0 +1,215 @@
+#ifndef RAY_TRACING_TRIANGLE_MESH_H
+#define RAY_TRACING_TRIANGLE_MESH_H
+
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "bvh_builder.h"
+#include "material.h"
+#include "cstdint"
+#include "cmath"
+#include "utility"
+#include "vector"
+
+namespace primitive {
+    // An indexed triangle mesh as one hittable: vertex positions, normals and uvs are shared buffers in float,
+    // triangles are three indices into them, behind a linear_bvh-style tree whose leaves are ranges of triangles
+    // (the index buffers are reordered into leaf order, so no extra indirection). All triangles share one material.
+    //
+    // Per triangle that is 12 bytes of indices plus the vertices it shares (about half a vertex, 6 bytes, on a
+    // closed mesh) and its share of the tree; memory_bytes() has the exact figure. obj_file.h loads OBJ files.
+    class triangle_mesh : public hittable {
+    public:
+        using vec3f = basic_vec3<float>;
+        static constexpr uint32_t no_index = UINT32_MAX;                    // a corner without a normal or uv
+
+        struct uv {
+            float u, v;
+        };
+
+        // What the constructor takes over. Every index must be in range; normal_indices and uv_indices are either
+        // empty or hold three entries per triangle like indices, no_index where a corner has none.
+        struct buffers {
+            std::vector<vec3f> positions, normals;
+            std::vector<uv> uvs;
+            std::vector<uint32_t> indices, normal_indices, uv_indices;
+        };
+
+        triangle_mesh(material::material_table& materials, buffers mesh,
+                      const std::shared_ptr<material::material_base>& obj_material,
+                      const bvh_build_options& options = default_options()):
+                      data(std::move(mesh)), obj_material(materials.add(obj_material)) {
+            build(options);
+        }
+
+        static bvh_build_options default_options() {
+            bvh_build_options options;
+            options.max_leaf_size = 8;
+            return options;
+        }
+
+        bool hit(const ray& r, const interval& inter, hit_record& rec) const override {
+            RAY_TRACING_COUNT_KIND(primitive_hits, "triangle_mesh");
+            const sheared_ray query(r);
+            uint32_t best = 0;
+            real best_t = 0;
+            double best_u = 0.0, best_v = 0.0;
+            bool hit_any = linear_bvh::traverse(nodes, r, inter, [&](uint32_t offset, uint32_t count, interval& ray_t) {
+                bool hit_leaf = false;
+                for (uint32_t i = offset; i != offset + count; ++i) {
+                    double t, u, v;
+                    if (intersect(query, i, ray_t, t, u, v)) {
+                        best = i;
+                        best_u = u, best_v = v;
+                        best_t = ray_t.max = static_cast<real>(t);
+                        hit_leaf = true;
+                    }
+                }
+                return hit_leaf;
+            });
+            if (hit_any) {
+                rec.t = best_t;
+                rec.object = this;
+                rec.primitive_id = best;
+                rec.u = static_cast<real>(best_u);                          // barycentrics of the second and the
+                rec.v = static_cast<real>(best_v);                          // third corner, until compute_surface
+            }
+            return hit_any;
+        }
+
+        // The geometric normal decides front_face, the interpolated one (if the mesh has normals) shades.
+        // Texture coordinates are interpolated from the uvs, or are the barycentrics if there are none.
+        void compute_surface(const ray& r, hit_record& rec) const override {
+            const auto corner = 3 * static_cast<size_t>(rec.primitive_id);
+            const auto b1 = rec.u, b2 = rec.v, b0 = 1 - b1 - b2;
+            const auto& p0 = data.positions[data.indices[corner]];
+            const auto& p1 = data.positions[data.indices[corner + 1]];
+            const auto& p2 = data.positions[data.indices[corner + 2]];
+            rec.p = r.at(rec.t);
+            rec.surface_id = obj_material;
+            rec.set_face_normal(r, normalize(cross(vec3(p1 - p0), vec3(p2 - p0))));
+            if (!data.normal_indices.empty() && data.normal_indices[corner] != no_index
+                && data.normal_indices[corner + 1] != no_index && data.normal_indices[corner + 2] != no_index) {
+                auto shading = b0 * vec3(data.normals[data.normal_indices[corner]])
+                               + b1 * vec3(data.normals[data.normal_indices[corner + 1]])
+                               + b2 * vec3(data.normals[data.normal_indices[corner + 2]]);
+                if (shading.length_square() > 0) rec.normal = rec.front_face ? normalize(shading) : -normalize(shading);
+            }
+            if (!data.uv_indices.empty() && data.uv_indices[corner] != no_index
+                && data.uv_indices[corner + 1] != no_index && data.uv_indices[corner + 2] != no_index) {
+                const auto& t0 = data.uvs[data.uv_indices[corner]];
+                const auto& t1 = data.uvs[data.uv_indices[corner + 1]];
+                const auto& t2 = data.uvs[data.uv_indices[corner + 2]];
+                rec.u = b0 * t0.u + b1 * t1.u + b2 * t2.u;
+                rec.v = b0 * t0.v + b1 * t1.v + b2 * t2.v;
+            }
+        }
+
+        [[nodiscard]] aabb bounding_box() const override { return bbox; }
+
+        [[nodiscard]] aabb transformed_bounding_box(const affine_transform& to_world) const override {
+            point3d lo(utilities::infinity), hi(-utilities::infinity);
+            for (const auto& position: data.positions) {
+                auto p = to_world.point(point3d(position));
+                for (int a = 0; a != 3; ++a) {
+                    lo[a] = std::min(lo[a], p[a]);
+                    hi[a] = std::max(hi[a], p[a]);
+                }
+            }
+            return data.positions.empty() ? aabb() : affine_transform::outward(lo, hi).pad();
+        }
+
+        [[nodiscard]] size_t triangle_count() const { return data.indices.size() / 3; }
+        [[nodiscard]] size_t vertex_count() const { return data.positions.size(); }
+        [[nodiscard]] size_t node_count() const { return nodes.size(); }
+        [[nodiscard]] size_t memory_bytes() const {                         // everything the mesh owns
+            return sizeof(*this) + nodes.size() * sizeof(linear_bvh_node)
+                   + (data.positions.size() + data.normals.size()) * sizeof(vec3f) + data.uvs.size() * sizeof(uv)
+                   + (data.indices.size() + data.normal_indices.size() + data.uv_indices.size()) * sizeof(uint32_t);
+        }
+
+    private:
+        // The ray in the watertight test's frame (Woop, Benthin and Wald 2013): the axis the direction is longest
+        // on becomes z, and a shear turns the direction into (0, 0, 1), so a triangle is hit where its projection
+        // onto the xy plane contains the origin.
+        struct sheared_ray {
+            point3d origin;
+            int kx, ky, kz;
+            double sx, sy, sz;
+
+            explicit sheared_ray(const ray& r): origin(r.origin()) {
+                vec3d d(r.direction());
+                kz = std::fabs(d[0]) > std::fabs(d[1]) ? (std::fabs(d[0]) > std::fabs(d[2]) ? 0 : 2)
+                                                       : (std::fabs(d[1]) > std::fabs(d[2]) ? 1 : 2);
+                kx = (kz + 1) % 3;
+                ky = (kx + 1) % 3;
+                if (d[kz] < 0) std::swap(kx, ky);                          // keeps the winding
+                sx = d[kx] / d[kz];
+                sy = d[ky] / d[kz];
+                sz = 1.0 / d[kz];
+            }
+        };
+
+        buffers data;
+        material::material_id obj_material;
+        std::vector<linear_bvh_node> nodes;
+        aabb bbox;
+
+        // In double, on float vertices: the edge functions of neighbouring triangles are computed from the same
+        // sheared vertices, so a ray through a shared edge or vertex never slips between them. An edge function of
+        // exactly 0 counts as inside, so such a ray may hit both, and the nearer (or the first) one wins.
+        bool intersect(const sheared_ray& q, uint32_t triangle, const interval& ray_t,
+                       double& t, double& u, double& v) const {
+            const auto corner = 3 * static_cast<size_t>(triangle);
+            auto a = vec3d(data.positions[data.indices[corner]]) - q.origin;
+            auto b = vec3d(data.positions[data.indices[corner + 1]]) - q.origin;
+            auto c = vec3d(data.positions[data.indices[corner + 2]]) - q.origin;
+            const double ax = a[q.kx] - q.sx * a[q.kz], ay = a[q.ky] - q.sy * a[q.kz];
+            const double bx = b[q.kx] - q.sx * b[q.kz], by = b[q.ky] - q.sy * b[q.kz];
+            const double cx = c[q.kx] - q.sx * c[q.kz], cy = c[q.ky] - q.sy * c[q.kz];
+            const double e0 = cx * by - cy * bx, e1 = ax * cy - ay * cx, e2 = bx * ay - by * ax;
+            if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0)) return false;
+            const double determinant = e0 + e1 + e2;
+            if (determinant == 0) return false;                              // seen edge-on
+            const double scaled_t = (e0 * a[q.kz] + e1 * b[q.kz] + e2 * c[q.kz]) * q.sz;
+            t = scaled_t / determinant;
+            if (!(t > ray_t.min && t < ray_t.max)) return false;
+            u = e1 / determinant;
+            v = e2 / determinant;
+            return true;
+        }
+
+        aabb triangle_box(size_t triangle) const {
+            const auto corner = 3 * triangle;
+            aabb box(point3(data.positions[data.indices[corner]]), point3(data.positions[data.indices[corner + 1]]));
+            return aabb(box, aabb(point3(data.positions[data.indices[corner + 2]]),
+                                  point3(data.positions[data.indices[corner + 2]])));
+        }
+
+        // Reorders the index buffers so every leaf is a contiguous range of triangles, then flattens the tree.
+        void build(bvh_build_options options) {
+            auto count = data.indices.size() / 3;
+            data.indices.resize(3 * count);
+            if (data.normal_indices.size() != data.indices.size()) data.normal_indices.clear();
+            if (data.uv_indices.size() != data.indices.size()) data.uv_indices.clear();
+            if (count == 0) return;
+            options.max_leaf_size = std::min<size_t>(options.max_leaf_size, UINT16_MAX);
+            bvh_builder builder(count, [this](size_t i) { return triangle_box(i); }, options);
+            bbox = builder.nodes[0].box.pad();
+            auto reorder = [&](std::vector<uint32_t>& corners) {
+                if (corners.empty()) return;
+                std::vector<uint32_t> ordered(corners.size());
+                for (size_t i = 0; i != count; ++i)
+                    for (size_t k = 0; k != 3; ++k) ordered[3 * i + k] = corners[3 * builder.indices[i] + k];
+                corners.swap(ordered);
+            };
+            reorder(data.indices);
+            reorder(data.normal_indices);
+            reorder(data.uv_indices);
+            nodes.reserve(builder.nodes.size());
+            auto leaf = [](const bvh_builder::node& source) { return source.start; };
+            linear_bvh::linearize(builder, 0, nodes, leaf);
+        }
+    };
+}
+
+#endif //RAY_TRACING_TRIANGLE_MESH_H
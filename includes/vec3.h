@@ -4,22 +4,32 @@
 #include "iostream"
 #include "cmath"
 #include "vector"
+#include "type_traits"
+#include "scalar.h"
 #include "utilities.h"
 
-class vec3 {
+// T is the scalar type, see scalar.h: vec3 is basic_vec3<real>, vec3d always double.
+template<typename T>
+class basic_vec3 {
 public:
-    double e[3];
-
-    vec3(): e{0, 0, 0} {}
-    vec3(double e1, double e2, double e3): e{e1, e2, e3} {}
-    explicit vec3(double val): e{val, val, val} {}              // support for broadcasting
+    using value_type = T;
+    T e[3];
+
+    basic_vec3(): e{0, 0, 0} {}
+    template<typename A, typename B, typename C,                        // any arithmetic arguments, converted here
+             typename = std::enable_if_t<std::is_arithmetic_v<A> && std::is_arithmetic_v<B> && std::is_arithmetic_v<C>>>
+    basic_vec3(A e1, B e2, C e3): e{static_cast<T>(e1), static_cast<T>(e2), static_cast<T>(e3)} {}
+    explicit basic_vec3(T val): e{val, val, val} {}              // support for broadcasting
+    template<typename U, typename = std::enable_if_t<!std::is_same_v<T, U>>>
+    explicit basic_vec3(const basic_vec3<U>& other):             // precision change, always explicit
+            e{static_cast<T>(other.e[0]), static_cast<T>(other.e[1]), static_cast<T>(other.e[2])} {}
 
     // this is a copy constructor
-    vec3(const vec3 &rhs): e{rhs.e[0], rhs.e[1], rhs.e[2]} {}
+    basic_vec3(const basic_vec3 &rhs): e{rhs.e[0], rhs.e[1], rhs.e[2]} {}
     // this is a move constructor
-    vec3(const vec3 &&rhs) noexcept : e{rhs.e[0], rhs.e[1], rhs.e[2]} {}
+    basic_vec3(const basic_vec3 &&rhs) noexcept : e{rhs.e[0], rhs.e[1], rhs.e[2]} {}
     // assignment operator
-    vec3& operator=(const vec3 &rhs) {
+    basic_vec3& operator=(const basic_vec3 &rhs) {
         if (this != &rhs) {
             e[0] = rhs.e[0];
             e[1] = rhs.e[1];
@@ -28,27 +38,27 @@ public:
         return *this;
     }
 
-    [[nodiscard]] double x() const { return e[0]; }                       // for const ones, return value copy
-    [[nodiscard]] double y() const { return e[1]; }
-    [[nodiscard]] double z() const { return e[2]; }
+    [[nodiscard]] T x() const { return e[0]; }                       // for const ones, return value copy
+    [[nodiscard]] T y() const { return e[1]; }
+    [[nodiscard]] T z() const { return e[2]; }
 
-    [[nodiscard]] double& x() { return e[0]; }                            // for none-const ones, return reference
-    [[nodiscard]] double& y() { return e[1]; }
-    [[nodiscard]] double& z() { return e[2]; }
+    [[nodiscard]] T& x() { return e[0]; }                            // for none-const ones, return reference
+    [[nodiscard]] T& y() { return e[1]; }
+    [[nodiscard]] T& z() { return e[2]; }
 
-    vec3 operator-() const { return {-e[0], -e[1], -e[2]}; } // negative
-    double operator[](int i) const { return e[i]; }                     // subscript(const version, always returns copy)
+    basic_vec3 operator-() const { return {-e[0], -e[1], -e[2]}; } // negative
+    T operator[](int i) const { return e[i]; }                     // subscript(const version, always returns copy)
     // subscript(none-const version, returns reference, a reference can be modified, so shouldn't be a const)
-    double& operator[](int i) { return e[i]; }
+    T& operator[](int i) { return e[i]; }
 
-    vec3& operator += (const vec3 &rhs) {
+    basic_vec3& operator += (const basic_vec3 &rhs) {
         e[0] += rhs[0];
         e[1] += rhs[1];
         e[2] += rhs[2];
         return *this;
     }
 
-    vec3& operator -= (const vec3 &rhs) {
+    basic_vec3& operator -= (const basic_vec3 &rhs) {
         e[0] -= rhs[0];
         e[1] -= rhs[1];
         e[2] -= rhs[2];
@@ -57,29 +67,29 @@ public:
 
     // To be mentioned, we must use const reference here, c++ will not allow lhs(non-const) reference
     //   to be bound to a temporary object
-    vec3& operator *= (const vec3 &rhs) {
+    basic_vec3& operator *= (const basic_vec3 &rhs) {
         e[0] *= rhs[0];
         e[1] *= rhs[1];
         e[2] *= rhs[2];
         return *this;
     }
 
-    vec3& operator *=(const double t) {
+    basic_vec3& operator *=(const T t) {
         e[0] *= t;
         e[1] *= t;
         e[2] *= t;
         return *this;
     }
 
-    vec3& operator /= (const double t) {
+    basic_vec3& operator /= (const T t) {
         return (*this *= 1/t);
     }
 
-    [[nodiscard]] double length_square() const {
+    [[nodiscard]] T length_square() const {
         return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
     }
 
-    [[nodiscard]] double length() const {
+    [[nodiscard]] T length() const {
         return std::sqrt(this->length_square());
     }
 
@@ -88,127 +98,142 @@ public:
     }
 
     [[nodiscard]] bool near_zero() const {
-        auto s = 1e-8;
-        return (fabs(e[0]) < s) && (fabs(e[1]) < s) && (fabs(e[2]) < s);
+        auto s = T(1e-8);
+        return (std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
     }
 
-    static inline vec3 random_vec() {
-        return {utilities::random_double(), utilities::random_double(), utilities::random_double()};
+    static inline basic_vec3 random_vec() {
+        double draws[3];
+        sampler::thread_rng().fill(draws, 3);                          // one batched draw for all components
+        return {draws[0], draws[1], draws[2]};
     }
 
-    static inline vec3 random_vec(double min, double max) {
-        return {utilities::random_double(min, max), utilities::random_double(min, max),
-                                                        utilities::random_double(min, max)};
+    static inline basic_vec3 random_vec(double min, double max) {
+        double draws[3];
+        sampler::thread_rng().fill(draws, 3, min, max);
+        return {draws[0], draws[1], draws[2]};
     }
 
-    static inline vec3 random_unit_vec_on_sphere() {
-        double a = utilities::random_double(0, 2 * utilities::pi);
-        double z = utilities::random_double(-1, 1);
-        double r = std::sqrt(1 - z * z);
+    static inline basic_vec3 random_unit_vec_on_sphere() {
+        auto& rng = sampler::thread_rng();
+        T a = static_cast<T>(rng.uniform(0, 2 * utilities::pi));
+        T z = static_cast<T>(rng.uniform(-1, 1));
+        T r = std::sqrt(1 - z * z);
         return {r * std::cos(a), r * std::sin(a), z};
     }
 
-    static inline vec3 random_unit_vec_on_hemisphere(const vec3 &normal) {
-        vec3 random_vec = random_unit_vec_on_sphere();
+    static inline basic_vec3 random_unit_vec_on_hemisphere(const basic_vec3 &normal) {
+        basic_vec3 random_vec = random_unit_vec_on_sphere();
         if (dot(random_vec, normal) > 0.0) {
             return random_vec;
         } else {
             return -random_vec;
         }
     }
-
-    friend std::ostream& operator <<(std::ostream &out, const vec3 &val);
-    friend vec3 operator + (const vec3 &lhs, const vec3 &rhs);
-    friend vec3 operator - (const vec3 &lhs, const vec3 &rhs);
-    friend vec3 operator * (const vec3 &lhs, const vec3 &rhs);
-    friend vec3 operator / (const vec3 &lhs, double t);
-    friend double dot(const vec3 &lhs, const vec3 &rhs);
-    friend vec3 cross(const vec3 &lhs, const vec3 &rhs);
-    friend vec3 normalize(const vec3 &val);
-    friend vec3 reflect(const vec3 &val, const vec3 &normal);
-    friend vec3 refract(const vec3& val, const vec3 &normal, const double etai_over_etat);
 };
 
+using vec3 = basic_vec3<real>;
 using point3 = vec3;
+using vec3d = basic_vec3<double>;                                      // for the few places that need double
+using point3d = vec3d;                                                 // whatever real is
+
+// The scalar of a vec3 operation is a non-deduced context: 2 * v and v * 0.5 work for float vectors too.
+template<typename T>
+using vec3_scalar = std::type_identity_t<T>;
 
 // inline instead of constexpr because constexpr requires compilers to calculate the return value when compiling
 // but compiler cannot calculate stream
-inline std::ostream& operator <<(std::ostream &out, const vec3 &val) {
+template<typename T>
+inline std::ostream& operator <<(std::ostream &out, const basic_vec3<T> &val) {
     return out << val[0] << ' ' << val[1] << ' ' << val[2];
 }
 
-inline vec3 operator + (const vec3 &lhs, const vec3 &rhs) {
+template<typename T>
+inline basic_vec3<T> operator + (const basic_vec3<T> &lhs, const basic_vec3<T> &rhs) {
     return {lhs[0] + rhs[0], lhs[1] + rhs[1], lhs[2] + rhs[2]};
 }
 
-inline vec3 operator - (const vec3 &lhs, const vec3 &rhs) {
+template<typename T>
+inline basic_vec3<T> operator - (const basic_vec3<T> &lhs, const basic_vec3<T> &rhs) {
     return {lhs[0] - rhs[0], lhs[1] - rhs[1], lhs[2] - rhs[2]};
 }
 
-inline vec3 operator * (const vec3 &lhs, const vec3 &rhs) {
+template<typename T>
+inline basic_vec3<T> operator * (const basic_vec3<T> &lhs, const basic_vec3<T> &rhs) {
     return {lhs[0] * rhs[0], lhs[1] * rhs[1], lhs[2] * rhs[2]};
 }
 
-inline vec3 operator * (const double &t, const vec3 &rhs) {
+template<typename T>
+inline basic_vec3<T> operator * (const vec3_scalar<T> &t, const basic_vec3<T> &rhs) {
     return {t * rhs[0], t * rhs[1], t * rhs[2]};
 }
 
-inline vec3 operator * (const vec3 &lhs, const double &t) {
+template<typename T>
+inline basic_vec3<T> operator * (const basic_vec3<T> &lhs, const vec3_scalar<T> &t) {
     return {t * lhs[0], t * lhs[1], t * lhs[2]};
 }
 
-inline vec3 operator / (const vec3 &lhs, double t) {
+template<typename T>
+inline basic_vec3<T> operator / (const basic_vec3<T> &lhs, vec3_scalar<T> t) {
     return {lhs[0] / t, lhs[1] / t, lhs[2] / t};
 }
 
-inline double dot(const vec3 &lhs, const vec3 &rhs) {
+template<typename T>
+inline T dot(const basic_vec3<T> &lhs, const basic_vec3<T> &rhs) {
     return lhs[0] * rhs[0] + lhs[1] * rhs[1] + lhs[2] * rhs[2];
 }
 
-inline vec3 cross(const vec3 &lhs, const vec3 &rhs) {
+template<typename T>
+inline basic_vec3<T> cross(const basic_vec3<T> &lhs, const basic_vec3<T> &rhs) {
     return {lhs[1] * rhs[2] - lhs[2] * rhs[1],
             lhs[2] * rhs[0] - lhs[0] * rhs[2],
             lhs[0] * rhs[1] - lhs[1] * rhs[0]};
 }
 
-inline vec3 normalize(const vec3 &val) {
+template<typename T>
+inline basic_vec3<T> normalize(const basic_vec3<T> &val) {
     return val / val.length();
 }
 
 /*
  * We require that both val and normal to be unit vectors
  */
-inline vec3 reflect(const vec3 &val, const vec3 &normal) {
+template<typename T>
+inline basic_vec3<T> reflect(const basic_vec3<T> &val, const basic_vec3<T> &normal) {
     return val - 2 * dot(val, normal) * normal;
 }
 
 /*
  * We require that both val and normal to be unit vectors
  */
-inline vec3 refract(const vec3& val, const vec3 &normal, const double etai_over_etat) {
-    auto cos_theta = fmin(dot(-val, normal), 1.0);              // TODO: why fmin?
-    vec3 out_perp = etai_over_etat * (val + cos_theta * normal);
-    vec3 out_para = -std::sqrt(1.0 - out_perp.length_square()) * normal;
+template<typename T>
+inline basic_vec3<T> refract(const basic_vec3<T>& val, const basic_vec3<T> &normal, const vec3_scalar<T> etai_over_etat) {
+    auto cos_theta = std::fmin(dot(-val, normal), T(1.0));              // TODO: why fmin?
+    basic_vec3<T> out_perp = etai_over_etat * (val + cos_theta * normal);
+    basic_vec3<T> out_para = -std::sqrt(T(1.0) - out_perp.length_square()) * normal;
     return out_perp + out_para;
 }
 
 inline vec3 random_in_unit_disk() {
+    auto& rng = sampler::thread_rng();
     while (true) {
-        auto p = vec3(utilities::random_double(-1,1), utilities::random_double(-1,1), 0);
+        double xy[2];
+        rng.fill(xy, 2, -1, 1);
+        auto p = vec3(xy[0], xy[1], 0);
         if (p.length_square() < 1)
             return p;
     }
 }
 
 inline vec3 random_vec(double min, double max) {
-    return {utilities::random_double(min, max), utilities::random_double(min, max),
-            utilities::random_double(min, max)};
+    return vec3::random_vec(min, max);
 }
 
 // cosine-weighted hemisphere sampling
 inline vec3 random_cosine_direction() {
-    auto r1 = utilities::random_double();
-    auto r2 = utilities::random_double();
+    auto& rng = sampler::thread_rng();
+    auto r1 = rng.uniform();
+    auto r2 = rng.uniform();
 
     auto phi = 2*utilities::pi*r1;
     auto x = cos(phi)*sqrt(r2);
@@ -219,7 +244,7 @@ inline vec3 random_cosine_direction() {
 }
 
 using normalize_func = vec3 (*) (const vec3&);
-normalize_func unit_vector = normalize;
+normalize_func unit_vector = normalize<real>;
 
 //namespace utilities {
 //    inline void get_sphere_uv(const vec3& p, double& u, double& v) {
@@ -244,7 +269,7 @@ namespace unit_test {
 //    v1 -= v2;
         vec3 v3 = 3 * v1;
         std::cout << v3 << std::endl;
-        std::cout << reflect(normalize({1, -1, 0}), {0, 1, 0}) << std::endl;
+        std::cout << reflect(normalize(vec3{1, -1, 0}), vec3{0, 1, 0}) << std::endl;
     }
 }
 
@@ -14,15 +14,19 @@ namespace material::volume {
     public:
         explicit isotropic(std::shared_ptr<texture::texture_base> texture) : texture(std::move(texture)) {}
         explicit isotropic(const color &c) : texture(std::make_shared<texture::solid_color>(c)) {}
-        bool scatter(const ray &in, const hit_record &rec, color &attenuation, ray &out, double& pdf) const override {
-            out = ray {rec.p, vec3::random_unit_vec_on_sphere(), in.time()};
+        bool scatter(const ray &in, const hit_record &rec, color &attenuation, ray &out, real& pdf) const override {
+            RAY_TRACING_COUNT_KIND(scatters, "isotropic");
+            out = ray {rec.p, vec3::random_unit_vec_on_sphere(), in.time(), ray::keep_direction};
             attenuation = texture->value(rec.u, rec.v, rec.p);
             pdf = 1 / (4 * utilities::pi);
             return true;
         }
-        [[nodiscard]] double scattering_pdf(const ray& in, const hit_record& rec, const ray& scattered) const override{
+        [[nodiscard]] real scattering_pdf(const ray& in, const hit_record& rec, const ray& scattered) const override{
             return 1 / (4 * utilities::pi);
         }
+        [[nodiscard]] color albedo(const hit_record& rec) const override {
+            return texture->value(rec.u, rec.v, rec.p);
+        }
 
     private:
         std::shared_ptr<texture::texture_base> texture;
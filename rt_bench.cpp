@@ -0,0 +1,173 @@
+/*
+ * Renders every scene of main.cpp (includes/scenes.h) with one seed, image width and sample count, several times
+ * each, and writes build time, render time and rays per second of every scene as JSON, to compare builds.
+ * Usage: rt_bench [out.json] [width] [samples_per_pixel] [runs] [scene]
+ */
+
+#include "iostream"
+#include "fstream"
+#include "chrono"
+#include "cmath"
+#include "cstdio"
+#include "string"
+#include "vector"
+#include "algorithm"
+#include "thread"
+#include "./includes/common.h"
+#include "./includes/scenes.h"
+
+namespace rt_bench {
+    using clock = std::chrono::high_resolution_clock;
+
+    struct settings {
+        std::string output = "rt_bench.json";
+        int width = 256;                                                    // each scene keeps its aspect ratio
+        unsigned int samples_per_pixel = 16;
+        unsigned int runs = 5;
+        unsigned long long seed = 1;                                        // of the camera, and of random worlds
+        std::string scene;                                                  // empty: all of them
+    };
+
+    struct scene_result {
+        std::string name;
+        std::vector<double> build_ms, render_ms;                            // one per run
+        std::vector<double> primary_mrays, total_mrays;                     // per second of render_ms
+        uint64_t primary_rays = 0, total_rays = 0;                          // of the last run
+        render_stats::counters statistics{};                                // of the last run, RAY_TRACING_STATS
+    };
+
+    double milliseconds(clock::time_point start, clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // A run builds the scene anew (world, BVHs, camera) and renders it once. The render time includes writing
+    // the image, which at these sizes is far below a millisecond.
+    scene_result run(const scenes::entry& scene, const settings& setting) {
+        scene_result result;
+        result.name = scene.name;
+        const char* image = "rt_bench_image.ppm";
+        for (unsigned int i = 0; i != setting.runs; ++i) {
+            sampler::thread_rng().seed(setting.seed);                      // fancy_scene's spheres are random
+            hittable_list world;
+            camera cam;
+            auto start = clock::now();
+            scene.setup(world, cam);
+            auto built = clock::now();
+
+            cam.set_image_width(setting.width);
+            cam.samples_per_pixel = setting.samples_per_pixel;
+            cam.adaptive_sampling = false;                                 // every scene gets every sample
+            cam.rng_seed = setting.seed;
+            cam.print_progress = false;
+            cam.sample_map_file.clear();
+            cam.checkpoint_file.clear();
+            cam.set_output_file(image);
+            auto render_start = clock::now();
+            cam.render(world);
+            auto end = clock::now();
+
+            auto render_ms = milliseconds(render_start, end);
+            result.build_ms.push_back(milliseconds(start, built));
+            result.render_ms.push_back(render_ms);
+            result.primary_rays = cam.camera_rays();
+            result.total_rays = cam.rays_traced();
+            result.statistics = cam.statistics();
+            result.primary_mrays.push_back(static_cast<double>(result.primary_rays) / render_ms / 1000.0);
+            result.total_mrays.push_back(static_cast<double>(result.total_rays) / render_ms / 1000.0);
+        }
+        std::remove(image);
+        return result;
+    }
+
+    // "name": {"mean": .., "min": .., "max": .., "stddev": .., "runs": [..]}
+    void write_spread(std::ostream& out, const char* name, const std::vector<double>& values) {
+        double mean = 0.0, variance = 0.0;
+        for (auto value: values) mean += value;
+        mean /= static_cast<double>(values.size());
+        for (auto value: values) variance += (value - mean) * (value - mean);
+        auto stddev = values.size() > 1 ? std::sqrt(variance / static_cast<double>(values.size() - 1)) : 0.0;
+        out << "      \"" << name << "\": {\"mean\": " << mean
+            << ", \"min\": " << *std::min_element(values.begin(), values.end())
+            << ", \"max\": " << *std::max_element(values.begin(), values.end())
+            << ", \"stddev\": " << stddev << ", \"runs\": [";
+        for (size_t i = 0; i != values.size(); ++i) out << (i ? ", " : "") << values[i];
+        out << "]}";
+    }
+
+    void write_json(std::ostream& out, const settings& setting, const std::vector<scene_result>& results) {
+        out << "{\n  \"build\": {\"compiler\": \"" << __VERSION__ << "\", \"real_bytes\": " << sizeof(real)
+            << ", \"avx2\": " <<
+#ifdef __AVX2__
+            "true"
+#else
+            "false"
+#endif
+            << ", \"statistics\": " <<
+#ifdef RAY_TRACING_STATS
+            "true"
+#else
+            "false"
+#endif
+            << ", \"hardware_threads\": " << std::thread::hardware_concurrency() << "},\n"
+            << "  \"settings\": {\"width\": " << setting.width << ", \"samples_per_pixel\": "
+            << setting.samples_per_pixel << ", \"runs\": " << setting.runs << ", \"seed\": " << setting.seed
+            << "},\n  \"scenes\": [";
+        for (size_t i = 0; i != results.size(); ++i) {
+            const auto& result = results[i];
+            out << (i ? ",\n" : "\n") << "    {\n      \"name\": \"" << result.name << "\",\n"
+                << "      \"primary_rays\": " << result.primary_rays << ",\n"
+                << "      \"total_rays\": " << result.total_rays << ",\n";
+            write_spread(out, "build_ms", result.build_ms);
+            out << ",\n";
+            write_spread(out, "render_ms", result.render_ms);
+            out << ",\n";
+            write_spread(out, "primary_mrays_per_s", result.primary_mrays);
+            out << ",\n";
+            write_spread(out, "total_mrays_per_s", result.total_mrays);
+#ifdef RAY_TRACING_STATS
+            out << ",\n      \"statistics\": {";
+            const char* separator = "";
+            render_stats::for_each(result.statistics, [&](const std::string& name, uint64_t value) {
+                out << separator << "\"" << name << "\": " << value;
+                separator = ", ";
+            });
+            out << "}";
+#endif
+            out << "\n    }";
+        }
+        out << "\n  ]\n}\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    rt_bench::settings setting;
+    if (argc > 1) setting.output = argv[1];
+    if (argc > 2) setting.width = std::stoi(argv[2]);
+    if (argc > 3) setting.samples_per_pixel = std::stoul(argv[3]);
+    if (argc > 4) setting.runs = std::max(1ul, std::stoul(argv[4]));
+    if (argc > 5) setting.scene = argv[5];
+
+    std::vector<rt_bench::scene_result> results;
+    for (const auto& scene: scenes::all()) {
+        if (!setting.scene.empty() && setting.scene != scene.name) continue;
+        results.push_back(rt_bench::run(scene, setting));
+        const auto& result = results.back();
+        std::clog << scene.name << ": render " << *std::min_element(result.render_ms.begin(), result.render_ms.end())
+                  << " ms (best of " << setting.runs << "), "
+                  << *std::max_element(result.total_mrays.begin(), result.total_mrays.end()) << " Mrays/s" << std::endl;
+    }
+    if (results.empty()) {
+        std::cout << "No scene named " << setting.scene << "." << std::endl;
+        return 1;
+    }
+
+    std::ofstream file(setting.output);
+    rt_bench::write_json(file, setting, results);
+    file.close();
+    if (file.fail()) {
+        std::cout << "Error occurred while writing " << setting.output << "." << std::endl;
+        return 1;
+    }
+    std::clog << "Results written to " << setting.output << std::endl;
+    return 0;
+}